@@ -49,5 +49,9 @@ fastpm_emit_event(FastPMEventHandler * handlers,
     const char * type, enum FastPMEventStage stage,
     FastPMEvent * event, void * context);
 
+int
+fastpm_count_event_handlers(FastPMEventHandler * handlers,
+    const char * type, enum FastPMEventStage stage);
+
 void
 fastpm_destroy_event_handlers(FastPMEventHandler ** handlers);
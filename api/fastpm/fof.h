@@ -39,6 +39,29 @@ fastpm_fof_execute(FastPMFOFFinder * finder,
                    FastPMStore * halos,
                    FastPMParticleMaskType * active);
 
+/* local FOF at nll linking lengths in decreasing order, with a single walk of one kdtree.
+ * returns the local groups of each level, to be passed to fastpm_fof_execute_linked;
+ * returns NULL if the linking lengths are not decreasing.
+ *
+ * the groups are created on the stack; free them with fastpm_fof_free_hierarchy.
+ * */
+ptrdiff_t **
+fastpm_fof_link_hierarchy(FastPMFOFFinder * finder,
+                   int nll,
+                   double * linkinglength);
+
+/* same as fastpm_fof_execute, but on the local groups of one level of
+ * fastpm_fof_link_hierarchy. The active particles of a level must be a union of groups
+ * of the previous level. */
+ptrdiff_t *
+fastpm_fof_execute_linked(FastPMFOFFinder * finder,
+                   ptrdiff_t * linked,
+                   FastPMStore * halos,
+                   FastPMParticleMaskType * active);
+
+void
+fastpm_fof_free_hierarchy(FastPMFOFFinder * finder, int nll, ptrdiff_t ** linked);
+
 void
 fastpm_fof_subsample_and_relabel(FastPMFOFFinder * finder,
     FastPMStore * halos,
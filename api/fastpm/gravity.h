@@ -15,9 +15,24 @@ fastpm_solver_compute_force(FastPMSolver * fastpm,
     FastPMPainter * painter,
     FastPMSofteningType dealias,
     FastPMKernelType kernel,
+    FastPMGradientType gradient,
     FastPMFloat * delta_k,
     double Time);
 
+/* as fastpm_solver_compute_force, but the forces are not kept in ACC;
+ * the velocities are kicked with them from kick->ai to af instead. */
+void
+fastpm_solver_compute_force_kick(FastPMSolver * fastpm,
+    PM * pm,
+    FastPMPainter * painter,
+    FastPMSofteningType dealias,
+    FastPMKernelType kernel,
+    FastPMGradientType gradient,
+    FastPMFloat * delta_k,
+    double Time,
+    FastPMKickFactor * kick,
+    double af);
+
 void
 gravity_apply_kernel_transfer(FastPMKernelType kernel, PM * pm, FastPMFloat * delta_k, FastPMFloat * canvas, FastPMFieldDescr field);
 
@@ -4,11 +4,16 @@ enum FastPMFillDeltaKScheme {
     FASTPM_DELTAK_GADGET,
     FASTPM_DELTAK_FAST,
     FASTPM_DELTAK_SLOW,
+    FASTPM_DELTAK_PHILOX, /* counter based; independent of the decomposition */
 };
 void
 fastpm_ic_fill_gaussiank(PM * pm, FastPMFloat * delta_k,
         int seed, enum FastPMFillDeltaKScheme scheme);
 
+/* Philox4x32-10 of Random123, in place on the counter; draws FASTPM_DELTAK_PHILOX */
+void
+fastpm_philox4x32(uint32_t ctr[4], const uint32_t key[2]);
+
 void
 fastpm_ic_remove_variance(PM * pm, FastPMFloat * delta_k);
 
@@ -52,10 +52,13 @@ typedef enum { FASTPM_KERNEL_3_4, FASTPM_KERNEL_3_2, FASTPM_KERNEL_5_4,
 typedef enum { FASTPM_SOFTENING_NONE,
                FASTPM_SOFTENING_GAUSSIAN, FASTPM_SOFTENING_GADGET_LONG_RANGE,
                FASTPM_SOFTENING_TWO_THIRD, FASTPM_SOFTENING_GAUSSIAN36 } FastPMSofteningType;
+typedef enum { FASTPM_GRADIENT_FOURIER,
+               FASTPM_GRADIENT_FD2, FASTPM_GRADIENT_FD4 } FastPMGradientType;
 
 void libfastpm_init();
 void libfastpm_cleanup();
 void libfastpm_set_memory_bound(size_t size);
+void libfastpm_set_memory_numa(int first_touch, int huge_pages);
 
 extern const char * LIBFASTPM_VERSION;
 
@@ -41,6 +41,10 @@ fastpm_push_msg_handler(fastpm_msg_handler handler, MPI_Comm comm, void * userda
 void 
 fastpm_pop_msg_handler();
 
+/* handler of the calling thread only; overrides the global handler. */
+void 
+fastpm_set_thread_msg_handler(fastpm_msg_handler handler, MPI_Comm comm, void * userdata);
+
 void 
 fastpm_default_msg_handler(
         const enum FastPMLogLevel level,
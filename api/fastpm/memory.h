@@ -11,23 +11,58 @@
 #endif
 #endif
 
+#include <stdint.h>
+
 FASTPM_BEGIN_DECLS
 
 typedef struct MemoryBlock MemoryBlock;
+typedef struct MemorySlab MemorySlab;
+typedef struct MemoryTagStat MemoryTagStat;
 typedef struct FastPMMemory FastPMMemory;
 typedef void (*fastpm_memory_func)(FastPMMemory * m, void * userdata);
 
+/* an allocation (positive bytes) or a free (negative bytes) of a block */
+typedef struct {
+    double time; /* seconds since fastpm_memory_init */
+    int32_t itag;
+    int32_t pool;
+    int64_t bytes;
+} FastPMMemoryEvent;
+
 struct FastPMMemory {
     size_t alignment;
+    /* like alignment, set before fastpm_memory_init. first_touch: the pages of the mesh
+     * blocks are touched by the threads in the static OpenMP schedule when first allocated;
+     * the stores touch their columns themselves;
+     * huge_pages: advise transparent huge pages for the pools. */
+    int first_touch;
+    int huge_pages;
     size_t total_bytes;
 
     MemoryBlock * pools[8];
+    /* hash index of the blocks by pointer; the blocks are recycled from slabs */
+    MemoryBlock ** index;
+    size_t index_size;
+    size_t nblocks;
+    MemorySlab * slabs;
+    MemoryBlock * spare;
+
+    /* usage per tag and the timeline of the last allocations */
+    MemoryTagStat * tags;
+    int ntags;
+    int maxtags;
+    FastPMMemoryEvent * timeline;
+    size_t nevents;
+    double t0;
+
     size_t peak_bytes;
     size_t used_bytes;
     size_t free_bytes;
     char * base0;
     char * top;
     char * base;
+    char * heap_touched; /* the pages below are touched */
+    char * stack_touched; /* the pages above are touched */
 
     void * userdata;
     fastpm_memory_func abortfunc;
@@ -59,12 +94,23 @@ fastpm_memory_free(FastPMMemory * m, void * p);
 void *
 fastpm_memory_alloc_details(FastPMMemory * m, const char * name, size_t s, enum FastPMMemoryLocation loc, const char * file, const int line);
 
+/* a block of a mesh; with first_touch its new pages are touched by the static schedule of the mesh loops */
+void *
+fastpm_memory_alloc_mesh_details(FastPMMemory * m, const char * name, size_t s, enum FastPMMemoryLocation loc, const char * file, const int line);
+
 void
 fastpm_memory_dump_status(FastPMMemory * m, int fd);
 
 void
 fastpm_memory_dump_status_str(FastPMMemory * m, char * buf, int n);
 
+/* the bytes of every tag at the high-water mark, their peaks and current usage */
+void
+fastpm_memory_dump_tags(FastPMMemory * m, int fd);
+
+void
+fastpm_memory_dump_timeline(FastPMMemory * m, int fd);
+
 #define fastpm_memory_alloc(m, name, s, loc) fastpm_memory_alloc_details(m, name, s, loc, __FILE__, __LINE__)
 
 FASTPM_END_DECLS
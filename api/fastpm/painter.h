@@ -7,6 +7,7 @@ struct FastPMPainter {
 
     void   (*paint)(FastPMPainter * painter, FastPMFloat * canvas, double pos[3], double weight, int diffdir);
     double (*readout)(FastPMPainter * painter, FastPMFloat * canvas, double pos[3], int diffdir);
+    void   (*readout_many)(FastPMPainter * painter, FastPMFloat * canvas[], int nfields, double pos[3], int diffdir, double value[]);
     fastpm_kernelfunc kernel;
     fastpm_kernelfunc diff;
 
@@ -17,6 +18,7 @@ struct FastPMPainter {
     int left; /* offset to start the kernel, (support - 1) / 2*/
     int Npoints; /* (support) ** 3 */
     double shift;
+    int tiled; /* paint by slabs of planes without atomics; reproducible for any number of threads */
 };
 
 void fastpm_painter_init(FastPMPainter * painter, PM * pm,
@@ -30,6 +32,16 @@ void
 fastpm_readout_local(FastPMPainter * painter, FastPMFloat * canvas,
         FastPMStore * p, size_t size, FastPMFieldDescr field);
 
+/* read out several meshes into several columns, sharing the kernel weights */
+void
+fastpm_readout_local_many(FastPMPainter * painter, FastPMFloat * canvas[], int nfields,
+        FastPMStore * p, size_t size, FastPMFieldDescr field[]);
+
+/* as fastpm_readout_local_many, but adds scale[f] times the values to the columns */
+void
+fastpm_readout_local_many_add(FastPMPainter * painter, FastPMFloat * canvas[], int nfields,
+        FastPMStore * p, size_t size, FastPMFieldDescr field[], const double scale[]);
+
 void
 fastpm_paint(FastPMPainter * painter, FastPMFloat * canvas,
         FastPMStore * p, FastPMFieldDescr field);
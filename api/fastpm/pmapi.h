@@ -102,6 +102,25 @@ pm_r2c(PM * pm, FastPMFloat * from, FastPMFloat * to);
 void 
 pm_c2r(PM * pm, FastPMFloat * inplace);
 
+/*
+ * Transform howmany fields in batches of up to max_batched_ffts (at most 6)
+ * fields with a single plan; the fields of a batch are interleaved into a
+ * scratch buffer on the stack, such that the transposes of all fields share
+ * the same messages. A batch shrinks if the scratch does not fit in the free
+ * memory of any rank; a batch of one field is a plain pm_r2c / pm_c2r.
+ * Same conventions as pm_r2c and pm_c2r.
+ * */
+void
+pm_r2c_many(PM * pm, FastPMFloat * from[], FastPMFloat * to[], int howmany);
+void
+pm_c2r_many(PM * pm, FastPMFloat * inplace[], int howmany);
+
+/* number of fields (at most howmany) a caller shall transform together,
+ * given that it allocates a new field for all but the first of the batch.
+ * Collective; the same on all ranks. */
+int
+pm_batch_size(PM * pm, int howmany);
+
 PM *
 fastpm_create_pm(int Ngrid, int NprocY, int transposed, double BoxSize, MPI_Comm comm);
 
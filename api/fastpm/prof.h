@@ -21,6 +21,9 @@ FastPMClock *
 fastpm_clock_find(const char * file, const char * func, const char * name);
 void fastpm_clock_out_barrier(FastPMClock * clock, MPI_Comm comm);
 
+/* the clocks are shared by all threads; the calling thread does not use them afterwards. */
+void fastpm_clock_skip_thread();
+
 #define CLOCK(name) FastPMClock * CLK ## name = fastpm_clock_find(__FILE__, __func__, # name);\
                     fastpm_clock_in(CLK ## name);
 
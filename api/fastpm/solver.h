@@ -3,6 +3,7 @@ FASTPM_BEGIN_DECLS
 #define FASTPM_EVENT_LPT "LPT"
 #define FASTPM_EVENT_TRANSITION "TRANSITION"
 #define FASTPM_EVENT_INTERPOLATION "INTERPOLATION"
+#define FASTPM_EVENT_INTERPOLATION_QUERY "INTERPOLATIONQUERY"
 
 typedef struct VPM VPM;
 
@@ -23,6 +24,18 @@ typedef struct {
     int whence; /* TIMESTEP_START, TIMESTEP_CUR, TIMESTEP_END */
 } FastPMInterpolationEvent;
 
+/* Asks the INTERPOLATION handlers whether they would act on (a1, a2]. Every
+ * handler answers by incrementing nanswers, and sets wanted if it would act.
+ * The solver skips the interpolation and fuses the kick with the following
+ * drift only if all INTERPOLATION handlers answered and none wanted it. */
+typedef struct {
+    FastPMEvent base;
+    double a1;
+    double a2;
+    int nanswers;
+    int wanted;
+} FastPMInterpolationQueryEvent;
+
 typedef struct {
     FastPMEvent base;
     FastPMTransition * transition;
@@ -64,12 +77,18 @@ typedef struct {
     /* FIXME: give them better looking names. */
     FastPMPainterType PAINTER_TYPE;
     int painter_support;
+    int painter_tiled;
+    int sort_particles; /* keep particles in the Morton order of the mesh cells */
+    int kick_in_readout; /* kick the particles as the force is read out; no ACC column */
     FastPMForceType FORCE_TYPE;
     FastPMKernelType KERNEL_TYPE;
     FastPMSofteningType SOFTENING_TYPE;
+    FastPMGradientType GRADIENT_TYPE;
 
     int NprocY;  /* Use 0 for auto */
     int UseFFTW; /* Use 0 for PFFT 1 for FFTW */
+    const char * fft_wisdom; /* prefix of the FFT wisdom files; NULL to plan by estimates */
+    int max_batched_ffts; /* max fields per batched FFT; 0 or 1 for one by one */
     int pgdc;
     double pgdc_alpha0;
     double pgdc_A;
@@ -174,15 +193,31 @@ void fastpm_drift_init(FastPMDriftFactor * drift, FastPMSolver * fastpm, double
 void fastpm_kick_init(FastPMKickFactor * kick, FastPMSolver * fastpm, double ai, double ac, double af);
 void fastpm_kick_one(FastPMKickFactor * kick, FastPMStore * p,  ptrdiff_t i, float vo[3], double af);
 void fastpm_drift_one(FastPMDriftFactor * drift, FastPMStore * p, ptrdiff_t i, double xo[3], double ae);
+void fastpm_drift_factors(FastPMDriftFactor * drift, FastPMStore * p, double ae, double factors[3]);
+void fastpm_drift_one_factors(FastPMDriftFactor * drift, FastPMStore * p, ptrdiff_t i, double xo[3], const double factors[3]);
+/* v' = v + c[0] * acc + c[1] * dx1 + c[2] * dx2; returns whether c[1] and c[2] are used. */
+int fastpm_kick_factors(FastPMKickFactor * kick, FastPMStore * p, double af, double c[3]);
 
 void 
 fastpm_kick_store(FastPMKickFactor * kick,
     FastPMStore * pi, FastPMStore * po, double af);
 
+/* the kick after the force readout has added the acc term to v. */
+void
+fastpm_kick_store_noacc(FastPMKickFactor * kick, FastPMStore * p, double af);
+
+/* if BoxSize is not NULL, the positions are also wrapped into the box. */
 void 
 fastpm_drift_store(FastPMDriftFactor * drift,
                FastPMStore * pi, FastPMStore * po,
-               double af);
+               double af, double * BoxSize);
+
+/* a kick to af_kick followed by a drift to af_drift in one pass; the drift
+ * uses the kicked velocity. */
+void
+fastpm_kick_drift_store(FastPMKickFactor * kick, FastPMDriftFactor * drift,
+    FastPMStore * pi, FastPMStore * po,
+    double af_kick, double af_drift, double * BoxSize);
 
 void 
 fastpm_set_snapshot(FastPMSolver * fastpm,
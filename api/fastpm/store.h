@@ -57,6 +57,10 @@ typedef enum FastPMColumnTags {
     COLUMN_RAND = 1L << 21,
     COLUMN_RMOM = 1L << 22,  /* Radial momentum m * rhat dot (a dx/dt), used in lightcone map*/
 
+    /* position as 32 bit fixed point offsets in the periodic box;
+     * replaces COLUMN_POS when requested, see fastpm_store_get_position. */
+    COLUMN_POS_FIXED = 1L << 23,
+
 } FastPMColumnTags;
 
 struct FastPMStore {
@@ -96,6 +100,8 @@ struct FastPMStore {
         double _q_scale[3];
         ptrdiff_t _q_strides[3];
         ptrdiff_t _q_size;
+
+        double _x_boxsize[3]; /* periodic box of the fixed point positions */
     } meta;
 
     union {
@@ -130,6 +136,9 @@ struct FastPMStore {
             /* other fields */
             float (* rand);   /* a random number between 0 and 1 */
             float (* rmom);   /* radial momentum, m rhat dot (a dx/dt) */
+
+            /* x in units of _x_boxsize / 2**32; used instead of x for COLUMN_POS_FIXED */
+            uint32_t (* xfix)[3];
         };
     };
 };
@@ -215,6 +224,11 @@ fastpm_store_summary(FastPMStore * p,
 void
 fastpm_store_wrap(FastPMStore * p, double BoxSize[3]);
 
+/* wrap the position of particle i into the box */
+void
+fastpm_store_wrap_one(FastPMStore * p, ptrdiff_t i, double BoxSize[3]);
+
+/* called concurrently from several threads */
 typedef int (*fastpm_store_target_func)(FastPMStore * p, ptrdiff_t index, void * data);
 
 int
@@ -223,6 +237,12 @@ fastpm_store_decompose(FastPMStore * p, fastpm_store_target_func target_func, vo
 void
 fastpm_store_permute(FastPMStore * p, int * ind);
 
+void
+fastpm_store_gather(FastPMStore * p, int * ind);
+
+void
+fastpm_store_sort_morton(FastPMStore * p, PM * pm);
+
 int
 FastPMLocalSortByID(const int i1,
                     const int i2,
@@ -266,6 +286,9 @@ void
 fastpm_store_extend(FastPMStore * p, FastPMStore * extra);
 
 void fastpm_store_get_position(FastPMStore * p, ptrdiff_t index, double pos[3]);
+/* with COLUMN_POS_FIXED the position is wrapped into the box */
+void fastpm_store_set_position(FastPMStore * p, ptrdiff_t index, const double pos[3]);
+void fastpm_store_set_boxsize(FastPMStore * p, const double BoxSize[3]);
 void fastpm_store_get_lagrangian_position(FastPMStore * p, ptrdiff_t index, double pos[3]);
 
 int
@@ -1,3 +1,6 @@
+#ifndef _FASTPM_TRANSFER_H
+#define _FASTPM_TRANSFER_H
+
 FASTPM_BEGIN_DECLS
 
 void
@@ -21,6 +24,11 @@ fastpm_apply_laplace_transfer(PM * pm, FastPMFloat * from, FastPMFloat * to, int
 void
 fastpm_apply_any_transfer(PM * pm, FastPMFloat * from, FastPMFloat * to, fastpm_fkfunc func, void * data);
 
+/* Same as fastpm_apply_any_transfer, but func is evaluated once per integer k**2
+ * (in units of the fundamental mode) into a table; each mode looks up the table. */
+void
+fastpm_apply_radial_transfer(PM * pm, FastPMFloat * from, FastPMFloat * to, fastpm_fkfunc func, void * data);
+
 void
 fastpm_apply_normalize_transfer(PM * pm, FastPMFloat * from, FastPMFloat * to);
 
@@ -36,4 +44,72 @@ fastpm_apply_set_mode_transfer(PM * pm, FastPMFloat * from, FastPMFloat * to, pt
 double
 fastpm_apply_get_mode_transfer(PM * pm, FastPMFloat * from, ptrdiff_t * mode);
 
+#define FASTPM_TRANSFER_CHAIN_MAX 4
+/* entries of the radial table, 4 MB */
+#define FASTPM_TRANSFER_RADIAL_MAX (1 << 19)
+
+/* A chain of transfers, applied to a complex field in a single sweep.
+ * The separable factors (decic, smoothing, the k of the derivatives)
+ * are folded into one table per axis as the stages are added. */
+typedef struct {
+    PM * pm;
+    double scale;
+    double * kernel[3];
+    int nimag; /* powers of i from the derivatives */
+    int zero_selfconj; /* a gradient of a real field is zero on the self-conjugate modes */
+    int nlaplace;
+    int laplace[FASTPM_TRANSFER_CHAIN_MAX]; /* orders of the inverse laplace */
+    double lowpass_kk;
+    int nfunc;
+    fastpm_fkfunc func[FASTPM_TRANSFER_CHAIN_MAX];
+    void * data[FASTPM_TRANSFER_CHAIN_MAX];
+    /* product of the radial stages, indexed by integer k**2 - radial_start */
+    double * radial;
+    ptrdiff_t radial_start;
+    ptrdiff_t radial_size;
+} FastPMTransferChain;
+
+void
+fastpm_transfer_chain_init(FastPMTransferChain * chain, PM * pm);
+
+void
+fastpm_transfer_chain_destroy(FastPMTransferChain * chain);
+
+void
+fastpm_transfer_chain_add_multiply(FastPMTransferChain * chain, double value);
+
+void
+fastpm_transfer_chain_add_decic(FastPMTransferChain * chain);
+
+void
+fastpm_transfer_chain_add_smoothing(FastPMTransferChain * chain, double sml);
+
+void
+fastpm_transfer_chain_add_lowpass(FastPMTransferChain * chain, double kth);
+
+/* 1 / k**2; same orders as fastpm_apply_laplace_transfer */
+void
+fastpm_transfer_chain_add_laplace(FastPMTransferChain * chain, int order);
+
+/* i k[dir]; same as fastpm_apply_diff_transfer */
+void
+fastpm_transfer_chain_add_diff(FastPMTransferChain * chain, int dir, int order);
+
+/* i k[dir], and zero on the self-conjugate modes, such that the result stays real. */
+void
+fastpm_transfer_chain_add_grad(FastPMTransferChain * chain, int dir, int order);
+
+void
+fastpm_transfer_chain_add_any(FastPMTransferChain * chain, fastpm_fkfunc func, void * data);
+
+/* func(k) tabulated on the integer k**2 of the local modes; see fastpm_apply_radial_transfer.
+ * as add_any if the table would be longer than the local modes or FASTPM_TRANSFER_RADIAL_MAX. */
+void
+fastpm_transfer_chain_add_radial(FastPMTransferChain * chain, fastpm_fkfunc func, void * data);
+
+void
+fastpm_transfer_chain_apply(FastPMTransferChain * chain, FastPMFloat * from, FastPMFloat * to);
+
 FASTPM_END_DECLS
+
+#endif
@@ -319,6 +319,133 @@ kd_fof_buggy(KDNode * node, double linking_length, ptrdiff_t * head)
 }
 
 
+/* Hierarchical FOF:
+ *
+ * FOF at several linking lengths in decreasing order with a single walk of the tree
+ * at the largest linking length. Each level keeps its own trees of heads and
+ * connection status of nodes; an edge of separation r is merged into every level with
+ * ll >= r.
+ *
+ * A node is opened unless it is connected at the finest level (thus at all levels).
+ * Between two such nodes we stop at the first pair that is linked at the finest level.
+ * */
+
+typedef struct HierTraverseData {
+    int nll;
+    TraverseData * levels;
+} HierTraverseData;
+
+static int
+_kd_fof_hier_visit_edge(void * data, KDEnumPair * pair)
+{
+    HierTraverseData * htrav = (HierTraverseData *) data;
+    int k;
+    for(k = 0; k < htrav->nll; k ++) {
+        if(pair->r > htrav->levels[k].ll) break;
+        _kd_fof_visit_edge(&htrav->levels[k], pair);
+    }
+    return 0;
+}
+
+static int
+_kd_fof_hier_visit_edge_connected(void * data, KDEnumPair * pair)
+{
+    HierTraverseData * htrav = (HierTraverseData *) data;
+    _kd_fof_hier_visit_edge(data, pair);
+    if(pair->r <= htrav->levels[htrav->nll - 1].ll) return -1;
+    return 0;
+}
+
+static int
+_kd_fof_hier_check_nodes(void * data, KDEnumNodePair * pair)
+{
+    HierTraverseData * htrav = (HierTraverseData *) data;
+    TraverseData * finest = &htrav->levels[htrav->nll - 1];
+    TraverseData * coarsest = &htrav->levels[0];
+
+    if(finest->node_connected[pair->nodes[0]->index]
+    && finest->node_connected[pair->nodes[1]->index]) {
+        kd_enum_check(pair->nodes, coarsest->ll2, 1, _kd_fof_hier_visit_edge_connected, data);
+    } else {
+        kd_enum_check(pair->nodes, coarsest->ll2, 1, _kd_fof_hier_visit_edge, data);
+    }
+    coarsest->enumerated += (pair->nodes[0]->size * pair->nodes[1]->size); /* this count is duplicated. shall divide by two */
+    return 0;
+}
+
+static int
+_kd_fof_hier_visit_node(void * data, KDNode * node)
+{
+    HierTraverseData * htrav = (HierTraverseData *) data;
+    return htrav->levels[htrav->nll - 1].node_connected[node->index] == 0;
+}
+
+int
+kd_fof_hierarchical(KDNode * node, int nll, double * linking_length, ptrdiff_t ** head)
+{
+    KDNode * nodes[2] = {node, node};
+    HierTraverseData htrav[1];
+    TraverseData * levels = calloc(nll, sizeof(TraverseData));
+    int k;
+
+    for(k = 1; k < nll; k ++) {
+        if(linking_length[k] > linking_length[k - 1]) {
+            free(levels);
+            return -1;
+        }
+    }
+
+    htrav->nll = nll;
+    htrav->levels = levels;
+
+    for(k = 0; k < nll; k ++) {
+        TraverseData * trav = &levels[k];
+        trav->head = head[k];
+        trav->ll = linking_length[k];
+        trav->ll2 = linking_length[k] * linking_length[k];
+        trav->node_connected = calloc(node->tree->size, 1);
+        trav->ind = node->tree->ind;
+        trav->safe = 1;
+
+        ptrdiff_t i;
+        for(i = node->start; i < node->start + node->size; i ++) {
+            ptrdiff_t j = trav->ind[i];
+            trav->head[j] = j;
+        }
+        connect(trav, node, 0);
+    }
+
+    kd_enum_full(nodes, linking_length[0], NULL, _kd_fof_hier_check_nodes, _kd_fof_hier_visit_node, 1.0, 1, htrav);
+
+    for(k = 0; k < nll; k ++) {
+        TraverseData * trav = &levels[k];
+        ptrdiff_t i;
+        for(i = node->start; i < node->start + node->size; i ++) {
+            ptrdiff_t j = trav->ind[i];
+            trav->head[j] = splay(trav, j);
+        }
+        free(trav->node_connected);
+    }
+
+    last_traverse.visited = 0;
+    last_traverse.enumerated = levels[0].enumerated;
+    last_traverse.connected = 0;
+    last_traverse.maxdepth = 0;
+    last_traverse.nsplay = 0;
+    last_traverse.totaldepth = 0;
+    for(k = 0; k < nll; k ++) {
+        last_traverse.visited += levels[k].visited;
+        last_traverse.nsplay += levels[k].nsplay;
+        last_traverse.totaldepth += levels[k].totaldepth;
+        if(levels[k].maxdepth > last_traverse.maxdepth) {
+            last_traverse.maxdepth = levels[k].maxdepth;
+        }
+    }
+
+    free(levels);
+    return 0;
+}
+
 void
 kd_fof_get_last_traverse_info(ptrdiff_t *visited, ptrdiff_t *enumerated, ptrdiff_t *connected,
                               ptrdiff_t *maxdepth, ptrdiff_t *nsplay, ptrdiff_t *totaldepth)
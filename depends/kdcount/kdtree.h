@@ -274,6 +274,11 @@ kd_fof_unsafe(KDNode * tree, double linking_length, ptrdiff_t * head);
 int 
 kd_fof_heuristics(KDNode * tree, double linking_length, ptrdiff_t * head);
 
+/* FOF at nll linking lengths in decreasing order with a single tree walk;
+ * head[k] receives the labels of level k. returns -1 if not decreasing. */
+int
+kd_fof_hierarchical(KDNode * tree, int nll, double * linking_length, ptrdiff_t ** head);
+
 void
 kd_count(KDNode * nodes[2], KDAttr * attrs[2],
         double * edges, uint64_t * count, double * weight,
@@ -98,6 +98,23 @@ fastpm_emit_event(FastPMEventHandler * handlers,
     }
 }
 
+/**
+ * number of handlers of an event type and stage on the list.
+ */
+int
+fastpm_count_event_handlers(FastPMEventHandler * handlers,
+    const char * type, enum FastPMEventStage stage)
+{
+    int n = 0;
+    FastPMEventHandler * handler = handlers;
+    for(; handler; handler = handler->next) {
+        if(0 != strcmp(handler->type, type)) continue;
+        if(handler->stage != stage) continue;
+        n ++;
+    }
+    return n;
+}
+
 void
 fastpm_destroy_event_handlers(FastPMEventHandler ** handlers)
 {
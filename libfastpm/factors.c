@@ -69,39 +69,59 @@ fastpm_drift_lookup(FastPMDriftFactor * drift, double af, double * dyyy, double
     }
 }
 
-inline void
-fastpm_drift_one(FastPMDriftFactor * drift, FastPMStore * p, ptrdiff_t i, double xo[3], double af)
+/* the drift factors (dyyy, da1, da2) from p->meta.a_x to af. */
+void
+fastpm_drift_factors(FastPMDriftFactor * drift, FastPMStore * p, double af, double factors[3])
 {
-
     double dyyy_f, da1_f, da2_f;
     double dyyy_i, da1_i, da2_i;
-    double dyyy, da1, da2;
 
     fastpm_drift_lookup(drift, af, &dyyy_f, &da1_f, &da2_f);
     fastpm_drift_lookup(drift, p->meta.a_x, &dyyy_i, &da1_i, &da2_i);
 
-    dyyy = dyyy_f - dyyy_i;
-    da1 = da1_f - da1_i;
-    da2 = da2_f - da2_i;
+    factors[0] = dyyy_f - dyyy_i;
+    factors[1] = da1_f - da1_i;
+    factors[2] = da2_f - da2_i;
+}
+
+inline void
+fastpm_drift_one(FastPMDriftFactor * drift, FastPMStore * p, ptrdiff_t i, double xo[3], double af)
+{
+    double factors[3];
+
+    fastpm_drift_factors(drift, p, af, factors);
+    fastpm_drift_one_factors(drift, p, i, xo, factors);
+}
+
+/* drift with factors from fastpm_drift_factors; xo is affine in the factors. */
+inline void
+fastpm_drift_one_factors(FastPMDriftFactor * drift, FastPMStore * p, ptrdiff_t i, double xo[3], const double factors[3])
+{
+    const double dyyy = factors[0];
+    const double da1 = factors[1];
+    const double da2 = factors[2];
+
+    double x[3];
+    fastpm_store_get_position(p, i, x);
 
     int d;
     for(d = 0; d < 3; d ++) {
         double v;
         switch(drift->forcemode) {
             case FASTPM_FORCE_2LPT:
-                xo[d] = p->x[i][d] + p->dx1[i][d] * da1 + p->dx2[i][d] * da2;
+                xo[d] = x[d] + p->dx1[i][d] * da1 + p->dx2[i][d] * da2;
             break;
             case FASTPM_FORCE_ZA:
-                xo[d] = p->x[i][d] + p->dx1[i][d] * da1;
+                xo[d] = x[d] + p->dx1[i][d] * da1;
             break;
             case FASTPM_FORCE_FASTPM:
             case FASTPM_FORCE_PM:
-                xo[d] = p->x[i][d] + p->v[i][d] * dyyy;
+                xo[d] = x[d] + p->v[i][d] * dyyy;
             break;
             case FASTPM_FORCE_COLA:
                 /* For cola, remove the lpt velocity to find the residual velocity v*/
                 v = p->v[i][d] - (p->dx1[i][d]*drift->Dv1 + p->dx2[i][d]*drift->Dv2);
-                xo[d] = p->x[i][d] + v * dyyy;
+                xo[d] = x[d] + v * dyyy;
                 xo[d] += p->dx1[i][d] * da1 + p->dx2[i][d] * da2;
             break;
         }
@@ -172,23 +192,127 @@ fastpm_kick_one(FastPMKickFactor * kick, FastPMStore * p, ptrdiff_t i, float vo[
 
 // Leap frog time integration
 
+/*
+ * The store-level kick and drift look up the factors once per call, and
+ * fold the force mode into per-column coefficients:
+ *
+ *   v' = v + ca * acc + c1 * dx1 + c2 * dx2
+ *   x' = x + cv * v + c1 * dx1 + c2 * dx2 + cp * pgdc
+ *
+ * The has_* flags are constants at every call site, so the inlined loops
+ * carry no per-particle branches and are left for the compiler to vectorize.
+ * The kernels are orphaned omp for loops, to be called in a parallel region.
+ * */
+
+/* coefficients of acc, dx1 and dx2 from p->meta.a_v to af; returns whether
+ * the dx columns are used. */
+int
+fastpm_kick_factors(FastPMKickFactor * kick, FastPMStore * p, double af, double c[3])
+{
+    double dda_i, Dv1_i, Dv2_i;
+    double dda_f, Dv1_f, Dv2_f;
+
+    fastpm_kick_lookup(kick, af, &dda_f, &Dv1_f, &Dv2_f);
+    fastpm_kick_lookup(kick, p->meta.a_v, &dda_i, &Dv1_i, &Dv2_i);
+
+    const double dda = dda_f - dda_i;
+    c[0] = dda;
+    c[1] = 0;
+    c[2] = 0;
+
+    if(kick->forcemode != FASTPM_FORCE_COLA) return 0;
+
+    c[1] = kick->q1 * dda + (Dv1_f - Dv1_i);
+    c[2] = kick->q2 * dda + (Dv2_f - Dv2_i);
+    return 1;
+}
+
+/* coefficients of v, dx1, dx2 and pgdc from p->meta.a_x to af; returns
+ * whether the pgdc column is used. See fastpm_drift_one_factors. */
+static int
+_drift_coeffs(FastPMDriftFactor * drift, FastPMStore * p, double af, double c[4])
+{
+    double factors[3];
+    fastpm_drift_factors(drift, p, af, factors);
+
+    const double dyyy = factors[0];
+
+    c[0] = c[1] = c[2] = c[3] = 0;
+    switch(drift->forcemode) {
+        case FASTPM_FORCE_2LPT:
+            c[1] = factors[1];
+            c[2] = factors[2];
+        break;
+        case FASTPM_FORCE_ZA:
+            c[1] = factors[1];
+        break;
+        case FASTPM_FORCE_FASTPM:
+        case FASTPM_FORCE_PM:
+            c[0] = dyyy;
+        break;
+        case FASTPM_FORCE_COLA:
+            /* For cola, remove the lpt velocity to find the residual velocity v*/
+            c[0] = dyyy;
+            c[1] = factors[1] - drift->Dv1 * dyyy;
+            c[2] = factors[2] - drift->Dv2 * dyyy;
+        break;
+    }
+
+    /* no drift; to protect the pgdc line */
+    if(!p->pgdc || drift->ai == drift->af) return 0;
+
+    c[3] = 0.5 * dyyy / drift->dyyy[drift->nsamples-1];
+    return 1;
+}
+
+static inline void
+_kick_kernel(FastPMStore * pi, FastPMStore * po, const double c[3], const int has_acc, const int has_dx)
+{
+    ptrdiff_t i;
+#pragma omp for schedule(static)
+    for(i = 0; i < pi->np; i ++) {
+        int d;
+        for(d = 0; d < 3; d ++) {
+            double v = pi->v[i][d];
+            if(has_acc) {
+                v += c[0] * pi->acc[i][d];
+            }
+            if(has_dx) {
+                v += c[1] * pi->dx1[i][d] + c[2] * pi->dx2[i][d];
+            }
+            po->v[i][d] = v;
+        }
+    }
+}
+
 void 
 fastpm_kick_store(FastPMKickFactor * kick,
     FastPMStore * pi, FastPMStore * po, double af)
 {
-    int np = pi->np;
-
     // Kick using acceleration at a= ac
     // Assume forces at a=ac is in particles->force
 
-    int i;
-#pragma omp parallel for
-    for(i=0; i<np; i++) {
-        int d;
-        float vo[3];
-        fastpm_kick_one(kick, pi, i, vo, af);
-        for(d = 0; d < 3; d++) {
-            po->v[i][d] = vo[d];
+    double c[3];
+    int has_dx = fastpm_kick_factors(kick, pi, af, c);
+
+    /* without ACC (see fastpm_solver_compute_force_kick) only the null
+     * kicks of the interpolation at the start and the end can be done. */
+    if(pi->acc == NULL && c[0] != 0) {
+        fastpm_raise(-1, "No ACC column to kick the particles with.\n");
+    }
+
+#pragma omp parallel
+    {
+        if(pi->acc) {
+            if(has_dx)
+                _kick_kernel(pi, po, c, 1, 1);
+            else
+                _kick_kernel(pi, po, c, 1, 0);
+        } else {
+            if(has_dx)
+                _kick_kernel(pi, po, c, 0, 1);
+            else
+                _kick_kernel(pi, po, c, 0, 0);
         }
     }
 
@@ -196,6 +320,169 @@ fastpm_kick_store(FastPMKickFactor * kick,
     po->meta.a_v = af;
 }
 
+/* the rest of a kick whose acceleration term has been added to v by the
+ * force readout: the dx1 and dx2 terms of COLA. */
+void
+fastpm_kick_store_noacc(FastPMKickFactor * kick, FastPMStore * p, double af)
+{
+    double c[3];
+    int has_dx = fastpm_kick_factors(kick, p, af, c);
+
+    if(has_dx) {
+#pragma omp parallel
+        {
+            _kick_kernel(p, p, c, 0, 1);
+        }
+    }
+    p->meta.a_v = af;
+}
+
+/* drift, optionally after a kick of the same particle; the drift uses the
+ * kicked velocity. returns the largest number of boxes a particle is
+ * wrapped by on this thread.
+ *
+ * With xfix the displacement is rounded to the fixed point unit and added to
+ * the integer position, which wraps by itself; L is the box of the store. */
+static inline double
+_kick_drift_kernel(FastPMStore * pi, FastPMStore * po,
+    const double ck[3], const double cd[4], const double L[3],
+    const int kick, const int kick_dx,
+    const int has_v, const int has_dx1, const int has_dx2, const int has_pgdc, const int wrap,
+    const int xfix)
+{
+    double invL[3] = {0, 0, 0};
+    int d;
+    if(wrap) {
+        for(d = 0; d < 3; d ++) invL[d] = 1. / L[d];
+    }
+    if(xfix) {
+        for(d = 0; d < 3; d ++) invL[d] = 4294967296.0 / L[d];
+    }
+
+    double nmax = 0;
+    ptrdiff_t i;
+#pragma omp for schedule(static)
+    for(i = 0; i < pi->np; i ++) {
+        for(d = 0; d < 3; d ++) {
+            float v = 0;
+            if(kick || has_v) v = pi->v[i][d];
+            if(kick) {
+                double v1 = v + ck[0] * pi->acc[i][d];
+                if(kick_dx) v1 += ck[1] * pi->dx1[i][d] + ck[2] * pi->dx2[i][d];
+                v = v1;
+                po->v[i][d] = v;
+            }
+            double x = xfix ? 0 : pi->x[i][d];
+            if(has_v) x += cd[0] * v;
+            if(has_dx1) x += cd[1] * pi->dx1[i][d];
+            if(has_dx2) x += cd[2] * pi->dx2[i][d];
+            if(has_pgdc) x += cd[3] * pi->pgdc[i][d];
+            if(xfix) {
+                po->xfix[i][d] = pi->xfix[i][d] + (uint32_t) (int64_t) floor(x * invL[d] + 0.5);
+                continue;
+            }
+            if(wrap) {
+                double n = floor(x * invL[d]);
+                x -= n * L[d];
+                nmax = fmax(nmax, fabs(n));
+            }
+            po->x[i][d] = x;
+        }
+    }
+    return nmax;
+}
+
+static inline double
+_kick_drift_kernel_mode(FastPMForceType forcemode, FastPMStore * pi, FastPMStore * po,
+    const double ck[3], const double cd[4], const double L[3],
+    const int kick, const int has_pgdc, const int wrap, const int xfix)
+{
+    switch(forcemode) {
+        case FASTPM_FORCE_2LPT:
+            return _kick_drift_kernel(pi, po, ck, cd, L, kick, 0, 0, 1, 1, has_pgdc, wrap, xfix);
+        case FASTPM_FORCE_ZA:
+            return _kick_drift_kernel(pi, po, ck, cd, L, kick, 0, 0, 1, 0, has_pgdc, wrap, xfix);
+        case FASTPM_FORCE_FASTPM:
+        case FASTPM_FORCE_PM:
+            return _kick_drift_kernel(pi, po, ck, cd, L, kick, 0, 1, 0, 0, has_pgdc, wrap, xfix);
+        case FASTPM_FORCE_COLA:
+            return _kick_drift_kernel(pi, po, ck, cd, L, kick, kick, 1, 1, 1, has_pgdc, wrap, xfix);
+    }
+    return 0;
+}
+
+static inline double
+_kick_drift_kernel_flags(FastPMForceType forcemode, FastPMStore * pi, FastPMStore * po,
+    const double ck[3], const double cd[4], const double L[3],
+    const int kick, const int has_pgdc, const int wrap, const int xfix)
+{
+    if(has_pgdc) {
+        if(wrap)
+            return _kick_drift_kernel_mode(forcemode, pi, po, ck, cd, L, kick, 1, 1, xfix);
+        else
+            return _kick_drift_kernel_mode(forcemode, pi, po, ck, cd, L, kick, 1, 0, xfix);
+    } else {
+        if(wrap)
+            return _kick_drift_kernel_mode(forcemode, pi, po, ck, cd, L, kick, 0, 1, xfix);
+        else
+            return _kick_drift_kernel_mode(forcemode, pi, po, ck, cd, L, kick, 0, 0, xfix);
+    }
+}
+
+static void
+_kick_drift_run(FastPMForceType forcemode, FastPMStore * pi, FastPMStore * po,
+    const double ck[3], const double cd[4], double * BoxSize,
+    const int kick, const int has_pgdc)
+{
+    const int xfix = pi->xfix != NULL;
+    const int wrap = BoxSize != NULL && !xfix;
+    double L[3] = {1, 1, 1};
+    if(xfix) {
+        memcpy(L, pi->meta._x_boxsize, sizeof(L));
+    } else if(wrap) {
+        memcpy(L, BoxSize, sizeof(L));
+    }
+
+    double nmax = 0;
+#pragma omp parallel reduction(max: nmax)
+    {
+        if(xfix) {
+            if(kick)
+                nmax = _kick_drift_kernel_flags(forcemode, pi, po, ck, cd, L, 1, has_pgdc, 0, 1);
+            else
+                nmax = _kick_drift_kernel_flags(forcemode, pi, po, ck, cd, L, 0, has_pgdc, 0, 1);
+        } else {
+            if(kick)
+                nmax = _kick_drift_kernel_flags(forcemode, pi, po, ck, cd, L, 1, has_pgdc, wrap, 0);
+            else
+                nmax = _kick_drift_kernel_flags(forcemode, pi, po, ck, cd, L, 0, has_pgdc, wrap, 0);
+        }
+    }
+
+    if(nmax > 10000) {
+        fastpm_raise(-1, "Particles are %g boxes away from the bounds. Wrapping failed.\n", nmax);
+    }
+}
+
+void
+fastpm_kick_drift_store(FastPMKickFactor * kick, FastPMDriftFactor * drift,
+    FastPMStore * pi, FastPMStore * po,
+    double af_kick, double af_drift, double * BoxSize)
+{
+    if(kick->forcemode != drift->forcemode) {
+        fastpm_raise(-1, "kick and drift must use the same force mode.\n");
+    }
+    double ck[3];
+    double cd[4];
+    fastpm_kick_factors(kick, pi, af_kick, ck);
+    int has_pgdc = _drift_coeffs(drift, pi, af_drift, cd);
+
+    _kick_drift_run(drift->forcemode, pi, po, ck, cd, BoxSize, 1, has_pgdc);
+
+    po->meta.a_v = af_kick;
+    po->meta.a_x = af_drift;
+}
+
 static double G_p(FastPMGrowthInfo * growth_info)
 {
     /* integral of G_p */
@@ -373,21 +660,13 @@ fastpm_drift_init(FastPMDriftFactor * drift, FastPMSolver * fastpm,
 void
 fastpm_drift_store(FastPMDriftFactor * drift,
                FastPMStore * pi, FastPMStore * po,
-               double af)
+               double af, double * BoxSize)
 {
-    int np = pi->np;
+    double cd[4];
+    int has_pgdc = _drift_coeffs(drift, pi, af, cd);
+
+    _kick_drift_run(drift->forcemode, pi, po, NULL, cd, BoxSize, 0, has_pgdc);
 
-    int i;
-    // Drift
-#pragma omp parallel for
-    for(i=0; i<np; i++) {
-        double xo[3] = {0};
-        fastpm_drift_one(drift, pi, i, xo, af);
-        int d;
-        for(d = 0; d < 3; d ++) {
-            po->x[i][d] = xo[d];
-        }
-    }
     po->meta.a_x = af;
 }
 
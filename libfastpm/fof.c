@@ -10,6 +10,7 @@
 #include <fastpm/store.h>
 
 #include <fastpm/fof.h>
+#include "pmpfft.h"
 #include "pmghosts.h"
 
 //#define FASTPM_FOF_DEBUG
@@ -70,6 +71,21 @@ _kdtree_buffered_free(void * userdata, size_t size, void * ptr)
     /* do nothing; */
 }
 
+/* copy the positions of a store to a double buffer of the kdtree */
+static void
+_kdtree_copy_positions(double (* x)[3], FastPMStore * p)
+{
+    if(p->x) {
+        memcpy(x, &p->x[0][0], p->np * sizeof(p->x[0]));
+        return;
+    }
+    ptrdiff_t i;
+#pragma omp parallel for
+    for(i = 0; i < p->np; i ++) {
+        fastpm_store_get_position(p, i, x[i]);
+    }
+}
+
 static 
 KDNode *
 _create_kdtree (KDTree * tree, int thresh,
@@ -100,20 +116,21 @@ _create_kdtree (KDTree * tree, int thresh,
     tree->input.dims[1] = 3;
 
     FastPMParticleMaskType * active = NULL;
-    if(tree->input.dims[0] < stores[0]->np_upper) {
+    if(tree->input.dims[0] < stores[0]->np_upper && stores[0]->x) {
         /* if the first store is big enough, use it for the tree */
         tree->input.buffer = (void*) &stores[0]->x[0][0];
         if(use_mask) {
             active = &stores[0]->mask[0];
         }
     } else {
-        /* otherwise, allocate a big buffer and make a copy */
+        /* otherwise, allocate a big buffer and make a copy; fixed point
+         * positions are always converted to a copy. */
 
         /* Note that we do not compact the array because we want to ensure
          * the index used by kd_fof's head agrees with FastPM's. */
         tree->input.buffer = _kdtree_buffered_malloc(pbuffer,
                     tree->input.dims[0] * sizeof(stores[0]->x[0]));
-        memcpy(tree->input.buffer, &stores[0]->x[0][0], stores[0]->np * sizeof(stores[0]->x[0]));
+        _kdtree_copy_positions((void*) tree->input.buffer, stores[0]);
         if(use_mask) {
             active = _kdtree_buffered_malloc(pbuffer,
                         tree->input.dims[0] * sizeof(active[0]));
@@ -125,9 +142,8 @@ _create_kdtree (KDTree * tree, int thresh,
 
     /* copy the other positions to the base pointer. */
     for(s = 1; s < nstore; s ++) {
-        memcpy(((char*) tree->input.buffer) + i * sizeof(stores[0]->x[0]),
-                &stores[s]->x[0][0],
-                stores[s]->np * sizeof(stores[0]->x[0]));
+        _kdtree_copy_positions((void*) (((char*) tree->input.buffer) + i * sizeof(stores[0]->x[0])),
+                stores[s]);
         if(use_mask) {
             memcpy(((char*) active) + i * sizeof(stores[0]->mask[0]),
                 &stores[s]->mask[0],
@@ -255,35 +271,153 @@ fastpm_fof_init(FastPMFOFFinder * finder, double max_linkinglength,
 }
 
 
+/*
+ * Global merge of the local FOF segments is a distributed union-find.
+ *
+ * Every segment (a local head) is a vertex. Each particle has a tag
+ * ThisTask * npmax + i; the id of a segment is the minimal tag of its local
+ * particles, or a tag after all particle tags if the segment has only ghosts.
+ * A ghost links the segment of its head to the segment of the particle it is a
+ * copy of.
+ *
+ * label[head] points to a segment of smaller or equal id in the same group,
+ * by the tag of any of its particles. The segments with label == id are the roots.
+ * Each round shortcuts the labels by pointer jumping till every segment points
+ * to a root, then hooks the roots across the remaining cross links onto the smaller
+ * root. Links inside a tree are dropped, so the edge list shrinks with each round
+ * and the number of rounds grows logarithmically with the size of the group.
+ *
+ * The root of a group is the segment with the minimal tag of the group.
+ * */
+struct fof_labels {
+    int ThisTask;
+    int NTask;
+    MPI_Comm comm;
+    uint64_t npmax; /* max number of particles per rank */
+    uint64_t ngmax; /* max number of ghosts per rank */
+    size_t np;
+    ptrdiff_t * head;
+    uint64_t * label;
+};
+
+struct fof_edge {
+    ptrdiff_t u; /* local head */
+    uint64_t w; /* tag in the remote segment */
+};
+
 static int
-_merge(uint64_t * src, ptrdiff_t isrc, uint64_t * dest, ptrdiff_t idest, ptrdiff_t * head)
+_fof_tag_task(struct fof_labels * L, uint64_t tag)
 {
-    int merge = 0;
-    ptrdiff_t j = head[idest];
-    if(src[isrc] < dest[j]) {
-        merge = 1;
+    uint64_t nptags = L->npmax * L->NTask;
+    if(tag < nptags) {
+        return tag / L->npmax;
     }
+    return (tag - nptags) / L->ngmax;
+}
 
-    if(merge) {
-        dest[j] = src[isrc];
+/* the local head of the segment containing tag; on the task of the tag */
+static ptrdiff_t
+_fof_tag_head(struct fof_labels * L, uint64_t tag)
+{
+    uint64_t nptags = L->npmax * L->NTask;
+    ptrdiff_t i;
+    if(tag < nptags) {
+        i = tag % L->npmax;
+    } else {
+        i = L->np + (tag - nptags) % L->ngmax;
     }
-    return merge;
+    return L->head[i];
 }
 
-struct reduce_fof_data {
-    ptrdiff_t * head;
-    size_t nmerged;
-};
-
+/* For every tag, lower the label of its segment to values[k] on the task of the tag,
+ * and return the updated label in values[k]. UINT64_MAX queries the label. */
 static void
-FastPMReduceFOF(FastPMStore * src, ptrdiff_t isrc, FastPMStore * dest, ptrdiff_t idest, int ci, void * userdata)
+_fof_exchange_min(struct fof_labels * L, uint64_t * tags, uint64_t * values, size_t n)
 {
+    int NTask = L->NTask;
+    int * sendcount = calloc(NTask, sizeof(int));
+    int * sendoffset = malloc(sizeof(int) * NTask);
+    int * recvcount = malloc(sizeof(int) * NTask);
+    int * recvoffset = malloc(sizeof(int) * NTask);
+    int * target = malloc(sizeof(int) * (n + 1));
+
+    ptrdiff_t k;
+    for(k = 0; k < n; k ++) {
+        target[k] = _fof_tag_task(L, tags[k]);
+        sendcount[target[k]] ++;
+    }
+
+    MPI_Alltoall_sparse_counts(sendcount, recvcount, L->comm);
+
+    cumsum(sendoffset, sendcount, NTask);
+    size_t Nrecv = cumsum(recvoffset, recvcount, NTask);
+
+    uint64_t (*sendbuf)[2] = malloc(sizeof(sendbuf[0]) * (n + 1));
+    uint64_t (*recvbuf)[2] = malloc(sizeof(recvbuf[0]) * (Nrecv + 1));
+
+    for(k = 0; k < NTask; k ++) {
+        sendcount[k] = 0;
+    }
+    for(k = 0; k < n; k ++) {
+        /* target[k] becomes the position in the send buffer */
+        int t = target[k];
+        target[k] = sendoffset[t] + sendcount[t] ++;
+        sendbuf[target[k]][0] = tags[k];
+        sendbuf[target[k]][1] = values[k];
+    }
+
+    MPI_Datatype PAIR;
+    MPI_Type_contiguous(2, MPI_UINT64_T, &PAIR);
+    MPI_Type_commit(&PAIR);
+
+    MPIAlltoallvSparse h[1];
+    MPI_Ialltoallv_sparse(sendbuf, sendcount, sendoffset, PAIR,
+                  recvbuf, recvcount, recvoffset, PAIR, L->comm, h);
+
+    int rank;
+    /* lower the labels with the pairs from a rank while the others are in flight */
+    while((rank = MPI_Alltoallv_sparse_waitany(h)) >= 0) {
+        for(k = recvoffset[rank]; k < recvoffset[rank] + recvcount[rank]; k ++) {
+            ptrdiff_t j = _fof_tag_head(L, recvbuf[k][0]);
+            if(recvbuf[k][1] < L->label[j]) {
+                L->label[j] = recvbuf[k][1];
+            }
+        }
+    }
+    MPI_Alltoallv_sparse_waitall(h);
+
+    /* the labels are final once all pairs are in */
+    for(k = 0; k < Nrecv; k ++) {
+        ptrdiff_t j = _fof_tag_head(L, recvbuf[k][0]);
+        recvbuf[k][1] = L->label[j];
+    }
 
-    struct reduce_fof_data * data = userdata;
+    MPI_Alltoallv_sparse(recvbuf, recvcount, recvoffset, PAIR,
+                  sendbuf, sendcount, sendoffset, PAIR, L->comm);
 
-    data->nmerged += _merge(src->minid, isrc, dest->minid, idest, data->head);
+    MPI_Type_free(&PAIR);
+
+    for(k = 0; k < n; k ++) {
+        values[k] = sendbuf[target[k]][1];
+    }
+
+    free(recvbuf);
+    free(sendbuf);
+    free(target);
+    free(recvoffset);
+    free(recvcount);
+    free(sendoffset);
+    free(sendcount);
 }
 
+static int
+_fof_edge_cmp(const void * p1, const void * p2)
+{
+    const struct fof_edge * e1 = p1;
+    const struct fof_edge * e2 = p2;
+    if(e1->u != e2->u) return (e1->u > e2->u) - (e1->u < e2->u);
+    return (e1->w > e2->w) - (e1->w < e2->w);
+}
 
 static void
 _fof_global_merge(
@@ -299,37 +433,70 @@ _fof_global_merge(
     MPI_Comm comm = finder->priv->comm;
 
     size_t npmax = p->np;
+    size_t ngmax = pgd->p->np;
 
     MPI_Allreduce(MPI_IN_PLACE, &npmax, 1, MPI_LONG, MPI_MAX, comm);
-
-    /* initialize minid, used as a global tag of groups as we merge */
+    MPI_Allreduce(MPI_IN_PLACE, &ngmax, 1, MPI_LONG, MPI_MAX, comm);
+
+    struct fof_labels L[1] = {{
+        .ThisTask = finder->priv->ThisTask,
+        .NTask = finder->priv->NTask,
+        .comm = comm,
+        .npmax = npmax,
+        .ngmax = ngmax,
+        .np = p->np,
+        .head = head,
+        .label = minid,
+    }};
+
+    /* the tags of particles, used as a global tag of groups as we merge */
     for(i = 0; i < p->np; i ++) {
-        /* assign unique ID to each particle; could use a better scheme with true offsets */
-        minid[i] = i + finder->priv->ThisTask * npmax;
-        #ifdef FASTPM_FOF_DEBUG
-        /* for debugging, overwrite the previous unique ID with the true ID of particles */
-        minid[i] = p->id[i];
-        #endif
+        /* the tags address the particles in _fof_exchange_min; they can not be
+         * replaced by the true ID of particles for debugging. */
+        minid[i] = i + L->ThisTask * npmax;
     }
 
-    /* send minid */
+    /* send the tags; ghosts get the tags of the particles they are copies of */
     p->minid = minid; /* only send up to p->np */
     pm_ghosts_send(pgd, COLUMN_MINID);
     p->minid = NULL;
 
-    /* copy over to minid for storage; FIXME: allow overriding  */
-    for(i = 0; i < pgd->p->np; i ++) {
-        minid[i + p->np] = pgd->p->minid[i];
-    }
-
-    /* reduce the minid of the head items according to the local connection. */
+    /* the id of the segments; only valid on the heads */
+    uint64_t * segid = fastpm_memory_alloc(p->mem, "FOFSegID",
+                    sizeof(segid[0]) * (p->np + pgd->p->np), FASTPM_MEMORY_STACK);
 
-    while(1) {
-        size_t nmerge = 0;
-        for(i = 0; i < p->np + pgd->p->np; i ++) {
-            nmerge += _merge(minid, i, minid, i, head);
+    for(i = 0; i < p->np + pgd->p->np; i ++) {
+        segid[i] = UINT64_MAX;
+    }
+    for(i = 0; i < p->np; i ++) {
+        if(minid[i] < segid[head[i]]) segid[head[i]] = minid[i];
+    }
+    for(i = p->np; i < p->np + pgd->p->np; i ++) {
+        if(segid[i] == UINT64_MAX) {
+            segid[i] = npmax * L->NTask + L->ThisTask * ngmax + (i - p->np);
         }
-        if(nmerge == 0) break;
+    }
+    for(i = 0; i < p->np + pgd->p->np; i ++) {
+        minid[i] = segid[i];
+    }
+
+    /* the cross links, one per ghost */
+    size_t nedges = pgd->p->np;
+    struct fof_edge * edges = fastpm_memory_alloc(p->mem, "FOFEdges",
+                    sizeof(edges[0]) * (nedges + 1), FASTPM_MEMORY_STACK);
+
+    /* the heads that are not roots; also the buffer for the hooks. */
+    size_t nbuf = p->np + pgd->p->np;
+    ptrdiff_t * nonroot = fastpm_memory_alloc(p->mem, "FOFNonRoot",
+                    sizeof(nonroot[0]) * (nbuf + 1), FASTPM_MEMORY_STACK);
+    uint64_t * tags = fastpm_memory_alloc(p->mem, "FOFTags",
+                    sizeof(tags[0]) * (nbuf + 1), FASTPM_MEMORY_STACK);
+    uint64_t * values = fastpm_memory_alloc(p->mem, "FOFValues",
+                    sizeof(values[0]) * (nbuf + 1), FASTPM_MEMORY_STACK);
+
+    for(i = 0; i < nedges; i ++) {
+        edges[i].u = head[i + p->np];
+        edges[i].w = pgd->p->minid[i];
     }
 
 #ifdef FASTPM_FOF_DEBUG
@@ -350,49 +517,92 @@ _fof_global_merge(
     int iter = 0;
 
     while(1) {
+        /* shortcut by pointer jumping till all segments point to a root */
+        int njump = 0;
+        while(1) {
+            size_t n = 0;
+            for(i = 0; i < p->np + pgd->p->np; i ++) {
+                if(head[i] != i || minid[i] == segid[i]) continue;
+                nonroot[n] = i;
+                tags[n] = minid[i];
+                values[n] = UINT64_MAX;
+                n++;
+            }
 
-        /* prepare the communication buffer, every ghost has
-         * the minid and task of the current head. such that
-         * they will connect to the other ranks correctly */
-
-        for(i = 0; i < pgd->p->np; i ++) {
-            pgd->p->minid[i] = minid[head[i + p->np]];
-        }
-
-        /* at this point all items on ghosts have local minid and task, ready to reduce */
-
-        struct reduce_fof_data data = {
-            .head = head,
-            .nmerged = 0,
-        };
+            _fof_exchange_min(L, tags, values, n);
 
-        /* merge ghosts into the p, reducing the MINID on p */
+            size_t nchanged = 0;
+            for(i = 0; i < n; i ++) {
+                if(values[i] != minid[nonroot[i]]) {
+                    minid[nonroot[i]] = values[i];
+                    nchanged ++;
+                }
+            }
 
-        p->minid = minid; /* only update up to p->np */
-        pm_ghosts_reduce(pgd, COLUMN_MINID, FastPMReduceFOF, &data);
-        p->minid = NULL;
+            MPI_Allreduce(MPI_IN_PLACE, &nchanged, 1, MPI_LONG, MPI_SUM, comm);
+            if(nchanged == 0) break;
+            njump ++;
+        }
 
-        size_t nmerged = data.nmerged;
+        /* look up the roots of the remote ends */
+        for(i = 0; i < nedges; i ++) {
+            tags[i] = edges[i].w;
+            values[i] = UINT64_MAX;
+        }
 
-        /* at this point all items on p->fof with head[i] = i have present minid and task */
+        _fof_exchange_min(L, tags, values, nedges);
+
+        /* hook the larger root to the smaller root; drop the links inside a tree */
+        size_t n = 0;
+        size_t j = 0;
+        for(i = 0; i < nedges; i ++) {
+            uint64_t lu = minid[edges[i].u];
+            uint64_t lw = values[i];
+            if(lu == lw) continue;
+
+            tags[n] = lu > lw ? lu : lw;
+            values[n] = lu > lw ? lw : lu;
+            n++;
+            edges[j].u = edges[i].u;
+            edges[j].w = lw;
+            j++;
+        }
 
-        MPI_Allreduce(MPI_IN_PLACE, &nmerged, 1, MPI_LONG, MPI_SUM, comm);
+        /* values is overwritten with the labels of the hooked roots */
+        _fof_exchange_min(L, tags, values, n);
 
-        MPI_Barrier(comm);
+        qsort(edges, j, sizeof(edges[0]), _fof_edge_cmp);
+        nedges = 0;
+        for(i = 0; i < j; i ++) {
+            if(nedges > 0 && _fof_edge_cmp(&edges[i], &edges[nedges - 1]) == 0) continue;
+            edges[nedges++] = edges[i];
+        }
 
-        fastpm_info("FOF reduction iteration %d : merged %td crosslinks\n", iter, nmerged);
+        size_t nlinks = nedges;
+        MPI_Allreduce(MPI_IN_PLACE, &nlinks, 1, MPI_LONG, MPI_SUM, comm);
 
-        if(nmerged == 0) break;
+        fastpm_info("FOF reduction iteration %d : %d jumps, %td crosslinks remaining\n", iter, njump, nlinks);
 
-        for(i = 0; i < p->np + pgd->p->np; i ++) {
-            if(minid[i] < minid[head[i]]) {
-                fastpm_raise(-1, "p->fof invariance is broken i = %td np = %td\n", i, p->np);
-            }
-        }
+        if(nlinks == 0) break;
 
         iter++;
     }
 
+#ifdef FASTPM_FOF_DEBUG
+    /* one line per local segment that is merged into a segment with a smaller tag */
+    for(i = 0; i < p->np; i ++) {
+        if(head[i] != i || minid[i] == segid[i]) continue;
+        fastpm_ilog(INFO, "%d SEGMENT head = %td ID = %ld TAG %ld -> %ld", finder->priv->ThisTask,
+            i, p->id[i], segid[i], minid[i]);
+    }
+#endif
+
+    fastpm_memory_free(p->mem, values);
+    fastpm_memory_free(p->mem, tags);
+    fastpm_memory_free(p->mem, nonroot);
+    fastpm_memory_free(p->mem, edges);
+    fastpm_memory_free(p->mem, segid);
+
     /* previous loop only updated head[i]; now make sure every particles has the correct minid. */
     for(i = 0; i < p->np + pgd->p->np; i ++) {
         minid[i] = minid[head[i]];
@@ -402,10 +612,7 @@ _fof_global_merge(
     {
     for(i = 0; i < p->np + pgd->p->np ; i ++) {
         uint64_t id = i <p->np?p->id[i]:pgd->p->id[i - p->np];
-        if(minid[i] == 88) {
-            fastpm_ilog(INFO, "%d MINID == %ld ID = %ld headminid == %ld i = %td / %td head=%td", finder->priv->ThisTask,
-                minid[i], id, minid[head[i]], i, p->np, head[i]);
-        }
+        /* minid is a tag, not an ID; watch the particles by their true ID */
         if(id == 88 || id == 96 || id == 152 || id == 160) {
             fastpm_ilog(INFO, "%d MINID == %ld ID = %ld headminid == %ld i = %td / %td head=%td", finder->priv->ThisTask,
                 minid[i], id, minid[head[i]], i, p->np, head[i]);
@@ -652,7 +859,7 @@ fastpm_fof_reduce_halo_attrs(FastPMFOFFinder * finder, FastPMStore * halos,
         }
     }
 
-    /* use permute to replicate the first halo attr to the rest:
+    /* use gather to replicate the first halo attr to the rest:
      *
      * we do not want to replicate
      * - fof, as fof.task is the original mpi rank of the halo
@@ -673,7 +880,7 @@ fastpm_fof_reduce_halo_attrs(FastPMFOFFinder * finder, FastPMStore * halos,
     halos->id = NULL;
     halos->mask = NULL;
 
-    fastpm_store_permute(halos, ind);
+    fastpm_store_gather(halos, ind);
 
     memcpy(halos->columns, save->columns, sizeof(save->columns));
 
@@ -850,9 +1057,12 @@ _convert_basic_halo_attrs(FastPMFOFFinder * finder, FastPMStore * p, ptrdiff_t i
     }
     halos->length[hid] = 1;
 
+    double x[3];
+    fastpm_store_get_position(p, i, x);
+
     for(d = 0; d < 3; d++) {
         if(halos->x)
-            halos->x[hid][d] = p->x[i][d];
+            halos->x[hid][d] = x[d];
         if(halos->v)
             halos->v[hid][d] = p->v[i][d];
         if(halos->dx1)
@@ -917,9 +1127,12 @@ _convert_extended_halo_attrs(FastPMFOFFinder * finder, FastPMStore * p, ptrdiff_
 
     int d;
     double rrel[3];
+    double x[3];
+
+    fastpm_store_get_position(p, i, x);
 
     for(d = 0; d < 3; d ++) {
-        rrel[d] = p->x[i][d] - halos->x[hid][d];
+        rrel[d] = x[d] - halos->x[hid][d];
 
         if(finder->priv->boxsize) {
             double L = finder->priv->boxsize[d];
@@ -996,6 +1209,10 @@ fastpm_fof_allocate_halos(FastPMStore * halos,
 {
 
     FastPMColumnTags attributes = p->attributes;
+    /* halo positions are averaged in double precision */
+    if(attributes & COLUMN_POS_FIXED) {
+        attributes = (attributes & ~COLUMN_POS_FIXED) | COLUMN_POS;
+    }
     attributes |= COLUMN_MASK;
     attributes |= COLUMN_LENGTH | COLUMN_MINID | COLUMN_TASK;
     attributes |= COLUMN_RDISP | COLUMN_VDISP | COLUMN_RVDISP;
@@ -1036,6 +1253,50 @@ fastpm_fof_allocate_halos(FastPMStore * halos,
     }
 }
 
+/* merge the local groups of head globally and build the halos; head is relabelled to
+ * the halo of each particle. */
+static void
+_fof_execute_linked(FastPMFOFFinder * finder, FastPMStore * halos, ptrdiff_t * head)
+{
+    FastPMStore * p = finder->p;
+    PMGhostData * pgd = finder->priv->pgd;
+    size_t np_and_ghosts = p->np + pgd->p->np;
+
+    FastPMStore savebuff[1];
+    fastpm_store_init(savebuff, p->name, np_and_ghosts, COLUMN_MINID, FASTPM_MEMORY_STACK);
+
+    _fof_global_merge (finder, p, pgd, savebuff->minid, head);
+
+    /* assign halo attr entries. This will keep only candidates that can possibly reach to nmin */
+    size_t nsegments = _assign_halo_attr(finder, pgd, head, p->np, pgd->p->np, finder->nmin);
+
+    fastpm_info("Found %td halos segments >= %d particles; or cross linked. \n", nsegments, finder->nmin);
+    /* create local halos */
+    fastpm_fof_allocate_halos(halos, nsegments, finder->p, finder->priv->boxsize != NULL, finder->priv->comm);
+    /* remove halos without any local particles */
+    fastpm_fof_remove_empty_halos(finder, halos, savebuff->minid, head);
+
+    fastpm_store_destroy(savebuff);
+
+    /* reduce the primary halo attrs */
+    fastpm_fof_compute_halo_attrs(finder, halos, head, _convert_basic_halo_attrs, _add_basic_halo_attrs, _reduce_basic_halo_attrs);
+
+    #ifdef FASTPM_FOF_DEBUG
+    {
+        int i;
+        for(i  = 0; i < halos->np; i ++) {
+            fastpm_ilog(INFO, "Task = %d, Halo[%d] = %d mask=%d MINID=%ld\n", finder->priv->ThisTask, i, halos->length[i], halos->mask[i], halos->minid[i]);
+        }
+    }
+    #endif
+
+    /* apply length cut */
+    fastpm_fof_apply_length_cut(finder, halos, head);
+
+    /* reduce the primary halo attrs */
+    fastpm_fof_compute_halo_attrs(finder, halos, head, _convert_extended_halo_attrs, _add_extended_halo_attrs, _reduce_extended_halo_attrs);
+}
+
 ptrdiff_t *
 fastpm_fof_execute(FastPMFOFFinder * finder,
     double linkinglength,
@@ -1067,9 +1328,6 @@ fastpm_fof_execute(FastPMFOFFinder * finder,
                                         finder->kdtree_thresh,
                                         stores, 2, finder->priv->boxsize, use_mask);
 
-    FastPMStore savebuff[1];
-    fastpm_store_init(savebuff, p->name, np_and_ghosts, COLUMN_MINID, FASTPM_MEMORY_STACK);
-
     ptrdiff_t i;
     /* kdcount will only modify the head of active particles.
      * thus inactive particles are never linked. */
@@ -1079,52 +1337,110 @@ fastpm_fof_execute(FastPMFOFFinder * finder,
     /* local find of p and the ghosts */
     kd_fof(finder->priv->root, linkinglength, head);
 
-    _fof_global_merge (finder, p, pgd, savebuff->minid, head);
+    _free_kdtree(&finder->priv->tree, finder->priv->root);
 
-    /* assign halo attr entries. This will keep only candidates that can possibly reach to nmin */
-    size_t nsegments = _assign_halo_attr(finder, pgd, head, p->np, pgd->p->np, finder->nmin);
+    _fof_execute_linked(finder, halos, head);
 
-    fastpm_info("Found %td halos segments >= %d particles; or cross linked. \n", nsegments, finder->nmin);
-    /* create local halos */
-    fastpm_fof_allocate_halos(halos, nsegments, finder->p, finder->priv->boxsize != NULL, finder->priv->comm);
-    /* remove halos without any local particles */
-    fastpm_fof_remove_empty_halos(finder, halos, savebuff->minid, head);
+    /* restore mask */
+    finder->p->mask = old_mask;
 
-    fastpm_store_destroy(savebuff);
+    /* halos stores halos that spans to this rank, with duplication.
+     * only those where mask==1 are primary
+     * the others are ghosts with the correct properties but shall not show up in the
+     * catalog.
+     *
+     * halos[head[i]] is the hosting halo of particle i, if head[i] >= 0.
+     * */
+    return head;
+}
 
-    /* reduce the primary halo attrs */
-    fastpm_fof_compute_halo_attrs(finder, halos, head, _convert_basic_halo_attrs, _add_basic_halo_attrs, _reduce_basic_halo_attrs);
+ptrdiff_t **
+fastpm_fof_link_hierarchy(FastPMFOFFinder * finder, int nll, double * linkinglength)
+{
+    FastPMStore * p = finder->p;
+    PMGhostData * pgd = finder->priv->pgd;
+    size_t np_and_ghosts = p->np + pgd->p->np;
 
-    #ifdef FASTPM_FOF_DEBUG
-    {
-        int i;
-        for(i  = 0; i < halos->np; i ++) {
-            fastpm_ilog(INFO, "Task = %d, Halo[%d] = %d mask=%d MINID=%ld\n", finder->priv->ThisTask, i, halos->length[i], halos->mask[i], halos->minid[i]);
-        }
+    int k;
+    for(k = 1; k < nll; k ++) {
+        if(linkinglength[k] > linkinglength[k - 1]) return NULL;
     }
-    #endif
 
-    /* apply length cut */
-    fastpm_fof_apply_length_cut(finder, halos, head);
+    ptrdiff_t ** linked = malloc(sizeof(linked[0]) * nll);
+    for(k = 0; k < nll; k ++) {
+        linked[k] = fastpm_memory_alloc(p->mem, "FOFLinked",
+                    sizeof(linked[k][0]) * np_and_ghosts, FASTPM_MEMORY_STACK);
+    }
 
-    /* reduce the primary halo attrs */
-    fastpm_fof_compute_halo_attrs(finder, halos, head, _convert_extended_halo_attrs, _add_extended_halo_attrs, _reduce_extended_halo_attrs);
+    FastPMStore * stores[2] = {p, pgd->p};
+
+    finder->priv->root = _create_kdtree(&finder->priv->tree,
+                                        finder->kdtree_thresh,
+                                        stores, 2, finder->priv->boxsize, 0);
+
+    ptrdiff_t i;
+    for(k = 0; k < nll; k ++) {
+        for(i = 0; i < np_and_ghosts; i ++) {
+            linked[k][i] = i;
+        }
+    }
+
+    kd_fof_hierarchical(finder->priv->root, nll, linkinglength, linked);
 
     _free_kdtree(&finder->priv->tree, finder->priv->root);
 
+    return linked;
+}
+
+ptrdiff_t *
+fastpm_fof_execute_linked(FastPMFOFFinder * finder,
+    ptrdiff_t * linked,
+    FastPMStore * halos,
+    FastPMParticleMaskType * active)
+{
+    FastPMStore * p = finder->p;
+    PMGhostData * pgd = finder->priv->pgd;
+    size_t np_and_ghosts = p->np + pgd->p->np;
+    ptrdiff_t * head = fastpm_memory_alloc(p->mem, "FOFHead",
+                    sizeof(head[0]) * np_and_ghosts, FASTPM_MEMORY_STACK);
+
+    FastPMParticleMaskType * old_mask = finder->p->mask;
+
+    memcpy(head, linked, sizeof(head[0]) * np_and_ghosts);
+
+    if(active) {
+        finder->p->mask = active;
+        pm_ghosts_send(pgd, COLUMN_MASK);
+
+        /* the groups of inactive particles are entirely inactive, thus
+         * no active particle is linked to an inactive one. */
+        ptrdiff_t i;
+        for(i = 0; i < p->np; i ++) {
+            if(!active[i]) head[i] = i;
+        }
+        for(i = 0; i < pgd->p->np; i ++) {
+            if(!pgd->p->mask[i]) head[i + p->np] = i + p->np;
+        }
+    }
+
+    _fof_execute_linked(finder, halos, head);
+
     /* restore mask */
     finder->p->mask = old_mask;
 
-    /* halos stores halos that spans to this rank, with duplication.
-     * only those where mask==1 are primary
-     * the others are ghosts with the correct properties but shall not show up in the
-     * catalog.
-     *
-     * halos[head[i]] is the hosting halo of particle i, if head[i] >= 0.
-     * */
     return head;
 }
 
+void
+fastpm_fof_free_hierarchy(FastPMFOFFinder * finder, int nll, ptrdiff_t ** linked)
+{
+    int k;
+    for(k = nll - 1; k >= 0; k --) {
+        fastpm_memory_free(finder->p->mem, linked[k]);
+    }
+    free(linked);
+}
+
 void
 fastpm_fof_destroy(FastPMFOFFinder * finder)
 {
@@ -11,94 +11,13 @@
 #include "pmghosts.h"
 
 static void
-apply_pot_transfer(PM * pm, FastPMFloat * from, FastPMFloat * to, int order)
-{
-    fastpm_apply_laplace_transfer(pm, from, to, order);
-    fastpm_apply_multiply_transfer(pm, to, to, -1);
-}
-
-static void
-apply_grad_transfer(PM * pm, FastPMFloat * from, FastPMFloat * to, int dir, int order)
-{
-    /* no need to print these, since we will check for FFT fields with pm_check_values.*/
-    if(0) {
-        PMKIter kiter;
-        pm_kiter_init(pm, &kiter);
-        float ** klist[2] = {kiter.k, kiter.k_finite};
-        int i;
-        for(i = 0; i < pm_nmesh(pm)[dir]; i ++) {
-            double k_finite = klist[order][dir][i];
-            fastpm_info("fourier space kernel[%d] = %g\n", i, k_finite);
-        }
-    }
-#pragma omp parallel
-    {
-        PMKIter kiter;
-        ptrdiff_t * Nmesh = pm_nmesh(pm);
-        float ** klist[2] = {kiter.k, kiter.k_finite};
-        pm_kiter_init(pm, &kiter);
-        for(;
-            !pm_kiter_stop(&kiter);
-            pm_kiter_next(&kiter)) {
-            double k_finite;
-            k_finite = klist[order][dir][kiter.iabs[dir]];
-            ptrdiff_t ind = kiter.ind;
-            /* i k[d] */
-            /* Watch out the data dependency */
-            if(
-                kiter.iabs[0] == (Nmesh[0] - kiter.iabs[0]) % Nmesh[0] &&
-                kiter.iabs[1] == (Nmesh[1] - kiter.iabs[1]) % Nmesh[1] &&
-                kiter.iabs[2] == (Nmesh[2] - kiter.iabs[2]) % Nmesh[2]
-            ) {
-                /* We are at the nyquist and the diff operator shall be zero;
-                 * otherwise the force is not real! */
-                to[kiter.ind + 0] = 0;
-                to[kiter.ind + 1] = 0;
-            } else {
-                FastPMFloat tmp = from[ind + 0] * (k_finite);
-                to[ind + 0] = - from[ind + 1] * (k_finite);
-                to[ind + 1] = tmp;
-            }
-        }
-    }
-}
-
-static void
-apply_gaussian_softening(PM * pm, FastPMFloat * from, FastPMFloat * to, double N)
+add_gaussian_softening(FastPMTransferChain * chain, double N)
 {
+    PM * pm = chain->pm;
     /* N is rms in mesh size */
     double r0 = N * pm->BoxSize[0] / pm->Nmesh[0];
 
-#pragma omp parallel
-    {
-        PMKIter kiter;
-        int d;
-        int i;
-        double *kernel[3];
-        pm_kiter_init(pm, &kiter);
-        for(d = 0; d < 3; d ++) {
-            kernel[d] = malloc(sizeof(double) * pm->Nmesh[d]);
-            for(i = 0; i < pm->Nmesh[d]; i ++) {
-                kernel[d][i] = exp(- 0.5 * pow(kiter.k[d][i] * r0, 2));
-            }
-        }
-
-        for(;
-            !pm_kiter_stop(&kiter);
-            pm_kiter_next(&kiter)) {
-            int d;
-            double fac = 1;
-            ptrdiff_t ind = kiter.ind;
-            for(d = 0; d < 3; d++) {
-                fac *= kernel[d][kiter.iabs[d]];
-            }
-            to[ind + 0] *= fac;
-            to[ind + 1] *= fac;
-        }
-        for(d = 0; d < 3; d ++) {
-            free(kernel[d]);
-        }
-    }
+    fastpm_transfer_chain_add_smoothing(chain, r0);
 }
 static double
 gaussian36(double k, double * knq)
@@ -179,94 +98,239 @@ gravity_apply_kernel_transfer(FastPMKernelType type,
     int potorder, gradorder, difforder, deconvolveorder;
     fastpm_kernel_type_get_orders(type, &potorder, &gradorder, &difforder, &deconvolveorder);
 
-    while(deconvolveorder > 0) {
-        fastpm_apply_decic_transfer(pm, canvas, canvas);
-        deconvolveorder--;
-    }
+    /* the whole kernel is one sweep from delta_k to canvas; the deconvolution
+     * used to go to the canvas before it is overwritten here, thus it is left out. */
+    FastPMTransferChain chain[1];
+    fastpm_transfer_chain_init(chain, pm);
+
     int d1, d2;
+    int D1[] = {0, 1, 2, 0, 1, 2};
+    int D2[] = {0, 1, 2, 1, 2, 0};
 
     switch(field.attribute) {
         case COLUMN_POTENTIAL:
-            apply_pot_transfer(pm, delta_k, canvas, potorder);
+            fastpm_transfer_chain_add_laplace(chain, potorder);
+            fastpm_transfer_chain_add_multiply(chain, -1);
             break;
         case COLUMN_DENSITY:
-            fastpm_apply_multiply_transfer(pm, delta_k, canvas, 1.0);
             break;
         case COLUMN_TIDAL:
-            switch(field.memb) {
-                case 0:
-                    d1 = 0; d2 = 0;
-                    apply_pot_transfer(pm, delta_k, canvas, potorder);
-                    apply_grad_transfer(pm, canvas, canvas, d1, gradorder);
-                    apply_grad_transfer(pm, canvas, canvas, d2, gradorder);
-                    break;
-                case 1:
-                    d1 = 1; d2 = 1;
-                    apply_pot_transfer(pm, delta_k, canvas, potorder);
-                    apply_grad_transfer(pm, canvas, canvas, d1, gradorder);
-                    apply_grad_transfer(pm, canvas, canvas, d2, gradorder);
-                    break;
-                case 2:
-                    d1 = 2; d2 = 2;
-                    apply_pot_transfer(pm, delta_k, canvas, potorder);
-                    apply_grad_transfer(pm, canvas, canvas, d1, gradorder);
-                    apply_grad_transfer(pm, canvas, canvas, d2, gradorder);
-                    break;
-                case 3:
-                    d1 = 0; d2 = 1;
-                    apply_pot_transfer(pm, delta_k, canvas, potorder);
-                    apply_grad_transfer(pm, canvas, canvas, d1, gradorder);
-                    apply_grad_transfer(pm, canvas, canvas, d2, gradorder);
-                    break;
-                case 4:
-                    d1 = 1; d2 = 2;
-                    apply_pot_transfer(pm, delta_k, canvas, potorder);
-                    apply_grad_transfer(pm, canvas, canvas, d1, gradorder);
-                    apply_grad_transfer(pm, canvas, canvas, d2, gradorder);
-                    break;
-                case 5:
-                    d1 = 2; d2 = 0;
-                    apply_pot_transfer(pm, delta_k, canvas, potorder);
-                    apply_grad_transfer(pm, canvas, canvas, d1, gradorder);
-                    apply_grad_transfer(pm, canvas, canvas, d2, gradorder);
-                    break;
-            }
+            d1 = D1[field.memb]; d2 = D2[field.memb];
+            fastpm_transfer_chain_add_laplace(chain, potorder);
+            fastpm_transfer_chain_add_multiply(chain, -1);
+            fastpm_transfer_chain_add_grad(chain, d1, gradorder);
+            fastpm_transfer_chain_add_grad(chain, d2, gradorder);
             break;
         case COLUMN_ACC:
-            apply_pot_transfer(pm, delta_k, canvas, potorder);
-            apply_grad_transfer(pm, canvas, canvas, field.memb, gradorder);
+            fastpm_transfer_chain_add_laplace(chain, potorder);
+            fastpm_transfer_chain_add_multiply(chain, -1);
+            fastpm_transfer_chain_add_grad(chain, field.memb, gradorder);
             break;
         default:
             fastpm_raise(-1, "Unknown type for gravity attribute\n");
     }
+    fastpm_transfer_chain_apply(chain, delta_k, canvas);
+    fastpm_transfer_chain_destroy(chain);
 }
 static void
 apply_softening_transfer(FastPMSofteningType type, PM * pm, FastPMFloat * from, FastPMFloat * to)
 {
+    if(type == FASTPM_SOFTENING_NONE) return;
+
+    double k_nq = M_PI / pm->BoxSize[0] * pm->Nmesh[0];
+
+    FastPMTransferChain chain[1];
+    fastpm_transfer_chain_init(chain, pm);
+
     switch(type) {
         case FASTPM_SOFTENING_TWO_THIRD:
-            {
-            double k_nq = M_PI / pm->BoxSize[0] * pm->Nmesh[0];
-            fastpm_apply_lowpass_transfer(pm, from, to, 2.0 / 3 * k_nq);
-            }
+            fastpm_transfer_chain_add_lowpass(chain, 2.0 / 3 * k_nq);
         break;
         case FASTPM_SOFTENING_GAUSSIAN:
-            apply_gaussian_softening(pm, from, to, 1.0);
+            add_gaussian_softening(chain, 1.0);
         break;
         case FASTPM_SOFTENING_GADGET_LONG_RANGE:
-            apply_gaussian_softening(pm, from, to, pow(2,0.5)*1.25);
+            add_gaussian_softening(chain, pow(2,0.5)*1.25);
         break;
         case FASTPM_SOFTENING_GAUSSIAN36:
-            {
-            double k_nq = M_PI / pm->BoxSize[0] * pm->Nmesh[0];
-            fastpm_apply_any_transfer(pm, from, to, (fastpm_fkfunc) gaussian36, &k_nq);
-            }
-        break;
-        case FASTPM_SOFTENING_NONE:
+            fastpm_transfer_chain_add_radial(chain, (fastpm_fkfunc) gaussian36, &k_nq);
         break;
         default:
             fastpm_raise(-1, "wrong softening kernel type");
     }
+    fastpm_transfer_chain_apply(chain, from, to);
+    fastpm_transfer_chain_destroy(chain);
+}
+
+/* pointer to row (i, j) of the real space mesh; i and j may be up to h cells
+ * outside of the local region, in which case the row comes from the halo. */
+static FastPMFloat *
+_fd_row(PM * pm, FastPMFloat * canvas, FastPMFloat * xhalo[2], FastPMFloat * yhalo[2], int h, ptrdiff_t i, ptrdiff_t j)
+{
+    ptrdiff_t * size = pm->IRegion.size;
+    ptrdiff_t * strides = pm->IRegion.strides;
+    if(i < 0)
+        return xhalo[0] + (i + h) * strides[0] + j * strides[1];
+    if(i >= size[0])
+        return xhalo[1] + (i - size[0]) * strides[0] + j * strides[1];
+    if(j < 0)
+        return yhalo[0] + (i * h + j + h) * strides[1];
+    if(j >= size[1])
+        return yhalo[1] + (i * h + j - size[1]) * strides[1];
+    return canvas + i * strides[0] + j * strides[1];
+}
+
+/* fetch the h planes (x) and rows (y) next to the local region from
+ * the neighbouring ranks; z is not decomposed and needs no halo.
+ * xhalo[0], yhalo[0] are below the local region, xhalo[1], yhalo[1] above. */
+static void
+_fd_exchange_halo(PM * pm, FastPMFloat * canvas, int h, FastPMFloat * xhalo[2], FastPMFloat * yhalo[2])
+{
+    ptrdiff_t * size = pm->IRegion.size;
+    ptrdiff_t * strides = pm->IRegion.strides;
+    MPI_Comm comm = pm->Comm2D;
+
+    int rank;
+    int coords[2];
+    int left[2], right[2];
+    int d;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Cart_coords(comm, rank, 2, coords);
+    for(d = 0; d < 2; d ++) {
+        int c[2] = {coords[0], coords[1]};
+        c[d] = (coords[d] + pm->Nproc[d] - 1) % pm->Nproc[d];
+        MPI_Cart_rank(comm, c, &left[d]);
+        c[d] = (coords[d] + 1) % pm->Nproc[d];
+        MPI_Cart_rank(comm, c, &right[d]);
+    }
+
+    /* planes are contiguous */
+    int nx = h * strides[0] * sizeof(FastPMFloat);
+    MPI_Sendrecv(canvas, nx, MPI_BYTE, left[0], 0,
+                 xhalo[1], nx, MPI_BYTE, right[0], 0, comm, MPI_STATUS_IGNORE);
+    MPI_Sendrecv(canvas + (size[0] - h) * strides[0], nx, MPI_BYTE, right[0], 1,
+                 xhalo[0], nx, MPI_BYTE, left[0], 1, comm, MPI_STATUS_IGNORE);
+
+    /* rows are not */
+    int ny = size[0] * h * strides[1] * sizeof(FastPMFloat);
+    FastPMFloat * buf = fastpm_memory_alloc(pm->mem, "FDHaloBuf", ny, FASTPM_MEMORY_STACK);
+    ptrdiff_t i;
+    int r;
+
+#pragma omp parallel for private(r)
+    for(i = 0; i < size[0]; i ++) {
+        for(r = 0; r < h; r ++) {
+            memcpy(buf + (i * h + r) * strides[1],
+                   canvas + i * strides[0] + r * strides[1], sizeof(FastPMFloat) * strides[1]);
+        }
+    }
+    MPI_Sendrecv(buf, ny, MPI_BYTE, left[1], 2,
+                 yhalo[1], ny, MPI_BYTE, right[1], 2, comm, MPI_STATUS_IGNORE);
+
+#pragma omp parallel for private(r)
+    for(i = 0; i < size[0]; i ++) {
+        for(r = 0; r < h; r ++) {
+            memcpy(buf + (i * h + r) * strides[1],
+                   canvas + i * strides[0] + (size[1] - h + r) * strides[1], sizeof(FastPMFloat) * strides[1]);
+        }
+    }
+    MPI_Sendrecv(buf, ny, MPI_BYTE, right[1], 3,
+                 yhalo[0], ny, MPI_BYTE, left[1], 3, comm, MPI_STATUS_IGNORE);
+
+    fastpm_memory_free(pm->mem, buf);
+}
+
+/* Finite difference gradient of the real space field canvas, h = 1 for 2 point and
+ * h = 2 for 4 point central differences; the latter is the real space
+ * version of the k_finite gradient (gradorder = 1).
+ * grad[2] may be the same as canvas. */
+static void
+apply_fd_gradient(PM * pm, FastPMFloat * canvas, FastPMFloat * grad[3], int h)
+{
+    ptrdiff_t * size = pm->IRegion.size;
+    ptrdiff_t * strides = pm->IRegion.strides;
+
+    /* each neighbouring rank must hold at least h planes */
+    int minsize = size[0] < size[1] ? size[0] : size[1];
+    MPI_Allreduce(MPI_IN_PLACE, &minsize, 1, MPI_INT, MPI_MIN, pm->Comm2D);
+    if(minsize < h) {
+        fastpm_raise(-1, "The local mesh (%d cells) is too thin for a finite difference gradient of %d cells\n", minsize, h);
+    }
+
+    /* c[o] multiplies phi(i + o) - phi(i - o) */
+    double c[3] = {0, 0, 0};
+    if(h == 1) {
+        c[1] = 1 / 2.;
+    } else {
+        c[1] = 2 / 3.;
+        c[2] = - 1 / 12.;
+    }
+
+    FastPMFloat * xhalo[2], * yhalo[2];
+    xhalo[0] = fastpm_memory_alloc(pm->mem, "FDHaloX0", sizeof(FastPMFloat) * h * strides[0], FASTPM_MEMORY_STACK);
+    xhalo[1] = fastpm_memory_alloc(pm->mem, "FDHaloX1", sizeof(FastPMFloat) * h * strides[0], FASTPM_MEMORY_STACK);
+    yhalo[0] = fastpm_memory_alloc(pm->mem, "FDHaloY0", sizeof(FastPMFloat) * size[0] * h * strides[1], FASTPM_MEMORY_STACK);
+    yhalo[1] = fastpm_memory_alloc(pm->mem, "FDHaloY1", sizeof(FastPMFloat) * size[0] * h * strides[1], FASTPM_MEMORY_STACK);
+
+    _fd_exchange_halo(pm, canvas, h, xhalo, yhalo);
+
+    ptrdiff_t ij;
+#pragma omp parallel for
+    for(ij = 0; ij < size[0] * size[1]; ij ++) {
+        ptrdiff_t i = ij / size[1];
+        ptrdiff_t j = ij % size[1];
+        FastPMFloat * xm[3], * xp[3], * ym[3], * yp[3];
+        int o;
+        for(o = 1; o <= h; o ++) {
+            xm[o] = _fd_row(pm, canvas, xhalo, yhalo, h, i - o, j);
+            xp[o] = _fd_row(pm, canvas, xhalo, yhalo, h, i + o, j);
+            ym[o] = _fd_row(pm, canvas, xhalo, yhalo, h, i, j - o);
+            yp[o] = _fd_row(pm, canvas, xhalo, yhalo, h, i, j + o);
+        }
+        ptrdiff_t ind = i * strides[0] + j * strides[1];
+        ptrdiff_t k;
+        for(k = 0; k < size[2]; k ++) {
+            double gx = 0, gy = 0;
+            for(o = 1; o <= h; o ++) {
+                gx += c[o] * (xp[o][k] - xm[o][k]);
+                gy += c[o] * (yp[o][k] - ym[o][k]);
+            }
+            grad[0][ind + k] = gx * pm->InvCellSize[0];
+            grad[1][ind + k] = gy * pm->InvCellSize[1];
+        }
+    }
+
+    fastpm_memory_free(pm->mem, yhalo[1]);
+    fastpm_memory_free(pm->mem, yhalo[0]);
+    fastpm_memory_free(pm->mem, xhalo[1]);
+    fastpm_memory_free(pm->mem, xhalo[0]);
+
+    /* z is local and periodic; go through a padded copy of the row
+     * because grad[2] may overwrite canvas. */
+#pragma omp parallel
+    {
+        FastPMFloat * row = malloc(sizeof(FastPMFloat) * (size[2] + 2 * h));
+#pragma omp for
+        for(ij = 0; ij < size[0] * size[1]; ij ++) {
+            ptrdiff_t i = ij / size[1];
+            ptrdiff_t j = ij % size[1];
+            ptrdiff_t ind = i * strides[0] + j * strides[1];
+            ptrdiff_t k;
+            int o;
+            for(k = - h; k < size[2] + h; k ++) {
+                row[k + h] = canvas[ind + (k + size[2]) % size[2]];
+            }
+            for(k = 0; k < size[2]; k ++) {
+                double gz = 0;
+                for(o = 1; o <= h; o ++) {
+                    gz += c[o] * (row[k + h + o] - row[k + h - o]);
+                }
+                grad[2][ind + k] = gz * pm->InvCellSize[2];
+            }
+        }
+        free(row);
+    }
 }
 
 void
@@ -324,8 +388,10 @@ _fastpm_solver_compute_delta_k(FastPMSolver * fastpm, PM * pm, FastPMPainter * p
         FastPMStore * p = fastpm_solver_get_species(fastpm, si);
         if(!p) continue;
 
-        VALGRIND_CHECK_MEM_IS_DEFINED(p->x, sizeof(p->x[0]) * p->np);
-        VALGRIND_CHECK_MEM_IS_DEFINED(pgd[si]->p->x, sizeof(pgd[si]->p->x[0]) * pgd[si]->p->np);
+        if(p->x) {
+            VALGRIND_CHECK_MEM_IS_DEFINED(p->x, sizeof(p->x[0]) * p->np);
+            VALGRIND_CHECK_MEM_IS_DEFINED(pgd[si]->p->x, sizeof(pgd[si]->p->x[0]) * pgd[si]->p->np);
+        }
 
         double total_mass1 = 0;
         ptrdiff_t i;
@@ -355,50 +421,191 @@ _fastpm_solver_compute_delta_k(FastPMSolver * fastpm, PM * pm, FastPMPainter * p
 
 }
 
-void
-_fastpm_solver_compute_force(FastPMSolver * fastpm,
+/* read out the forces into ACC; or with a kick, add the kick from the
+ * forces to v instead. The ghosts then collect only the kick, to be reduced
+ * into v. first is set on the first batch of the components. */
+static void
+_fastpm_solver_readout_force(FastPMSolver * fastpm,
+    FastPMPainter * reader,
+    PMGhostData * pgd[6],
+    FastPMFloat * field[], int nfields,
+    FastPMFieldDescr * ACC,
+    FastPMKickFactor * kick, double af, int first)
+{
+    int si;
+    for(si = 0; si < FASTPM_SOLVER_NSPECIES; si ++) {
+        FastPMStore * p = fastpm_solver_get_species(fastpm, si);
+        if(!p) continue;
+        FastPMStore * g = pgd[si]->p;
+        if(!kick) {
+            fastpm_readout_local_many(reader, field, nfields, p, p->np, ACC);
+            fastpm_readout_local_many(reader, field, nfields, g, g->np, ACC);
+            continue;
+        }
+        double c[3];
+        fastpm_kick_factors(kick, p, af, c);
+
+        FastPMFieldDescr KICK[4];
+        double scale[4];
+        int f;
+        for(f = 0; f < nfields; f ++) {
+            KICK[f] = ACC[f];
+            scale[f] = 1;
+            if(ACC[f].attribute == COLUMN_ACC) {
+                KICK[f].attribute = COLUMN_VEL;
+                scale[f] = c[0];
+            }
+        }
+
+        /* the ghosts accumulate the kicks of all batches */
+        if(first) {
+            memset(g->v, 0, sizeof(g->v[0]) * g->np);
+        }
+        for(f = 0; f < nfields; f ++) {
+            if(ACC[f].attribute != COLUMN_POTENTIAL) continue;
+            memset(p->potential, 0, sizeof(p->potential[0]) * p->np);
+            memset(g->potential, 0, sizeof(g->potential[0]) * g->np);
+        }
+        fastpm_readout_local_many_add(reader, field, nfields, p, p->np, KICK, scale);
+        fastpm_readout_local_many_add(reader, field, nfields, g, g->np, KICK, scale);
+    }
+}
+
+/* the potential is transformed once; the forces are its finite differences.
+ * ACC[0:3] are the force components, ACC[3] the potential if nacc == 4. */
+static void
+_fastpm_solver_compute_force_fd(FastPMSolver * fastpm,
     PM * pm,
     FastPMPainter * reader,
     FastPMKernelType kernel,
+    FastPMGradientType gradient,
     PMGhostData * pgd[6],
     FastPMFloat * canvas,
-    FastPMFloat * delta_k, FastPMFieldDescr * ACC, int nacc)
+    FastPMFloat * delta_k, FastPMFieldDescr * ACC, int nacc,
+    FastPMKickFactor * kick, double af)
 {
-    int d;
-
     CLOCK(transfer);
     CLOCK(c2r);
+    CLOCK(gradient);
     CLOCK(readout);
-    CLOCK(reduce);
 
-    for(d = 0; d < nacc; d ++) {
+    FastPMFieldDescr POTENTIAL = {COLUMN_POTENTIAL, 0};
+    int si;
 
-        ENTER(transfer);
-        gravity_apply_kernel_transfer(kernel, pm, delta_k, canvas, ACC[d]);
-        LEAVE(transfer);
+    ENTER(transfer);
+    gravity_apply_kernel_transfer(kernel, pm, delta_k, canvas, POTENTIAL);
+    LEAVE(transfer);
 
-        ENTER(c2r);
-        pm_check_values(pm, canvas, "Before c2r %d", d);
-        pm_c2r(pm, canvas);
-        pm_check_values(pm, canvas, "After c2r %d", d);
-        LEAVE(c2r);
+    ENTER(c2r);
+    pm_check_values(pm, canvas, "Before c2r");
+    pm_c2r(pm, canvas);
+    pm_check_values(pm, canvas, "After c2r");
+    LEAVE(c2r);
 
+    if(nacc > 3) {
         ENTER(readout);
-        int si;
         for(si = 0; si < FASTPM_SOLVER_NSPECIES; si ++) {
             FastPMStore * p = fastpm_solver_get_species(fastpm, si);
             if(!p) continue;
-            fastpm_readout_local(reader, canvas, p, p->np, ACC[d]);
-            fastpm_readout_local(reader, canvas, pgd[si]->p, pgd[si]->p->np, ACC[d]);
+            fastpm_readout_local(reader, canvas, p, p->np, ACC[3]);
+            fastpm_readout_local(reader, canvas, pgd[si]->p, pgd[si]->p->np, ACC[3]);
         }
         LEAVE(readout);
+    }
+
+    FastPMFloat * grad[3];
+    grad[0] = pm_alloc(pm);
+    grad[1] = pm_alloc(pm);
+    grad[2] = canvas;
 
+    ENTER(gradient);
+    apply_fd_gradient(pm, canvas, grad, gradient == FASTPM_GRADIENT_FD4 ? 2 : 1);
+    LEAVE(gradient);
+
+    ENTER(readout);
+    _fastpm_solver_readout_force(fastpm, reader, pgd, grad, 3, ACC, kick, af, 1);
+    LEAVE(readout);
+
+    pm_free(pm, grad[1]);
+    pm_free(pm, grad[0]);
+}
+
+void
+_fastpm_solver_compute_force(FastPMSolver * fastpm,
+    PM * pm,
+    FastPMPainter * reader,
+    FastPMKernelType kernel,
+    FastPMGradientType gradient,
+    PMGhostData * pgd[6],
+    FastPMFloat * canvas,
+    FastPMFloat * delta_k, FastPMFieldDescr * ACC, int nacc,
+    FastPMKickFactor * kick, double af)
+{
+    int d;
+
+    CLOCK(transfer);
+    CLOCK(c2r);
+    CLOCK(readout);
+    CLOCK(reduce);
+
+    if(gradient != FASTPM_GRADIENT_FOURIER) {
+        _fastpm_solver_compute_force_fd(fastpm, pm, reader, kernel, gradient, pgd, canvas, delta_k, ACC, nacc, kick, af);
+    } else {
+        /* the components go through batched c2r of up to nbatch fields */
+        int nbatch = pm_batch_size(pm, nacc);
+        FastPMFloat * field[4];
+        for(d = 0; d < nbatch; d ++) {
+            field[d] = (d == 0) ? canvas : pm_alloc(pm);
+        }
+
+        int d0, n;
+        for(d0 = 0; d0 < nacc; d0 += n) {
+            n = (nacc - d0 < nbatch) ? nacc - d0 : nbatch;
+
+            ENTER(transfer);
+            for(d = 0; d < n; d ++) {
+                gravity_apply_kernel_transfer(kernel, pm, delta_k, field[d], ACC[d0 + d]);
+            }
+            LEAVE(transfer);
+
+            ENTER(c2r);
+            for(d = 0; d < n; d ++) {
+                pm_check_values(pm, field[d], "Before c2r %d", d0 + d);
+            }
+            pm_c2r_many(pm, field, n);
+            for(d = 0; d < n; d ++) {
+                pm_check_values(pm, field[d], "After c2r %d", d0 + d);
+            }
+            LEAVE(c2r);
+
+            ENTER(readout);
+            _fastpm_solver_readout_force(fastpm, reader, pgd, field, n, ACC + d0, kick, af, d0 == 0);
+            LEAVE(readout);
+        }
+
+        for(d = nbatch - 1; d > 0; d --) {
+            pm_free(pm, field[d]);
+        }
     }
 
     int si;
     for(si = 0; si < FASTPM_SOLVER_NSPECIES; si ++) {
         FastPMStore * p = fastpm_solver_get_species(fastpm, si);
         if(!p) continue;
+
+        if(kick) {
+            ENTER(reduce);
+            pm_ghosts_reduce(pgd[si], COLUMN_VEL, FastPMReduceAddFloat, NULL);
+
+            if(p->potential != NULL) {
+                pm_ghosts_reduce(pgd[si], COLUMN_POTENTIAL, FastPMReduceAddFloat, NULL);
+            }
+            LEAVE(reduce);
+
+            fastpm_kick_store_noacc(kick, p, af);
+            continue;
+        }
+
         double acc_std[3], acc_mean[3], acc_min[3], acc_max[3];
         fastpm_store_summary(p, COLUMN_ACC, pm_comm(pm), "<s->", acc_min, acc_std, acc_mean, acc_max);
         for(d = 0; d < 3; d ++) {
@@ -460,8 +667,24 @@ fastpm_solver_compute_force(FastPMSolver * fastpm,
     FastPMPainter * painter,
     FastPMSofteningType dealias,
     FastPMKernelType kernel,
+    FastPMGradientType gradient,
     FastPMFloat * delta_k,
     double Time)
+{
+    fastpm_solver_compute_force_kick(fastpm, pm, painter, dealias, kernel, gradient, delta_k, Time, NULL, 0);
+}
+
+void
+fastpm_solver_compute_force_kick(FastPMSolver * fastpm,
+    PM * pm,
+    FastPMPainter * painter,
+    FastPMSofteningType dealias,
+    FastPMKernelType kernel,
+    FastPMGradientType gradient,
+    FastPMFloat * delta_k,
+    double Time,
+    FastPMKickFactor * kick,
+    double af)
 {
     PMGhostData * pgd[FASTPM_SOLVER_NSPECIES];
 
@@ -472,7 +695,7 @@ fastpm_solver_compute_force(FastPMSolver * fastpm,
     _fastpm_solver_compute_delta_k(fastpm, pm, painter, pgd, canvas, delta_k);
 
     CLOCK(dealias);
-    /* calculate the forces save them to p->acc */
+    /* calculate the forces save them to p->acc, or kick p->v with them */
     apply_softening_transfer(dealias, pm, delta_k, delta_k);
     pm_check_values(pm, delta_k, "After softening");
     LEAVE(dealias);
@@ -516,12 +739,12 @@ fastpm_solver_compute_force(FastPMSolver * fastpm,
         // nulra->nu_acc = gsl_interp_accel_alloc();
         gsl_interp_init(nulra->nu_spline, nulra->logknu, nulra->delta_nu_ratio, nulra->size);
         /* Now apply the neutrino transfer function to the field stored in delta_k.*/
-        fastpm_apply_any_transfer(pm, delta_k, canvas, (fastpm_fkfunc) lra_neutrinos, &nulra);
+        fastpm_apply_radial_transfer(pm, delta_k, canvas, (fastpm_fkfunc) lra_neutrinos, &nulra);
         free(nulra->delta_nu_ratio);
         free(nulra->logknu);
     }
 
-    _fastpm_solver_compute_force(fastpm, pm, painter, kernel, pgd, canvas, delta_k, ACC, nacc);
+    _fastpm_solver_compute_force(fastpm, pm, painter, kernel, gradient, pgd, canvas, delta_k, ACC, nacc, kick, af);
 
     _fastpm_solver_destroy_ghosts(fastpm, pgd);
 
@@ -1,4 +1,5 @@
 #include <string.h>
+#include <stdint.h>
 #include <math.h>
 #include <mpi.h>
 
@@ -15,6 +16,8 @@ static void
 pmic_fill_gaussian_fast(PM * pm, FastPMFloat * delta_k, int seed);
 static void
 pmic_fill_gaussian_slow(PM * pm, FastPMFloat * delta_k, int seed);
+static void
+pmic_fill_gaussian_philox(PM * pm, FastPMFloat * delta_k, int seed);
 
 void
 fastpm_ic_fill_gaussiank(PM * pm, FastPMFloat * delta_k, int seed, enum FastPMFillDeltaKScheme scheme)
@@ -33,6 +36,9 @@ fastpm_ic_fill_gaussiank(PM * pm, FastPMFloat * delta_k, int seed, enum FastPMFi
         case FASTPM_DELTAK_SLOW:
             pmic_fill_gaussian_slow(pm, delta_k, seed);
             break;
+        case FASTPM_DELTAK_PHILOX:
+            pmic_fill_gaussian_philox(pm, delta_k, seed);
+            break;
         default:
             pmic_fill_gaussian_gadget(pm, delta_k, seed);
             break;
@@ -352,6 +358,94 @@ pmic_fill_gaussian_slow(PM * pm, FastPMFloat * delta_k, int seed)
 }
 
 
+/* Philox4x32-10 (Salmon et al. 2011, Random123): a counter based generator;
+ * the four output words are a pure function of the counter and the key. */
+void
+fastpm_philox4x32(uint32_t ctr[4], const uint32_t key0[2])
+{
+    uint32_t key[2] = {key0[0], key0[1]};
+    int r;
+    for(r = 0; r < 10; r ++) {
+        uint64_t p0 = (uint64_t) 0xD2511F53 * ctr[0];
+        uint64_t p1 = (uint64_t) 0xCD9E8D57 * ctr[2];
+        uint32_t c[4] = {
+            (uint32_t) (p1 >> 32) ^ ctr[1] ^ key[0],
+            (uint32_t) p1,
+            (uint32_t) (p0 >> 32) ^ ctr[3] ^ key[1],
+            (uint32_t) p0,
+        };
+        memcpy(ctr, c, sizeof(c));
+        key[0] += 0x9E3779B9;
+        key[1] += 0xBB67AE85;
+    }
+}
+
+/* uniform in (0, 1) from two words; never 0, such that the log is finite. */
+static double
+philox_uniform(uint32_t hi, uint32_t lo)
+{
+    uint64_t u = ((uint64_t) hi << 32) | lo;
+    return ((u >> 12) + 0.5) * (1.0 / 4503599627370496.0);
+}
+
+static void
+pmic_fill_gaussian_philox(PM * pm, FastPMFloat * delta_k, int seed)
+{
+    /* Every mode is drawn from the counter (i, j, k), thus the field does not
+     * depend on the process mesh or the number of threads. */
+    ptrdiff_t * Nmesh = pm->Nmesh;
+    const uint32_t key[2] = {(uint32_t) seed, 0x46617374};
+
+#pragma omp parallel
+    {
+        PMKIter kiter;
+
+        for(pm_kiter_init(pm, &kiter);
+            !pm_kiter_stop(&kiter);
+            pm_kiter_next(&kiter)) {
+            ptrdiff_t iabs[3];
+            ptrdiff_t conj[3];
+            int d;
+            for(d = 0; d < 3; d ++) {
+                iabs[d] = kiter.iabs[d];
+                conj[d] = (Nmesh[d] - iabs[d]) % Nmesh[d];
+            }
+
+            /* on k = 0 and Nmesh/2 plane both a mode and its conjugate are stored;
+             * the one with the lower (i, j) draws, the other is its hermit transform. */
+            int use_conj = (iabs[2] == conj[2]) &&
+                (conj[0] < iabs[0] || (conj[0] == iabs[0] && conj[1] < iabs[1]));
+
+            ptrdiff_t * src = use_conj ? conj : iabs;
+            uint32_t ctr[4] = {src[0], src[1], src[2], 0};
+            fastpm_philox4x32(ctr, key);
+
+            /* we want two numbers that are of std ~ 1/sqrt(2) */
+            double ampl = sqrt(- log(philox_uniform(ctr[0], ctr[1])));
+            double phase = philox_uniform(ctr[2], ctr[3]) * 2 * M_PI;
+
+            double re = ampl * cos(phase);
+            double im = ampl * sin(phase);
+            if(use_conj) {
+                im *= -1;
+            }
+
+            if(conj[0] == iabs[0] && conj[1] == iabs[1] && conj[2] == iabs[2]) {
+                /* The mode is self conjuguate, thus imaginary mode must be zero */
+                im = 0;
+            }
+
+            if(iabs[0] == 0 && iabs[1] == 0 && iabs[2] == 0) {
+                /* the mean is zero */
+                re = 0;
+                im = 0;
+            }
+            delta_k[kiter.ind + 0] = re;
+            delta_k[kiter.ind + 1] = im;
+        }
+    }
+}
+
 /* Footnotes */ 
 
 /* 1): 
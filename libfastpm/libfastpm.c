@@ -22,6 +22,13 @@ void libfastpm_cleanup()
     pm_module_cleanup();
 }
 
+/* takes effect at the next libfastpm_set_memory_bound */
+void libfastpm_set_memory_numa(int first_touch, int huge_pages)
+{
+    GMEM.first_touch = first_touch;
+    GMEM.huge_pages = huge_pages;
+}
+
 void libfastpm_set_memory_bound(size_t size)
 {
     fastpm_memory_destroy(&GMEM);
@@ -126,9 +126,7 @@ funct(double a, void *params)
     if(p->v) {
         fastpm_drift_one(drift, p, i, xi, a);
     } else {
-        for(d = 0; d < 3; d ++) {
-            xi[d] = p->x[i][d];
-        }
+        fastpm_store_get_position(p, i, xi);
     }
     for(d = 0; d < 4; d ++) {
         xi[d] += Fp->tileshift[d];
@@ -174,6 +172,195 @@ _fastpm_usmesh_intersect_one(FastPMUSMesh * mesh,
         funct, params);
 }
 
+/*
+ * Crossing of the horizon by one particle on [a1, a2].
+ *
+ * The drift factors and the horizon are interpolated by cubics in
+ * t = (a - a1) / (a2 - a1) on the nodes 0, 1/4, 3/4, 1, once per interval.
+ * The drifted position is affine in the drift factors, so the position of a
+ * particle is a cubic of t as well. The root of the model is found by
+ * safeguarded Newton, then polished by Newton steps on the exact distance
+ * (funct) with the model derivative. Brent (fastpm_horizon_solve) is only
+ * used when the polish does not converge.
+ *
+ * The end points are nodes and use the exact drift factors and horizon,
+ * hence a particle is selected if and only if the Brent solver selects it.
+ * The solution is within CROSSING_TOL * a of the root, tighter than the
+ * 1e-5 relative interval of the Brent solver; thus a_emit agrees with
+ * the Brent solution within 1e-5 relative. Only particles within this
+ * tolerance of amin, amax or the edge of the field of view can be
+ * classified differently.
+ * */
+#define CROSSING_TOL 1e-7
+
+struct crossing_model {
+    double a1;
+    double a2;
+    double factors[4][3]; /* drift factors at the nodes */
+    double horizon[4]; /* horizon at the nodes */
+    double lagrange[4][4]; /* coefficients of t ** j of the k-th Lagrange polynomial */
+};
+
+static void
+_crossing_model_init(struct crossing_model * model, FastPMLightCone * lc,
+        FastPMDriftFactor * drift, FastPMStore * p, double a1, double a2)
+{
+    static const double nodes[4] = {0, 0.25, 0.75, 1.0};
+
+    model->a1 = a1;
+    model->a2 = a2;
+
+    int k;
+    for(k = 0; k < 4; k ++) {
+        /* exactly a1 and a2 at the end points */
+        double a = (k == 3)? a2 : a1 + (a2 - a1) * nodes[k];
+        if(p->v) {
+            fastpm_drift_factors(drift, p, a, model->factors[k]);
+        }
+        model->horizon[k] = HorizonDistance(a, lc->horizon);
+
+        /* expand prod_{m != k} (t - t_m) / (t_k - t_m) */
+        double * c = model->lagrange[k];
+        int j, m, n = 0;
+        c[0] = 1; c[1] = c[2] = c[3] = 0;
+        for(m = 0; m < 4; m ++) {
+            if(m == k) continue;
+            double w = 1.0 / (nodes[k] - nodes[m]);
+            for(j = n + 1; j >= 0; j --) {
+                c[j] = ((j > 0)? c[j - 1] : 0) * w - c[j] * nodes[m] * w;
+            }
+            n ++;
+        }
+    }
+}
+
+/* value and derivative over t of the distance to the observer of a cubic path */
+static void
+_crossing_distance(FastPMLightCone * lc, double (*x)[3], double t, double * value, double * deriv)
+{
+    double xt[3], dxt[3];
+    int d;
+    for(d = 0; d < 3; d ++) {
+        xt[d] = x[0][d] + t * (x[1][d] + t * (x[2][d] + t * x[3][d]));
+        dxt[d] = x[1][d] + t * (2 * x[2][d] + t * 3 * x[3][d]);
+    }
+    if (lc->fov <= 0) {
+        *value = xt[2];
+        *deriv = dxt[2];
+    } else {
+        double r = sqrt(xt[0] * xt[0] + xt[1] * xt[1] + xt[2] * xt[2]);
+        *value = r;
+        *deriv = (r > 0)? (xt[0] * dxt[0] + xt[1] * dxt[1] + xt[2] * dxt[2]) / r : 0;
+    }
+}
+
+/* returns 1 if a crossing is found, 0 if the particle does not cross;
+ * -1 if the caller shall fall back to the Brent solver. */
+static int
+_crossing_solve(struct crossing_model * model, struct funct_params * params,
+        ptrdiff_t i, double * solution)
+{
+    FastPMLightCone * lc = params->lc;
+    FastPMStore * p = params->p;
+    double xnode[4][3];
+    double x[4][3];
+    double h[4];
+    double fnode[2];
+    int k, j, d;
+
+    params->i = i;
+
+    for(k = 0; k < 4; k ++) {
+        double xi[4];
+        if(p->v) {
+            fastpm_drift_one_factors(params->drift, p, i, xi, model->factors[k]);
+        } else {
+            fastpm_store_get_position(p, i, xi);
+        }
+        xi[3] = 1;
+        for(d = 0; d < 4; d ++) {
+            xi[d] += params->tileshift[d];
+        }
+        double xo[4];
+        fastpm_gldot(lc->glmatrix, xi, xo);
+        for(d = 0; d < 3; d ++) {
+            xnode[k][d] = xo[d];
+        }
+    }
+
+    /* same values as funct at a1 and a2, same bracketing test as Brent */
+    fnode[0] = fastpm_lc_distance(lc, xnode[0]) - model->horizon[0];
+    fnode[1] = fastpm_lc_distance(lc, xnode[3]) - model->horizon[3];
+
+    if((fnode[0] < 0.0 && fnode[1] < 0.0) || (fnode[0] > 0.0 && fnode[1] > 0.0)) {
+        return 0;
+    }
+    if(fnode[0] == 0.0 || fnode[1] == 0.0) return -1;
+
+    for(j = 0; j < 4; j ++) {
+        h[j] = 0;
+        for(d = 0; d < 3; d ++) x[j][d] = 0;
+        for(k = 0; k < 4; k ++) {
+            h[j] += model->lagrange[k][j] * model->horizon[k];
+            for(d = 0; d < 3; d ++) {
+                x[j][d] += model->lagrange[k][j] * xnode[k][d];
+            }
+        }
+    }
+
+    /* root of the model; f(tlo) < 0 < f(thi) */
+    double tlo = (fnode[0] < 0)? 0 : 1;
+    double thi = 1 - tlo;
+    double t = fnode[0] / (fnode[0] - fnode[1]);
+    double g, dg;
+    int iter;
+    for(iter = 0; iter < 32; iter ++) {
+        double value, deriv;
+        _crossing_distance(lc, x, t, &value, &deriv);
+        g = value - (h[0] + t * (h[1] + t * (h[2] + t * h[3])));
+        dg = deriv - (h[1] + t * (2 * h[2] + t * 3 * h[3]));
+
+        if(g < 0) tlo = t; else thi = t;
+
+        double tn = t - g / dg;
+        if(dg == 0 || !(tn > fmin(tlo, thi) && tn < fmax(tlo, thi))) {
+            tn = 0.5 * (tlo + thi);
+        }
+        double dt = fabs(tn - t);
+        t = tn;
+        if(dt < 1e-12) break;
+    }
+
+    /* polish on the exact function, using the model derivative */
+    double scale = model->a2 - model->a1;
+    double a = model->a1 + t * scale;
+    /* the bracket of the model is not a bracket of funct */
+    double alo = (fnode[0] < 0)? model->a1 : model->a2;
+    double ahi = (fnode[0] < 0)? model->a2 : model->a1;
+    for(iter = 0; iter < 4; iter ++) {
+        double value, deriv;
+        double f = funct(a, params);
+        if(f == 0) break;
+        if(f < 0) alo = a; else ahi = a;
+
+        t = (a - model->a1) / scale;
+        _crossing_distance(lc, x, t, &value, &deriv);
+        dg = (deriv - (h[1] + t * (2 * h[2] + t * 3 * h[3]))) / scale;
+        if(dg == 0) return -1;
+
+        double an = a - f / dg;
+        if(!(an >= fmin(alo, ahi) && an <= fmax(alo, ahi))) return -1;
+
+        double da = fabs(an - a);
+        a = an;
+        if(da < CROSSING_TOL * fabs(a)) break;
+    }
+    if(iter == 4) return -1;
+
+    *solution = a;
+    return 1;
+}
+
 static double
 zangle(double * x) {
     double dxy = 0;
@@ -385,6 +572,9 @@ fastpm_usmesh_intersect_tile(FastPMUSMesh * mesh, double * tileshift,
 
     ptrdiff_t i;
 
+    struct crossing_model model[1];
+    _crossing_model_init(model, lc, drift, p, a1, a2);
+
     #pragma omp parallel firstprivate(params)
     {
         params.context = fastpm_horizon_solve_start();
@@ -392,7 +582,11 @@ fastpm_usmesh_intersect_tile(FastPMUSMesh * mesh, double * tileshift,
         for(i = 0; i < p->np; i ++) {
             double a_emit = 0;
 
-            if(0 == _fastpm_usmesh_intersect_one(mesh, &params, i, &a_emit)) continue;
+            int found = _crossing_solve(model, &params, i, &a_emit);
+            if(found < 0) {
+                found = _fastpm_usmesh_intersect_one(mesh, &params, i, &a_emit);
+            }
+            if(0 == found) continue;
 
             /* the event is outside the region we care, skip */
             if(a_emit > mesh->amax || a_emit < mesh->amin) continue;
@@ -406,9 +600,7 @@ fastpm_usmesh_intersect_tile(FastPMUSMesh * mesh, double * tileshift,
                 /* can we drift? if we are using a fixed grid there is no v. */
                 fastpm_drift_one(drift, p, i, xi, a_emit);
             } else {
-                for(d = 0; d < 3; d ++) {
-                    xi[d] = p->x[i][d];
-                }
+                fastpm_store_get_position(p, i, xi);
             }
             for(d = 0; d < 4; d ++) {
                 xi[d] += params.tileshift[d];
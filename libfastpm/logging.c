@@ -103,6 +103,21 @@ void fastpm_default_msg_handler(
     if(level == ERROR) fastpm_abort();
 }
 
+/* a thread that talks on its own communicator (e.g. an IO thread) overrides the handler */
+static __thread FastPMMSGHandler thread_handler_data = {
+    .handler = NULL,
+    .userdata = NULL,
+    .comm = (MPI_Comm) 0,
+    .prev = NULL
+};
+
+void fastpm_set_thread_msg_handler(fastpm_msg_handler handler, MPI_Comm comm, void * userdata)
+{
+    thread_handler_data.handler = handler;
+    thread_handler_data.userdata = userdata;
+    thread_handler_data.comm = comm;
+}
+
 void fastpm_set_msg_handler(fastpm_msg_handler handler, MPI_Comm comm, void * userdata)
 {
     handler_data.handler = handler;
@@ -197,13 +212,18 @@ static void fastpm_log2(
         const int code,
         const char * fmt, va_list argp) {
 
-    if (handler_data.handler == NULL) {
-        fastpm_set_msg_handler(fastpm_default_msg_handler, MPI_COMM_WORLD, NULL);
+    FastPMMSGHandler * h = &thread_handler_data;
+
+    if (h->handler == NULL) {
+        if (handler_data.handler == NULL) {
+            fastpm_set_msg_handler(fastpm_default_msg_handler, MPI_COMM_WORLD, NULL);
+        }
+        h = &handler_data;
     }
 
     char * buffer = fastpm_strdup_vprintf(fmt, argp);
     char * processed = process(file, line, buffer);
-    handler_data.handler(level, type, code, processed, handler_data.comm, handler_data.userdata);
+    h->handler(level, type, code, processed, h->comm, h->userdata);
     free(processed);
     free(buffer);
 }
@@ -2,6 +2,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
 
 #include <fastpm/libfastpm.h>
 #include <fastpm/memory.h>
@@ -11,11 +13,36 @@
 struct MemoryBlock {
     void * p;
     size_t size;
+    int pool;
     MemoryBlock * prev; /* pointer to previous block */
+    MemoryBlock * next; /* pointer to next block; NULL for the top of the pool */
+    int itag; /* index of the tag in m->tags; -1 before tagged */
     char tag[128]; /* tag */
 };
 
-static MemoryBlock head = { .p = NULL, .size = 0, .prev = NULL};
+/* usage of the blocks of one tag */
+struct MemoryTagStat {
+    uint64_t hash;
+    size_t bytes;
+    size_t peak_bytes;
+    size_t bytes_at_peak; /* bytes when the total usage peaked */
+    char tag[128];
+};
+
+/* the last events are kept in a ring */
+#define TIMELINE_SIZE 65536
+
+#define TOUCH_PAGE_SIZE 4096
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/* the blocks are carved from slabs and recycled through a free list,
+ * and looked up from the pointers by an open addressing hash index. */
+#define SLAB_SIZE 256
+
+struct MemorySlab {
+    MemorySlab * next;
+    MemoryBlock blocks[SLAB_SIZE];
+};
 
 static size_t
 _align(size_t old, size_t alignment)
@@ -33,6 +60,7 @@ static void
 _default_abort(FastPMMemory * m, void * userdata)
 {
     fastpm_memory_dump_status(m, 2);
+    fastpm_memory_dump_tags(m, 2);
     abort();
 }
 
@@ -43,13 +71,198 @@ _default_peak(FastPMMemory * m, void * userdata)
     fastpm_memory_dump_status(m, 1);
 }
 */
+static size_t
+_hash(const void * p, size_t mask)
+{
+    uint64_t h = (uint64_t) (uintptr_t) p;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h & mask;
+}
+
+static void
+_index_insert(FastPMMemory * m, MemoryBlock * entry);
+
+/* double the index when it gets half full */
+static void
+_index_grow(FastPMMemory * m)
+{
+    MemoryBlock ** old = m->index;
+    size_t oldsize = m->index_size;
+
+    m->index_size = oldsize ? oldsize * 2 : 1024;
+    m->index = calloc(m->index_size, sizeof(m->index[0]));
+    m->nblocks = 0;
+
+    size_t i;
+    for(i = 0; i < oldsize; i ++) {
+        if(old[i]) _index_insert(m, old[i]);
+    }
+    free(old);
+}
+
+static void
+_index_insert(FastPMMemory * m, MemoryBlock * entry)
+{
+    if(2 * (m->nblocks + 1) > m->index_size) {
+        _index_grow(m);
+    }
+    size_t mask = m->index_size - 1;
+    size_t i;
+    for(i = _hash(entry->p, mask); m->index[i]; i = (i + 1) & mask) continue;
+    m->index[i] = entry;
+    m->nblocks ++;
+}
+
+static size_t
+_index_find(FastPMMemory * m, const void * p)
+{
+    if(m->index_size == 0) return (size_t) -1;
+
+    size_t mask = m->index_size - 1;
+    size_t i;
+    for(i = _hash(p, mask); m->index[i]; i = (i + 1) & mask) {
+        if(m->index[i]->p == p) return i;
+    }
+    return (size_t) -1;
+}
+
+/* remove slot i; later entries of the probe run are shifted back,
+ * so that no tomb stones are needed. */
+static void
+_index_remove(FastPMMemory * m, size_t i)
+{
+    size_t mask = m->index_size - 1;
+    size_t j = i;
+    m->index[i] = NULL;
+    m->nblocks --;
+    for(j = (j + 1) & mask; m->index[j]; j = (j + 1) & mask) {
+        size_t k = _hash(m->index[j]->p, mask);
+        /* can the entry at j move to the hole at i? only if its home k
+         * is not cyclically in (i, j]. */
+        int stay = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+        if(stay) continue;
+        m->index[i] = m->index[j];
+        m->index[j] = NULL;
+        i = j;
+    }
+}
+
+static MemoryBlock *
+_block_new(FastPMMemory * m)
+{
+    if(m->spare == NULL) {
+        MemorySlab * slab = malloc(sizeof(MemorySlab));
+        if(slab == NULL) return NULL;
+        slab->next = m->slabs;
+        m->slabs = slab;
+        int i;
+        for(i = 0; i < SLAB_SIZE; i ++) {
+            slab->blocks[i].prev = m->spare;
+            m->spare = &slab->blocks[i];
+        }
+    }
+    MemoryBlock * entry = m->spare;
+    m->spare = entry->prev;
+    return entry;
+}
+
+static void
+_block_recycle(FastPMMemory * m, MemoryBlock * entry)
+{
+    entry->p = NULL;
+    entry->prev = m->spare;
+    m->spare = entry;
+}
+
+static double
+_now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+static uint64_t
+_hash_str(const char * str)
+{
+    /* FNV-1a */
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for(; *str; str ++) {
+        h ^= (unsigned char) *str;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/* the number of distinct tags is small; the hash saves most of the string compares */
+static int
+_tag_find(FastPMMemory * m, const char * tag)
+{
+    uint64_t h = _hash_str(tag);
+    int i;
+    for(i = 0; i < m->ntags; i ++) {
+        if(m->tags[i].hash == h && 0 == strcmp(m->tags[i].tag, tag)) return i;
+    }
+    if(m->ntags == m->maxtags) {
+        m->maxtags = m->maxtags ? m->maxtags * 2 : 64;
+        m->tags = realloc(m->tags, sizeof(m->tags[0]) * m->maxtags);
+    }
+    MemoryTagStat * stat = &m->tags[m->ntags];
+    memset(stat, 0, sizeof(stat[0]));
+    stat->hash = h;
+    strncpy(stat->tag, tag, sizeof(stat->tag) - 1);
+    return m->ntags ++;
+}
+
+static void
+_record_event(FastPMMemory * m, MemoryBlock * entry, int64_t bytes)
+{
+    if(m->timeline == NULL) {
+        m->timeline = malloc(sizeof(m->timeline[0]) * TIMELINE_SIZE);
+    }
+    FastPMMemoryEvent * event = &m->timeline[m->nevents % TIMELINE_SIZE];
+    event->time = _now() - m->t0;
+    event->itag = entry->itag;
+    event->pool = entry->pool;
+    event->bytes = bytes;
+    m->nevents ++;
+}
+
+/* a new high-water mark; remember the usage of every tag */
+static void
+_update_peak(FastPMMemory * m)
+{
+    if(m->used_bytes <= m->peak_bytes) return;
+
+    m->peak_bytes = m->used_bytes;
+    int i;
+    for(i = 0; i < m->ntags; i ++) {
+        m->tags[i].bytes_at_peak = m->tags[i].bytes;
+    }
+    if(m->peakfunc)
+        m->peakfunc(m, m->userdata);
+}
+
 void
 fastpm_memory_init(FastPMMemory * m, size_t total_bytes)
 {
     int pool;
     for(pool = 0; pool < FASTPM_MEMORY_MAX; pool++) {
-        m->pools[pool] = &head;
+        m->pools[pool] = NULL;
     }
+    m->index = NULL;
+    m->index_size = 0;
+    m->nblocks = 0;
+    m->slabs = NULL;
+    m->spare = NULL;
+    m->tags = NULL;
+    m->ntags = 0;
+    m->maxtags = 0;
+    m->timeline = NULL;
+    m->nevents = 0;
+    m->t0 = _now();
     m->abortfunc = NULL;
     m->peakfunc = NULL;
     m->userdata = NULL;
@@ -57,7 +270,21 @@ fastpm_memory_init(FastPMMemory * m, size_t total_bytes)
     if(total_bytes > 0) {
         total_bytes = _align(total_bytes, m->alignment);
 
-        m->base0 = (char*) malloc(total_bytes + m->alignment);
+        if(m->huge_pages) {
+            /* align to huge pages such that the madvise covers the pools */
+            void * p = NULL;
+            if(0 != posix_memalign(&p, HUGE_PAGE_SIZE, total_bytes + m->alignment)) {
+                p = NULL;
+            }
+            m->base0 = (char*) p;
+#ifdef MADV_HUGEPAGE
+            if(m->base0) {
+                madvise(m->base0, total_bytes + m->alignment, MADV_HUGEPAGE);
+            }
+#endif
+        } else {
+            m->base0 = (char*) malloc(total_bytes + m->alignment);
+        }
         m->base = (char*) _align((size_t)(m->base0), m->alignment);
         m->top = m->base + total_bytes;
     } else {
@@ -67,6 +294,10 @@ fastpm_memory_init(FastPMMemory * m, size_t total_bytes)
         m->top = NULL;
     }
 
+    /* nothing is touched yet; malloc does not touch the pages of a large region */
+    m->heap_touched = m->base;
+    m->stack_touched = m->top;
+
     m->free_bytes = total_bytes;
     m->total_bytes = total_bytes;
     m->used_bytes = 0;
@@ -98,20 +329,25 @@ _sys_abort(FastPMMemory * m)
 void
 fastpm_memory_tag(FastPMMemory * m, void * p, const char * tag)
 {
-    MemoryBlock * entry;
-    int pool = 0; 
-    for(pool = 0; pool < FASTPM_MEMORY_MAX; pool++) {
-        for(entry = m->pools[pool]; entry != &head; entry = entry->prev) {
-            if(entry->p == p) break;
-        }
-        if(entry->p == p) {
-            /* found in this pool */
-            strncpy(entry->tag, tag, 120);
-            return;
-        }
-    }
+    size_t i = _index_find(m, p);
     /* not found, die */
-    if(entry->p != p) _sys_abort(m);
+    if(i == (size_t) -1) {
+        _sys_abort(m);
+        return;
+    }
+    MemoryBlock * entry = m->index[i];
+    strncpy(entry->tag, tag, 120);
+
+    if(entry->itag >= 0) {
+        m->tags[entry->itag].bytes -= entry->size;
+    }
+    entry->itag = _tag_find(m, entry->tag);
+
+    MemoryTagStat * stat = &m->tags[entry->itag];
+    stat->bytes += entry->size;
+    if(stat->bytes > stat->peak_bytes) {
+        stat->peak_bytes = stat->bytes;
+    }
 }
 
 void
@@ -122,11 +358,28 @@ fastpm_memory_destroy(FastPMMemory * m)
     /* check for unrestored pools */
     int pool;
     for(pool = 0; pool < FASTPM_MEMORY_MAX; pool++) {
-        if(m->pools[pool] != &head) {
+        if(m->pools[pool] != NULL) {
             /* leak !*/
             _sys_abort(m);
         }
     }
+    while(m->slabs) {
+        MemorySlab * next = m->slabs->next;
+        free(m->slabs);
+        m->slabs = next;
+    }
+    m->spare = NULL;
+    free(m->tags);
+    m->tags = NULL;
+    m->ntags = 0;
+    m->maxtags = 0;
+    free(m->timeline);
+    m->timeline = NULL;
+    m->nevents = 0;
+    free(m->index);
+    m->index = NULL;
+    m->index_size = 0;
+    m->nblocks = 0;
 }
 
 void
@@ -139,10 +392,10 @@ fastpm_memory_dump_status_str(FastPMMemory * m, char * buffer, int n)
     n --;
     buf[n] = 0;
 
-    const char P[] = "SHF??????";
+    const char P[] = "HSF??????";
     int pool;
     for(pool = 0; pool < FASTPM_MEMORY_MAX; pool++) {
-        for(entry = m->pools[pool]; entry != &head; entry = entry->prev) {
+        for(entry = m->pools[pool]; entry != NULL; entry = entry->prev) {
             snprintf(buf, n, "%c 0x%016tx : %010td : %s\n", P[pool], (ptrdiff_t) entry->p, entry->size, entry->tag);
             buf += strlen(buf);
             n -= strlen(buf);
@@ -157,16 +410,54 @@ fastpm_memory_dump_status(FastPMMemory * m, int fd)
     MemoryBlock * entry;
     char buf[1024];
 
-    const char P[] = "SHF??????";
+    const char P[] = "HSF??????";
     int pool;
     for(pool = 0; pool < FASTPM_MEMORY_MAX; pool++) {
-        for(entry = m->pools[pool]; entry != &head; entry = entry->prev) {
+        for(entry = m->pools[pool]; entry != NULL; entry = entry->prev) {
             sprintf(buf, "%c 0x%016tx : %010td : %s\n", P[pool], (ptrdiff_t) entry->p, entry->size, entry->tag);
             write(fd, buf, strlen(buf));
         }
     }
 }
 
+void
+fastpm_memory_dump_tags(FastPMMemory * m, int fd)
+{
+    char buf[1024];
+    sprintf(buf, "# peak %td bytes; bytes at peak, peak bytes, current bytes of each tag\n", m->peak_bytes);
+    write(fd, buf, strlen(buf));
+
+    int i;
+    for(i = 0; i < m->ntags; i ++) {
+        MemoryTagStat * stat = &m->tags[i];
+        /* the live tags at the high-water mark are marked with a star */
+        sprintf(buf, "%c %010td : %010td : %010td : %s\n",
+            stat->bytes_at_peak ? '*' : ' ',
+            stat->bytes_at_peak, stat->peak_bytes, stat->bytes, stat->tag);
+        write(fd, buf, strlen(buf));
+    }
+}
+
+void
+fastpm_memory_dump_timeline(FastPMMemory * m, int fd)
+{
+    char buf[1024];
+    const char P[] = "HSF??????";
+
+    size_t first = m->nevents > TIMELINE_SIZE ? m->nevents - TIMELINE_SIZE : 0;
+    sprintf(buf, "# %td events, the last %td are kept; time, pool, bytes, tag\n", m->nevents, m->nevents - first);
+    write(fd, buf, strlen(buf));
+
+    size_t i;
+    for(i = first; i < m->nevents; i ++) {
+        FastPMMemoryEvent * event = &m->timeline[i % TIMELINE_SIZE];
+        sprintf(buf, "%12.6f %c %+012td : %s\n",
+            event->time, P[event->pool], (ptrdiff_t) event->bytes,
+            event->itag >= 0 ? m->tags[event->itag].tag : "");
+        write(fd, buf, strlen(buf));
+    }
+}
+
 static void *
 _sys_malloc(FastPMMemory *m, size_t s)
 {
@@ -178,8 +469,22 @@ _sys_malloc(FastPMMemory *m, size_t s)
     return p;
 }
 
+/* touch the pages of [start, end) with the static schedule of the particle and
+ * mesh loops, such that the pages land on the NUMA node of the thread that
+ * will use them. */
+static void
+_first_touch(char * start, char * end)
+{
+    ptrdiff_t npages = (end - start + TOUCH_PAGE_SIZE - 1) / TOUCH_PAGE_SIZE;
+    ptrdiff_t i;
+#pragma omp parallel for schedule(static)
+    for(i = 0; i < npages; i ++) {
+        start[i * TOUCH_PAGE_SIZE] = 0;
+    }
+}
+
 static void *
-fastpm_memory_alloc0(FastPMMemory * m, size_t s, enum FastPMMemoryLocation pool)
+fastpm_memory_alloc0(FastPMMemory * m, size_t s, enum FastPMMemoryLocation pool, int touch)
 {
     s = _align(s, m->alignment);
     if(m->free_bytes <= s) {
@@ -187,12 +492,10 @@ fastpm_memory_alloc0(FastPMMemory * m, size_t s, enum FastPMMemoryLocation pool)
     }
     m->used_bytes += s;
     m->free_bytes -= s;
-    if(m->used_bytes > m->peak_bytes) {
-        m->peak_bytes = m->used_bytes;
-        if(m->peakfunc)
-            m->peakfunc(m, m->userdata);
+    MemoryBlock * entry = _block_new(m);
+    if(entry == NULL) {
+        _sys_abort(m);
     }
-    MemoryBlock * entry = _sys_malloc(m, sizeof(head));
 
     int loc = pool;
     if(m->base0 == NULL) { /* allocate from floating but account in the requested loc */
@@ -204,94 +507,125 @@ fastpm_memory_alloc0(FastPMMemory * m, size_t s, enum FastPMMemoryLocation pool)
         case FASTPM_MEMORY_HEAP:
             entry->p = m->base;
             m->base += s;
+            /* the pools grow towards each other; only the first mesh block over a page touches it.
+             * other blocks are placed by their first use, never touched here. */
+            if(touch && m->first_touch && m->base > m->heap_touched) {
+                char * start = m->base - s;
+                _first_touch(start > m->heap_touched ? start : m->heap_touched, m->base);
+                m->heap_touched = m->base;
+            }
         break;
         case FASTPM_MEMORY_STACK:
             entry->p = m->top - s;
             m->top -= s;
+            if(touch && m->first_touch && m->top < m->stack_touched) {
+                char * end = m->top + s;
+                _first_touch(m->top, end < m->stack_touched ? end : m->stack_touched);
+                m->stack_touched = m->top;
+            }
         break;
         case FASTPM_MEMORY_FLOATING:
             entry->p = _sys_malloc(m, s);
         break;
     }
 
-    /* add to the pool */
+    /* add to the top of the pool */
+    entry->pool = pool;
+    entry->itag = -1;
+    entry->next = NULL;
     entry->prev = m->pools[pool];
+    if(entry->prev)
+        entry->prev->next = entry;
     m->pools[pool] = entry;
 
+    _index_insert(m, entry);
+
     return entry->p;
 }
 
-void *
-fastpm_memory_alloc_details(FastPMMemory * m, const char * name,
-        size_t s, enum FastPMMemoryLocation pool, const char * file, const int line)
+static void *
+_alloc_details(FastPMMemory * m, const char * name,
+        size_t s, enum FastPMMemoryLocation pool, int touch, const char * file, const int line)
 {
     char buf[80];
     sprintf(buf, "%20s: %20s:%d", name, file, line);
-    void * r = fastpm_memory_alloc0(m, s, pool);
+    void * r = fastpm_memory_alloc0(m, s, pool, touch);
     fastpm_memory_tag(m, r, buf);
+
+    MemoryBlock * entry = m->index[_index_find(m, r)];
+    _record_event(m, entry, entry->size);
+    /* after tagging, so that the peak is attributed to the new block */
+    _update_peak(m);
     return r;
 }
 
-
-MemoryBlock * _delist(MemoryBlock ** start, void * p, int * isfirst)
+void *
+fastpm_memory_alloc_details(FastPMMemory * m, const char * name,
+        size_t s, enum FastPMMemoryLocation pool, const char * file, const int line)
 {
-    MemoryBlock * entry = NULL;
-    MemoryBlock * last= NULL;
-
-    for(entry=*start;
-        entry != &head; last=entry, entry=entry->prev) {
-        if(entry->p == p) {
-            break;
-        }
-    }
-    *isfirst = entry == *start;
-    if(entry == &head) return NULL;
+    return _alloc_details(m, name, s, pool, 0, file, line);
+}
 
-    if(last) {
-        last->prev = entry->prev;
-    } else {
-        *start = entry->prev;
-    }
-    return entry;
+void *
+fastpm_memory_alloc_mesh_details(FastPMMemory * m, const char * name,
+        size_t s, enum FastPMMemoryLocation pool, const char * file, const int line)
+{
+    return _alloc_details(m, name, s, pool, 1, file, line);
 }
 
 
 void
 fastpm_memory_free(FastPMMemory * m, void * p)
 {
-    MemoryBlock * entry;
-    int isfirst = 0;
-    int pool;
-    for(pool = 0; pool < FASTPM_MEMORY_MAX; pool++) {
-        entry = _delist(&m->pools[pool], p, &isfirst);
-        if(entry) {
-            if(pool != FASTPM_MEMORY_FLOATING && !isfirst) {
-                _sys_abort(m);
-            }
-            int loc = pool;
-            /* unbacked */
-            if(m->base0 == NULL) {
-                loc = FASTPM_MEMORY_FLOATING;
-            }
-            switch(loc) {
-                case FASTPM_MEMORY_STACK:
-                    m->top += entry->size;
-                break;
-                case FASTPM_MEMORY_HEAP:
-                    m->base -= entry->size;
-                break;
-                case FASTPM_MEMORY_FLOATING:
-                    free(entry->p);
-                break;
-            }
-            goto exit;
-        }
+    size_t i = _index_find(m, p);
+    if(i == (size_t) -1) {
+        /* not ours */
+        _sys_abort(m);
+        return;
     }
-exit:
+    MemoryBlock * entry = m->index[i];
+    int pool = entry->pool;
+
+    /* the stack and the heap are freed in the reverse order of allocation */
+    if(pool != FASTPM_MEMORY_FLOATING && entry->next != NULL) {
+        _sys_abort(m);
+    }
+
+    _index_remove(m, i);
+
+    if(entry->itag >= 0) {
+        m->tags[entry->itag].bytes -= entry->size;
+    }
+    _record_event(m, entry, -(int64_t) entry->size);
+
+    if(entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        m->pools[pool] = entry->prev;
+    }
+    if(entry->prev) {
+        entry->prev->next = entry->next;
+    }
+
+    int loc = pool;
+    /* unbacked */
+    if(m->base0 == NULL) {
+        loc = FASTPM_MEMORY_FLOATING;
+    }
+    switch(loc) {
+        case FASTPM_MEMORY_STACK:
+            m->top += entry->size;
+        break;
+        case FASTPM_MEMORY_HEAP:
+            m->base -= entry->size;
+        break;
+        case FASTPM_MEMORY_FLOATING:
+            free(entry->p);
+        break;
+    }
+
     m->used_bytes -= entry->size;
     m->free_bytes += entry->size;
 
-    free(entry);
-
-    return;
+    _block_recycle(m, entry);
 }
@@ -8,12 +8,16 @@
 static double
 cic_readout_tuned(FastPMPainter * painter, FastPMFloat * canvas, double pos[3], int diffdir);
 
+static void
+cic_readout_many_tuned(FastPMPainter * painter, FastPMFloat * canvas[], int nfields, double pos[3], int diffdir, double value[]);
+
 static void
 cic_paint_tuned(FastPMPainter * painter, FastPMFloat * canvas, double pos[3], double weight, int diffdir);
 
 void
 fastpm_painter_init_cic(FastPMPainter * painter) {
     painter->readout = cic_readout_tuned;
+    painter->readout_many = cic_readout_many_tuned;
     painter->paint = cic_paint_tuned;
 }
 
@@ -189,3 +193,71 @@ cic_readout_tuned(FastPMPainter * painter, FastPMFloat * canvas, double pos[3],
     return value;
 }
 
+/* as cic_readout_tuned, for nfields meshes; the eight cells and their weights
+ * are found once. The sum runs in the same order, so every value[f] is
+ * bitwise the same as cic_readout_tuned on canvas[f]. */
+static void
+cic_readout_many_tuned(FastPMPainter * painter, FastPMFloat * canvas[], int nfields, double pos[3], int diffdir, double value[])
+{
+    PM * pm = painter->pm;
+
+    int d, f;
+
+    double XYZ[3];
+    int IJK[3];
+    int IJK1[3];
+    double D[3];
+    double T[3];
+
+    for(d = 0; d < 3; d ++) {
+        XYZ[d] = pos[d]*pm->InvCellSize[d];
+        // without floor, -1 < X < 0 is mapped to I=0
+        IJK[d] = (int) floor(XYZ[d]);
+        IJK1[d] = IJK[d] + 1;
+    };
+
+    for(d = 0; d < 3; d ++) {
+        D[d] = XYZ[d] - IJK[d];
+        T[d] = 1. - D[d];
+    }
+
+    if(diffdir >= 0) {
+        D[diffdir] = pm->InvCellSize[diffdir];
+        T[diffdir] = -pm->InvCellSize[diffdir];
+    }
+
+    for(d = 0; d < 3; d ++) {
+        while(UNLIKELY(IJK[d] < 0)) IJK[d] += pm->Nmesh[d];
+        while(UNLIKELY(IJK[d] >= pm->Nmesh[d])) IJK[d] -= pm->Nmesh[d];
+        while(UNLIKELY(IJK1[d] < 0)) IJK1[d] += pm->Nmesh[d];
+        while(UNLIKELY(IJK1[d] >= pm->Nmesh[d])) IJK1[d] -= pm->Nmesh[d];
+    }
+
+    /* start[2] == 0 */
+    for(d = 0; d < 2; d ++) {
+        IJK[d] -= pm->IRegion.start[d];
+        IJK1[d] -= pm->IRegion.start[d];
+    }
+
+    const int I[3][2] = {{IJK[0], IJK1[0]}, {IJK[1], IJK1[1]}, {IJK[2], IJK1[2]}};
+    const double W[3][2] = {{T[0], D[0]}, {T[1], D[1]}, {T[2], D[2]}};
+
+    for(f = 0; f < nfields; f ++) {
+        value[f] = 0;
+    }
+
+    int a, b, c;
+    for(a = 0; a < 2; a ++) {
+        if(UNLIKELY(!(0 <= I[0][a] && I[0][a] < pm->IRegion.size[0]))) continue;
+        for(b = 0; b < 2; b ++) {
+            if(UNLIKELY(!(0 <= I[1][b] && I[1][b] < pm->IRegion.size[1]))) continue;
+            for(c = 0; c < 2; c ++) {
+                if(UNLIKELY(!(0 <= I[2][c] && I[2][c] < pm->IRegion.size[2]))) continue;
+                const double w = W[2][c]*W[0][a]*W[1][b];
+                for(f = 0; f < nfields; f ++) {
+                    value[f] += REd(canvas[f], I[0][a], I[1][b], I[2][c], w, pm);
+                }
+            }
+        }
+    }
+}
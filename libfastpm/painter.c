@@ -1,8 +1,12 @@
 #include <string.h>
 #include <math.h>
 #include <mpi.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include <fastpm/libfastpm.h>
+#include <fastpm/logging.h>
 #include "pmpfft.h"
 #include "pmghosts.h"
 
@@ -13,6 +17,9 @@ static void
 _generic_paint(FastPMPainter * painter, FastPMFloat * canvas, double pos[3], double weight, int diffdir);
 static double
 _generic_readout(FastPMPainter * painter, FastPMFloat * canvas, double pos[3], int diffdir);
+static void
+_generic_readout_many(FastPMPainter * painter, FastPMFloat * canvas[], int nfields,
+    double pos[3], int diffdir, double value[]);
 
 static double
 _linear_kernel(double x, double invh) {
@@ -131,12 +138,15 @@ fastpm_painter_init(FastPMPainter * painter, PM * pm,
     painter->pm = pm;
     painter->paint = _generic_paint;
     painter->readout = _generic_readout;
+    painter->readout_many = _generic_readout_many;
 
     switch(type) {
         case FASTPM_PAINTER_CIC:
             fastpm_painter_init_cic(painter);
-            painter->kernel = NULL;
-            painter->diff = NULL;
+            /* CIC is the linear kernel; the tuned functions are used
+             * for paint and readout, the kernel for the tiled painter. */
+            painter->kernel = _linear_kernel;
+            painter->diff = _linear_diff;
             support = 2;
         break;
         case FASTPM_PAINTER_LINEAR:
@@ -160,6 +170,7 @@ fastpm_painter_init(FastPMPainter * painter, PM * pm,
     painter->invh= 1 / (0.5 * support);
     painter->left = (support  - 1) / 2;
     painter->diffdir = -1;
+    painter->tiled = 0;
     int nmax = 1;
     int d;
     for(d = 0; d < 3; d++) {
@@ -181,6 +192,14 @@ fastpm_painter_init_diff(FastPMPainter * painter, FastPMPainter * base, int diff
     painter->diffdir = diffdir;
 }
 
+/* first cell touched by the kernel at grid position gpos, before
+ * removing the offset of the local region. */
+static inline int
+_first_cell(FastPMPainter * painter, double gpos)
+{
+    return floor(gpos + painter->shift) - painter->left;
+}
+
 static void
 _fill_k(FastPMPainter * painter, double pos[3], int ipos[3], double k[3][64], int diffdir)
 {
@@ -189,7 +208,7 @@ _fill_k(FastPMPainter * painter, double pos[3], int ipos[3], double k[3][64], in
     int d;
     for(d = 0; d < 3; d++) {
         gpos[d] = pos[d] * pm->InvCellSize[d];
-        ipos[d] = floor(gpos[d] + painter->shift) - painter->left;
+        ipos[d] = _first_cell(painter, gpos[d]);
         double dx = gpos[d] - ipos[d];
         int i;
         double sum = 0;
@@ -316,6 +335,278 @@ outside:
     return value;
 }
 
+/*
+ * Tiled painting.
+ *
+ * The planes of the local region along x are split into tiles of a fixed
+ * width; particles are binned (stably) by the tile holding the first plane
+ * touched by their kernel. A tile is painted by a single thread, without
+ * atomics: planes only reached by the tile go directly to the canvas,
+ * the first and last (support - 1) planes, which are shared with the
+ * neighbouring tiles, go to a private border buffer of the tile. The borders
+ * are merged into the canvas after all tiles are painted.
+ *
+ * The tiles depend only on the mesh and the painter, not on the number of
+ * threads, hence neither does the order of additions into any cell;
+ * the painted field is bitwise reproducible for any number of threads.
+ *
+ * Planes are labelled by an unwrapped local coordinate u. If the local
+ * region covers the full mesh along x, u runs over [0, Nmesh) and the
+ * tail of the last tile wraps to the head of the first tile; otherwise
+ * u runs over [-(support - 1), size), and planes outside [0, size) are
+ * not local.
+ * */
+typedef struct {
+    ptrdiff_t Nmesh;
+    ptrdiff_t size;
+    int wrap;
+    ptrdiff_t lo;       /* first plane of the first tile */
+    ptrdiff_t range;    /* number of planes covered by the tiles */
+    ptrdiff_t width;    /* planes per tile; the last tile takes the remainder */
+    ptrdiff_t nborder;  /* planes shared by neighbouring tiles, support - 1 */
+    int ntiles;
+} PaintTiles;
+
+static int
+_paint_tiles_init(FastPMPainter * painter, PaintTiles * tiles)
+{
+    PM * pm = painter->pm;
+
+    tiles->Nmesh = pm->Nmesh[0];
+    tiles->size = pm->IRegion.size[0];
+    tiles->nborder = painter->support - 1;
+    tiles->wrap = tiles->size == tiles->Nmesh;
+
+    if(tiles->size == 0 || tiles->nborder < 1) return 0;
+
+    if(tiles->wrap) {
+        if(tiles->Nmesh < tiles->nborder) return 0;
+        tiles->lo = 0;
+        tiles->range = tiles->Nmesh;
+    } else {
+        /* the kernel must not reach the local region from both sides */
+        if(tiles->Nmesh - tiles->size < tiles->nborder) return 0;
+        tiles->lo = - tiles->nborder;
+        tiles->range = tiles->size + tiles->nborder;
+    }
+
+    /* borders take 2 * (support - 1) planes per tile. */
+    tiles->width = 8 * painter->support;
+    tiles->ntiles = tiles->range / tiles->width;
+    if(tiles->ntiles == 0) {
+        tiles->ntiles = 1;
+        tiles->width = tiles->range;
+    }
+    return 1;
+}
+
+/* map the first plane of a kernel (local, may be off by periods) to u. */
+static inline ptrdiff_t
+_paint_tiles_plane(PaintTiles * tiles, ptrdiff_t u)
+{
+    while(u >= tiles->Nmesh) u -= tiles->Nmesh;
+    while(u < 0) u += tiles->Nmesh;
+    if(u >= tiles->size) u -= tiles->Nmesh;
+    return u;
+}
+
+static inline int
+_paint_tiles_find(PaintTiles * tiles, ptrdiff_t u)
+{
+    if(u < tiles->lo) return -1;
+    ptrdiff_t t = (u - tiles->lo) / tiles->width;
+    if(t >= tiles->ntiles) t = tiles->ntiles - 1;
+    return t;
+}
+
+static void
+_tile_paint(FastPMPainter * painter, PaintTiles * tiles, FastPMFloat * canvas,
+    FastPMFloat * head, FastPMFloat * tail, ptrdiff_t b, ptrdiff_t e,
+    double pos[3], double weight)
+{
+    PM * pm = painter->pm;
+    int ipos[3];
+    double k[3][64];
+    ptrdiff_t offset[3][64];
+
+    _fill_k(painter, pos, ipos, k, painter->diffdir);
+
+    int d;
+    int r0, r1, r2;
+    int s2 = painter->support;
+    for(d = 1; d < 3; d ++) {
+        int r;
+        for(r = 0; r < s2; r ++) {
+            int targetpos = ipos[d] + r;
+            while(targetpos >= pm->Nmesh[d]) {
+                targetpos -= pm->Nmesh[d];
+            }
+            while(targetpos < 0) {
+                targetpos += pm->Nmesh[d];
+            }
+            if(UNLIKELY(targetpos >= pm->IRegion.size[d]))
+                offset[d][r] = -1;
+            else
+                offset[d][r] = pm->IRegion.strides[d] * targetpos;
+        }
+    }
+
+    ptrdiff_t u0 = _paint_tiles_plane(tiles, ipos[0]);
+    for(r0 = 0; r0 < s2; r0 ++) {
+        ptrdiff_t u = u0 + r0;
+        FastPMFloat * plane;
+        if(u < b + tiles->nborder) {
+            if(UNLIKELY(u < b)) continue;
+            plane = head + (u - b) * pm->IRegion.strides[0];
+        } else if(u < e) {
+            plane = canvas + u * pm->IRegion.strides[0];
+        } else {
+            if(UNLIKELY(u >= e + tiles->nborder)) continue;
+            plane = tail + (u - e) * pm->IRegion.strides[0];
+        }
+        for(r1 = 0; r1 < s2; r1 ++) {
+            if(UNLIKELY(offset[1][r1] < 0)) continue;
+            for(r2 = 0; r2 < s2; r2 ++) {
+                if(UNLIKELY(offset[2][r2] < 0)) continue;
+                double kernel = k[0][r0] * k[1][r1] * k[2][r2];
+                plane[offset[1][r1] + offset[2][r2]] += weight * kernel;
+            }
+        }
+    }
+}
+
+static inline double
+_get_weight(FastPMStore * p, ptrdiff_t i, int ci, FastPMFieldDescr field)
+{
+    if (!field.attribute) {
+        return fastpm_store_get_mass(p, i);
+    } else {
+        return fastpm_store_get_mass(p, i) * p->_column_info[ci].to_double(p, i, ci, field.memb);
+    }
+}
+
+static inline int
+_get_tile(FastPMPainter * painter, PaintTiles * tiles, FastPMStore * p, ptrdiff_t i)
+{
+    PM * pm = painter->pm;
+    double pos[3];
+    fastpm_store_get_position(p, i, pos);
+    ptrdiff_t u = _first_cell(painter, pos[0] * pm->InvCellSize[0]) - pm->IRegion.start[0];
+    return _paint_tiles_find(tiles, _paint_tiles_plane(tiles, u));
+}
+
+static void
+_paint_local_tiled(FastPMPainter * painter, PaintTiles * tiles, FastPMFloat * canvas,
+    FastPMStore * p, size_t size,
+    FastPMFieldDescr field)
+{
+    PM * pm = painter->pm;
+    int ci = fastpm_store_find_column_id(p, field.attribute);
+    const int T = tiles->ntiles;
+    const ptrdiff_t nb = tiles->nborder;
+    const ptrdiff_t planesize = pm->IRegion.strides[0];
+
+    ptrdiff_t * order = fastpm_memory_alloc(pm->mem, "PaintOrder",
+                sizeof(order[0]) * size, FASTPM_MEMORY_STACK);
+    FastPMFloat * border = fastpm_memory_alloc(pm->mem, "PaintBorder",
+                sizeof(border[0]) * T * 2 * nb * planesize, FASTPM_MEMORY_STACK);
+
+#ifdef _OPENMP
+    size_t * count = malloc(sizeof(count[0]) * omp_get_max_threads() * T);
+#else
+    size_t * count = malloc(sizeof(count[0]) * T);
+#endif
+    size_t * first = malloc(sizeof(first[0]) * (T + 1));
+
+#pragma omp parallel
+    {
+#ifdef _OPENMP
+        const int nth = omp_get_num_threads();
+        const int ith = omp_get_thread_num();
+#else
+        const int nth = 1;
+        const int ith = 0;
+#endif
+        size_t * mycount = count + ith * T;
+        ptrdiff_t i;
+        int t;
+
+        for(t = 0; t < T; t ++) {
+            mycount[t] = 0;
+        }
+
+        /* counting sort by tile; the static schedule gives each thread
+         * the same contiguous chunk in both passes, so the sort is stable. */
+#pragma omp for schedule(static)
+        for(i = 0; i < size; i ++) {
+            t = _get_tile(painter, tiles, p, i);
+            if(t >= 0) mycount[t] ++;
+        }
+
+#pragma omp single
+        {
+            size_t offset = 0;
+            int j;
+            for(t = 0; t < T; t ++) {
+                first[t] = offset;
+                for(j = 0; j < nth; j ++) {
+                    size_t c = count[j * T + t];
+                    count[j * T + t] = offset;
+                    offset += c;
+                }
+            }
+            first[T] = offset;
+        }
+
+#pragma omp for schedule(static)
+        for(i = 0; i < size; i ++) {
+            t = _get_tile(painter, tiles, p, i);
+            if(t >= 0) order[mycount[t]++] = i;
+        }
+
+#pragma omp for schedule(dynamic, 1)
+        for(t = 0; t < T; t ++) {
+            FastPMFloat * head = border + t * 2 * nb * planesize;
+            FastPMFloat * tail = head + nb * planesize;
+            ptrdiff_t b = tiles->lo + t * tiles->width;
+            ptrdiff_t e = (t == T - 1)? tiles->lo + tiles->range : b + tiles->width;
+            ptrdiff_t j;
+
+            memset(head, 0, sizeof(head[0]) * 2 * nb * planesize);
+
+            for(j = first[t]; j < first[t + 1]; j ++) {
+                double pos[3];
+                double weight = _get_weight(p, order[j], ci, field);
+                fastpm_store_get_position(p, order[j], pos);
+                _tile_paint(painter, tiles, canvas, head, tail, b, e, pos, weight);
+            }
+        }
+
+        /* the first nb planes of tile t receive its head and the tail of tile t - 1 */
+#pragma omp for schedule(static)
+        for(i = 0; i < T * nb; i ++) {
+            t = i / nb;
+            ptrdiff_t r = i % nb;
+            ptrdiff_t u = tiles->lo + t * tiles->width + r;
+            /* not local, only possible for the first tile. */
+            if(u < 0) continue;
+
+            FastPMFloat * dst = canvas + u * planesize;
+            FastPMFloat * head = border + (t * 2 * nb + r) * planesize;
+            FastPMFloat * tail = border + (((t + T - 1) % T) * 2 * nb + nb + r) * planesize;
+            ptrdiff_t q;
+            for(q = 0; q < planesize; q ++) {
+                dst[q] += head[q] + tail[q];
+            }
+        }
+    }
+
+    free(first);
+    free(count);
+    fastpm_memory_free(pm->mem, border);
+    fastpm_memory_free(pm->mem, order);
+}
+
 void
 fastpm_paint_local(FastPMPainter * painter, FastPMFloat * canvas,
     FastPMStore * p, size_t size,
@@ -324,15 +615,17 @@ fastpm_paint_local(FastPMPainter * painter, FastPMFloat * canvas,
     ptrdiff_t i;
     int ci = fastpm_store_find_column_id(p, field.attribute);
 
+    PaintTiles tiles[1];
+    if(painter->tiled && _paint_tiles_init(painter, tiles)) {
+        if(size > 0)
+            _paint_local_tiled(painter, tiles, canvas, p, size, field);
+        return;
+    }
+
 #pragma omp parallel for
     for (i = 0; i < size; i ++) {
         double pos[3];
-        double weight;
-        if (!field.attribute) {
-            weight = fastpm_store_get_mass(p, i);
-        } else {
-            weight = fastpm_store_get_mass(p, i) * p->_column_info[ci].to_double(p, i, ci, field.memb);
-        }
+        double weight = _get_weight(p, i, ci, field);
         fastpm_store_get_position(p, i, pos);
         painter->paint(painter, canvas, pos, weight, painter->diffdir);
     }
@@ -372,3 +665,111 @@ fastpm_readout_local(FastPMPainter * painter, FastPMFloat * canvas,
         p->_column_info[ci].from_double(p, i, ci, field.memb, weight);
     }
 }
+
+/* read out nfields meshes at pos; the kernel weights and the cell offsets
+ * are computed once for all meshes. */
+static void
+_generic_readout_many(FastPMPainter * painter, FastPMFloat * canvas[], int nfields,
+    double pos[3], int diffdir, double value[])
+{
+    PM * pm = painter->pm;
+    int ipos[3];
+    double k[3][64];
+    ptrdiff_t offset[3][64];
+
+    _fill_k(painter, pos, ipos, k, diffdir);
+
+    int s2 = painter->support;
+    int d, f;
+    for(d = 0; d < 3; d ++) {
+        int r;
+        for(r = 0; r < s2; r ++) {
+            int targetpos = ipos[d] + r;
+            while(targetpos >= pm->Nmesh[d]) {
+                targetpos -= pm->Nmesh[d];
+            }
+            while(targetpos < 0) {
+                targetpos += pm->Nmesh[d];
+            }
+            if(UNLIKELY(targetpos >= pm->IRegion.size[d]))
+                offset[d][r] = -1;
+            else
+                offset[d][r] = pm->IRegion.strides[d] * targetpos;
+        }
+    }
+
+    for(f = 0; f < nfields; f ++) {
+        value[f] = 0;
+    }
+
+    int r0, r1, r2;
+    for(r0 = 0; r0 < s2; r0 ++) {
+        if(UNLIKELY(offset[0][r0] < 0)) continue;
+        for(r1 = 0; r1 < s2; r1 ++) {
+            if(UNLIKELY(offset[1][r1] < 0)) continue;
+            double k01 = k[0][r0] * k[1][r1];
+            ptrdiff_t ind01 = offset[0][r0] + offset[1][r1];
+            for(r2 = 0; r2 < s2; r2 ++) {
+                if(UNLIKELY(offset[2][r2] < 0)) continue;
+                double kernel = k01 * k[2][r2];
+                ptrdiff_t ind = ind01 + offset[2][r2];
+                for(f = 0; f < nfields; f ++) {
+                    value[f] += kernel * canvas[f][ind];
+                }
+            }
+        }
+    }
+}
+
+void
+fastpm_readout_local_many(FastPMPainter * painter, FastPMFloat * canvas[], int nfields,
+    FastPMStore * p, size_t size,
+    FastPMFieldDescr field[])
+{
+    ptrdiff_t i;
+    int ci[nfields];
+    int f;
+    for(f = 0; f < nfields; f ++) {
+        ci[f] = fastpm_store_find_column_id(p, field[f].attribute);
+    }
+
+#pragma omp parallel for private(f)
+    for (i = 0; i < size; i ++) {
+        double pos[3];
+        double value[nfields];
+        fastpm_store_get_position(p, i, pos);
+        painter->readout_many(painter, canvas, nfields, pos, painter->diffdir, value);
+        for(f = 0; f < nfields; f ++) {
+            p->_column_info[ci[f]].from_double(p, i, ci[f], field[f].memb, value[f]);
+        }
+    }
+}
+
+void
+fastpm_readout_local_many_add(FastPMPainter * painter, FastPMFloat * canvas[], int nfields,
+    FastPMStore * p, size_t size,
+    FastPMFieldDescr field[], const double scale[])
+{
+    ptrdiff_t i;
+    int ci[nfields];
+    int f;
+    for(f = 0; f < nfields; f ++) {
+        ci[f] = fastpm_store_find_column_id(p, field[f].attribute);
+        if(!p->_column_info[ci[f]].to_double) {
+            fastpm_raise(-1, "Column %s didnot set to_double virtual function\n",
+                p->_column_info[ci[f]].name);
+        }
+    }
+
+#pragma omp parallel for private(f)
+    for (i = 0; i < size; i ++) {
+        double pos[3];
+        double value[nfields];
+        fastpm_store_get_position(p, i, pos);
+        painter->readout_many(painter, canvas, nfields, pos, painter->diffdir, value);
+        for(f = 0; f < nfields; f ++) {
+            double old = p->_column_info[ci[f]].to_double(p, i, ci[f], field[f].memb);
+            p->_column_info[ci[f]].from_double(p, i, ci[f], field[f].memb, old + scale[f] * value[f]);
+        }
+    }
+}
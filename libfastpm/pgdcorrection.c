@@ -25,35 +25,21 @@ fastpm_pgdc_get_kl(FastPMPGDCorrection * pgdc, double a)
     return pgdc->kl;
 }
 
-static void
-apply_pgdpot_transfer(PM * pm, FastPMFloat * from, FastPMFloat * to, double alpha, double kl, double ks)
+struct pgdpot {
+    double alpha;
+    double kl2;
+    double ks4;
+};
+
+static double
+pgdpot(double k, struct pgdpot * pot)
 {
-#pragma omp parallel
-    {
-        PMKIter kiter;
-        pm_kiter_init(pm, &kiter);
-	double kl2 = kl*kl;
-	double ks4 = ks*ks*ks*ks;
-        for(;
-            !pm_kiter_stop(&kiter);
-            pm_kiter_next(&kiter)) {
-            int d;
-            double kk = 0;
-            for(d = 0; d < 3; d++) {
-                kk += kiter.kk[d][kiter.iabs[d]];
-            }
-            ptrdiff_t ind = kiter.ind;
-            /* - 1 / k2 */
-            if(LIKELY(kk > 0)) {
-		double fac = alpha * exp(-kl2/kk-kk*kk/ks4) / kk;
-                to[ind + 0] = fac * from[ind + 0];
-                to[ind + 1] = fac * from[ind + 1];
-            } else {
-                to[ind + 0] = 0;
-                to[ind + 1] = 0;
-            }
-        }
+    double kk = k * k;
+    /* - 1 / k2 */
+    if(LIKELY(kk > 0)) {
+        return pot->alpha * exp(-pot->kl2/kk-kk*kk/pot->ks4) / kk;
     }
+    return 0;
 }
 
 void
@@ -89,37 +75,53 @@ fastpm_pgdc_calculate(FastPMPGDCorrection * pgdc,
     CLOCK(readout);
     CLOCK(reduce);
 
-    FastPMFloat * canvas = pm_alloc(pm);
+    /* the components go through batched c2r of up to nbatch canvases */
+    int nbatch = pm_batch_size(pm, 3);
+    FastPMFloat * canvas[3];
+    for(d = 0; d < nbatch; d ++) {
+        canvas[d] = pm_alloc(pm);
+    }
 
     double kl = fastpm_pgdc_get_kl(pgdc, a);
     double ks = fastpm_pgdc_get_ks(pgdc, a);
     double alpha = fastpm_pgdc_get_alpha(pgdc, a)*fac;
 
-    for(d = 0; d < 3; d ++) {
+    struct pgdpot pot = {alpha, kl * kl, ks * ks * ks * ks};
+
+    int d0, n;
+    for(d0 = 0; d0 < 3; d0 += n) {
+        n = (3 - d0 < nbatch) ? 3 - d0 : nbatch;
 
         ENTER(transfer);
-        /* apply the transfers */
-        apply_pgdpot_transfer(pm, delta_k, canvas, alpha, kl, ks);
-        fastpm_apply_diff_transfer(pm, canvas, canvas, C[d].memb, 1);  // PGD was calibrated using difforder=1. FIXME might want to recalibrate
-        /* result saved to canvas. */
+        for(d = 0; d < n; d ++) {
+            /* apply the transfers; the filter only depends on |k|, and is tabulated */
+            FastPMTransferChain chain[1];
+            fastpm_transfer_chain_init(chain, pm);
+            fastpm_transfer_chain_add_radial(chain, (fastpm_fkfunc) pgdpot, &pot);
+            fastpm_transfer_chain_add_diff(chain, C[d0 + d].memb, 1);  // PGD was calibrated using difforder=1. FIXME might want to recalibrate
+            fastpm_transfer_chain_apply(chain, delta_k, canvas[d]);
+            fastpm_transfer_chain_destroy(chain);
+            /* result saved to canvas. */
+        }
         LEAVE(transfer);
 
         ENTER(c2r);
-        pm_c2r(pm, canvas);
+        pm_c2r_many(pm, canvas, n);
         LEAVE(c2r);
 
         ENTER(readout);
-        fastpm_readout_local(reader, canvas, p, p->np, C[d]);
-        fastpm_readout_local(reader, canvas, pgd->p, pgd->p->np, C[d]);
+        fastpm_readout_local_many(reader, canvas, n, p, p->np, C + d0);
+        fastpm_readout_local_many(reader, canvas, n, pgd->p, pgd->p->np, C + d0);
         LEAVE(readout);
-
     }
 
     ENTER(reduce);
     pm_ghosts_reduce(pgd, COLUMN_PGDC, FastPMReduceAddFloat, NULL);
     LEAVE(reduce);
 
-    pm_free(pm, canvas);
+    for(d = nbatch - 1; d >= 0; d --) {
+        pm_free(pm, canvas[d]);
+    }
 
     pm_ghosts_free(pgd);
 }
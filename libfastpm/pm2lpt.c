@@ -28,9 +28,12 @@ pm_2lpt_solve(PM * pm, FastPMFloat * delta_k, FastPMFuncK * growth_rate_func_k,
      * Because we will read out from the (de-)shifted positions.
      * Otherwise the IC will have artifacts along the edges of domains. */
     for(i = 0; i < p->np; i ++) {
+        double x[3];
+        fastpm_store_get_position(p, i, x);
         for(d = 0; d < 3; d ++) {
-            p->x[i][d] -= shift[d];
+            x[d] -= shift[d];
         }
+        fastpm_store_set_position(p, i, x);
     }
     FastPMPainter painter[1];
     fastpm_painter_init(painter, pm, FASTPM_PAINTER_CIC, 0);
@@ -60,41 +63,54 @@ pm_2lpt_solve(PM * pm, FastPMFloat * delta_k, FastPMFuncK * growth_rate_func_k,
     int D1[] = {1, 2, 0};
     int D2[] = {2, 0, 1};
 
-    /* 1LPT */
+    /* each transfer below is a single sweep over delta_k */
+    FastPMTransferChain chain[1];
+
+    /* 1LPT; the three components share a single c2r */
     for(d = 0; d < 3; d++) {
         /* dx1 */
         /*Check the variable "ic_kernel_type" and decide who to call the functions*/
-        fastpm_apply_laplace_transfer(pm, delta_k, workspace, potorder);
-        fastpm_apply_diff_transfer(pm, workspace, workspace, d, difforder);
+        fastpm_transfer_chain_init(chain, pm);
+        fastpm_transfer_chain_add_laplace(chain, potorder);
+        fastpm_transfer_chain_add_diff(chain, d, difforder);
+        fastpm_transfer_chain_apply(chain, delta_k, field[d]);
+        fastpm_transfer_chain_destroy(chain);
+    }
 
-        pm_c2r(pm, workspace);
+    pm_c2r_many(pm, field, 3);
 
-        fastpm_readout_local(painter, workspace, p, p->np, DX1[d]);
-        fastpm_readout_local(painter, workspace, pgd->p, pgd->p->np, DX1[d]);
+    fastpm_readout_local_many(painter, field, 3, p, p->np, DX1);
+    fastpm_readout_local_many(painter, field, 3, pgd->p, pgd->p->np, DX1);
 
-        /* dv1 */
-        if (p->dv1) {
-            fastpm_apply_laplace_transfer(pm, delta_k, workspace, potorder);
-            fastpm_apply_diff_transfer(pm, workspace, workspace, d, difforder);
-            
-            fastpm_apply_any_transfer(pm, workspace, workspace, (fastpm_fkfunc) fastpm_funck_eval2, growth_rate_func_k);
+    /* dv1 */
+    if (p->dv1) {
+        for(d = 0; d < 3; d++) {
+            fastpm_transfer_chain_init(chain, pm);
+            fastpm_transfer_chain_add_laplace(chain, potorder);
+            fastpm_transfer_chain_add_diff(chain, d, difforder);
+            fastpm_transfer_chain_add_any(chain, (fastpm_fkfunc) fastpm_funck_eval2, growth_rate_func_k);
+            fastpm_transfer_chain_apply(chain, delta_k, field[d]);
+            fastpm_transfer_chain_destroy(chain);
+        }
 
-            pm_c2r(pm, workspace);
+        pm_c2r_many(pm, field, 3);
 
-            fastpm_readout_local(painter, workspace, p, p->np, DV1[d]);
-            fastpm_readout_local(painter, workspace, pgd->p, pgd->p->np, DV1[d]);
-        }
+        fastpm_readout_local_many(painter, field, 3, p, p->np, DV1);
+        fastpm_readout_local_many(painter, field, 3, pgd->p, pgd->p->np, DV1);
     }
 
     /* 2LPT */
     for(d = 0; d< 3; d++) {
-        fastpm_apply_laplace_transfer(pm, delta_k, field[d], potorder);
-        fastpm_apply_diff_transfer(pm, field[d], field[d], d, difforder);
-        fastpm_apply_diff_transfer(pm, field[d], field[d], d, difforder);
-        
-        pm_c2r(pm, field[d]);
+        fastpm_transfer_chain_init(chain, pm);
+        fastpm_transfer_chain_add_laplace(chain, potorder);
+        fastpm_transfer_chain_add_diff(chain, d, difforder);
+        fastpm_transfer_chain_add_diff(chain, d, difforder);
+        fastpm_transfer_chain_apply(chain, delta_k, field[d]);
+        fastpm_transfer_chain_destroy(chain);
     }
 
+    pm_c2r_many(pm, field, 3);
+
     for(d = 0; d < 3; d++) {
         int d1 = D1[d];
         int d2 = D2[d];
@@ -104,17 +120,24 @@ pm_2lpt_solve(PM * pm, FastPMFloat * delta_k, FastPMFuncK * growth_rate_func_k,
         }
     }
 
+    /* the diagonal terms are consumed; reuse field for the off-diagonal terms */
     for(d = 0; d < 3; d++) {
         int d1 = D1[d];
         int d2 = D2[d];
-        fastpm_apply_laplace_transfer(pm, delta_k, workspace, potorder);
-        fastpm_apply_diff_transfer(pm, workspace, workspace, d1, difforder);
-        fastpm_apply_diff_transfer(pm, workspace, workspace, d2, difforder);
+        fastpm_transfer_chain_init(chain, pm);
+        fastpm_transfer_chain_add_laplace(chain, potorder);
+        fastpm_transfer_chain_add_diff(chain, d1, difforder);
+        fastpm_transfer_chain_add_diff(chain, d2, difforder);
+        fastpm_transfer_chain_apply(chain, delta_k, field[d]);
+        fastpm_transfer_chain_destroy(chain);
+    }
+
+    pm_c2r_many(pm, field, 3);
 
-        pm_c2r(pm, workspace);
+    for(d = 0; d < 3; d++) {
 #pragma omp parallel for
         for(i = 0; i < pm->IRegion.total; i ++) {
-            source[i] -= workspace[i] * workspace[i];
+            source[i] -= field[d][i] * field[d][i];
         }
     } 
     pm_r2c(pm, source, workspace);
@@ -126,18 +149,20 @@ pm_2lpt_solve(PM * pm, FastPMFloat * delta_k, FastPMFuncK * growth_rate_func_k,
          *
          * */
 
-        fastpm_apply_laplace_transfer(pm, source, workspace, potorder);
-        fastpm_apply_diff_transfer(pm, workspace, workspace, d, difforder);
-
-        pm_c2r(pm, workspace);
-
+        fastpm_transfer_chain_init(chain, pm);
+        fastpm_transfer_chain_add_laplace(chain, potorder);
+        fastpm_transfer_chain_add_diff(chain, d, difforder);
         /* this ensures x = x0 + dx1(t) + dx2(t) */
-        fastpm_apply_multiply_transfer(pm, workspace, workspace, 3.0 / 7);
-
-        fastpm_readout_local(painter, workspace, p, p->np, DX2[d]);
-        fastpm_readout_local(painter, workspace, pgd->p, pgd->p->np, DX2[d]);
+        fastpm_transfer_chain_add_multiply(chain, 3.0 / 7);
+        fastpm_transfer_chain_apply(chain, source, field[d]);
+        fastpm_transfer_chain_destroy(chain);
     }
 
+    pm_c2r_many(pm, field, 3);
+
+    fastpm_readout_local_many(painter, field, 3, p, p->np, DX2);
+    fastpm_readout_local_many(painter, field, 3, pgd->p, pgd->p->np, DX2);
+
     pm_ghosts_reduce(pgd, COLUMN_DX1, FastPMReduceAddFloat, NULL);
     pm_ghosts_reduce(pgd, COLUMN_DX2, FastPMReduceAddFloat, NULL);
     if (p->dv1) pm_ghosts_reduce(pgd, COLUMN_DV1, FastPMReduceAddFloat, NULL);
@@ -148,9 +173,12 @@ pm_2lpt_solve(PM * pm, FastPMFloat * delta_k, FastPMFuncK * growth_rate_func_k,
 #endif
 
     for(i = 0; i < p->np; i ++) {
+        double x[3];
+        fastpm_store_get_position(p, i, x);
         for(d = 0; d < 3; d ++) {
-            p->x[i][d] += shift[d];
+            x[d] += shift[d];
         }
+        fastpm_store_set_position(p, i, x);
     }
 
     for(d = 0; d < 3; d ++) {
@@ -192,9 +220,11 @@ pm_2lpt_evolve(double aout, FastPMStore * p, FastPMCosmology * c, int zaonly)
     int i;
 #pragma omp parallel for
     for(i=0; i<np; i++) {
+        double x[3];
+        fastpm_store_get_position(p, i, x);
         int d;
         for(d = 0; d < 3; d ++) {
-            p->x[i][d] += D1 * p->dx1[i][d] + D2 * p->dx2[i][d];
+            x[d] += D1 * p->dx1[i][d] + D2 * p->dx2[i][d];
 
             if(p->v) {
                 p->v[i][d] += p->dx2[i][d]*Dv2;
@@ -205,6 +235,7 @@ pm_2lpt_evolve(double aout, FastPMStore * p, FastPMCosmology * c, int zaonly)
                 }
             }
         }
+        fastpm_store_set_position(p, i, x);
     }
     p->meta.a_x = p->meta.a_v = aout;
 }
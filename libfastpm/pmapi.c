@@ -10,7 +10,7 @@
 
 FastPMFloat * pm_alloc_details(PM * pm, const char * file, const int line)
 {
-    void * p = fastpm_memory_alloc_details(pm->mem, "PMAlloc", sizeof(FastPMFloat) * pm->allocsize, FASTPM_MEMORY_HEAP, file, line);
+    void * p = fastpm_memory_alloc_mesh_details(pm->mem, "PMAlloc", sizeof(FastPMFloat) * pm->allocsize, FASTPM_MEMORY_HEAP, file, line);
     memset(p, 0, pm->allocsize * sizeof(FastPMFloat));
     return p;
 }
@@ -85,12 +85,6 @@ PMRegion * pm_o_region(PM * pm) {
     return &pm->ORegion;
 }
 
-static void 
-pm_create_k_factors(PM * pm, PMKIter * iter);
-
-static void 
-pm_destroy_k_factors(PMKIter * iter);
-
 void 
 pm_kiter_init(PM * pm, PMKIter * iter) 
 {
@@ -127,10 +121,13 @@ pm_kiter_init(PM * pm, PMKIter * iter)
     int d;
     for(d = 0; d < 3; d ++) {
         iter->iabs[d] = iter->i[d] + pm->ORegion.start[d];
+        /* the tables belong to the PM; see pm_create_k_factors */
+        iter->k[d] = pm->KFactors.k[d];
+        iter->k_finite[d] = pm->KFactors.k_finite[d];
+        iter->kk[d] = pm->KFactors.kk[d];
+        iter->kk_finite[d] = pm->KFactors.kk_finite[d];
+        iter->kk_finite2[d] = pm->KFactors.kk_finite2[d];
     }
-
-    pm_create_k_factors(pm, iter);
-
 }
 
 double pm_kiter_get_kmag(PMKIter * iter)
@@ -146,9 +143,6 @@ double pm_kiter_get_kmag(PMKIter * iter)
 int pm_kiter_stop(PMKIter * iter) 
 {
     int stop = !(iter->ind < iter->end);
-    if(stop) {
-        pm_destroy_k_factors(iter);
-    }
     return stop;
 }
 
@@ -231,7 +225,7 @@ diff_kernel(double w)
     return 1 / 6.0 * (8 * sin (w) - sin (2 * w));
 }
 
-static void 
+void 
 pm_create_k_factors(PM * pm, PMKIter * iter) 
 { 
     /* This function populates fac with precalculated values that
@@ -239,6 +233,8 @@ pm_create_k_factors(PM * pm, PMKIter * iter)
      * e.g. k**2 and the finite differentiation kernels. 
      * precalculating them means in the true kernel we only need a 
      * table look up. watch out for the offset ORegion.start
+     *
+     * Called once by pm_init; the iterators share the tables of the PM.
      * */
     int d;
     ptrdiff_t ind;
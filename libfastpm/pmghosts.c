@@ -7,6 +7,10 @@
 #include "pmpfft.h"
 #include "pmghosts.h"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #ifdef ENABLE_VALGRIND
 #include </usr/include/valgrind/memcheck.h>
 #endif
@@ -21,6 +25,7 @@ void pm_ghosts_free(PMGhostData * pgd) {
 
     fastpm_memory_free(pgd->pm->mem, pgd->ighost_to_ipar);
 
+    free(pgd->Nsend_chunk);
     free(pgd->Nsend);
     free(pgd->Osend);
     free(pgd->Nrecv);
@@ -28,52 +33,80 @@ void pm_ghosts_free(PMGhostData * pgd) {
     free(pgd);
 }
 
+/* returns 1 if all cells between left and right are on the local
+ * domain in x and y; such particles never produce ghosts. */
+static int
+pm_ghosts_window_is_local(PM * pm, int left[3], int right[3])
+{
+    int d;
+    for(d = 0; d < 2; d ++) {
+        if(pm->Nproc[d] == 1) continue;
+        if(pm->IRegion.size[d] == 0) return 0;
+        if(left[d] < pm->IRegion.start[d]) return 0;
+        if(right[d] >= pm->IRegion.start[d] + pm->IRegion.size[d]) return 0;
+    }
+    return 1;
+}
+
+/* The particles are split into pgd->nchunks contiguous chunks that are
+ * visited in parallel; iter_func sees pgd->ichunk of the particle. */
 static void
-pm_iter_ghosts(PM * pm, PMGhostData * pgd, 
+pm_iter_ghosts(PM * pm, PMGhostData * pgd,
     pm_iter_ghosts_func iter_func, void * userdata)
 {
-
-    ptrdiff_t i;
-    for (i = 0; i < pgd->source->np; i ++) {
+    int ichunk;
+#pragma omp parallel for schedule(dynamic, 1)
+    for(ichunk = 0; ichunk < pgd->nchunks; ichunk ++) {
         PMGhostData localppd = *pgd;
-        double pos[3];
-        int rank;
-        fastpm_store_get_position(pgd->source, i, pos);
-        int d;
-
-        /* how far the window expands. */
-        int left[3];
-        int right[3];
-        for(d = 0; d < 3; d ++) {
-            /* this condition is not tightest for CIC painting, because
-             * a particle touches a cell doesn't mean cic touches the left edge
-             * of the cell.
-             * */
-            left[d] = floor(pos[d] * pm->InvCellSize[d] + pgd->Below[d]);
-            right[d] = floor(pos[d] * pm->InvCellSize[d] + pgd->Above[d]);
-        }
+        localppd.ichunk = ichunk;
+
+        ptrdiff_t start = pgd->source->np * ichunk / pgd->nchunks;
+        ptrdiff_t end = pgd->source->np * (ichunk + 1) / pgd->nchunks;
+
+        ptrdiff_t i;
+        for (i = start; i < end; i ++) {
+            double pos[3];
+            int rank;
+            fastpm_store_get_position(pgd->source, i, pos);
+            int d;
+
+            /* how far the window expands. */
+            int left[3];
+            int right[3];
+            for(d = 0; d < 3; d ++) {
+                /* this condition is not tightest for CIC painting, because
+                 * a particle touches a cell doesn't mean cic touches the left edge
+                 * of the cell.
+                 * */
+                left[d] = floor(pos[d] * pm->InvCellSize[d] + pgd->Below[d]);
+                right[d] = floor(pos[d] * pm->InvCellSize[d] + pgd->Above[d]);
+            }
 
-        /* probe neighbours */
-        int j[3];
-        int ranks[1000];
-        int used = 0;
-        localppd.ipar = i;
-        /* no need to run the z loop because the decomposition is in xy */
-        for(j[2] = left[2]; j[2] <= right[2]; j[2] ++)
-        for(j[0] = left[0]; j[0] <= right[0]; j[0] ++)
-        for(j[1] = left[1]; j[1] <= right[1]; j[1] ++)
-        {
-            rank = pm_ipos_to_rank(pm, j);
-            if(LIKELY(rank == pm->ThisTask))  continue;
-            int ptr;
-            for(ptr = 0; ptr < used; ptr++) {
-                if(rank == ranks[ptr]) break;
-            } 
-            if(UNLIKELY(ptr == used)) {
-                ranks[used++] = rank;
-                localppd.rank = rank;
-                localppd.reason = j;
-                iter_func(pm, &localppd, userdata);
+            /* most particles are far from the faces of the domain */
+            if(LIKELY(pm_ghosts_window_is_local(pm, left, right))) continue;
+
+            /* probe neighbours */
+            int j[3];
+            int ranks[1000];
+            int used = 0;
+            localppd.ipar = i;
+            /* no need to run the z loop because the decomposition is in xy */
+            j[2] = left[2];
+            for(j[0] = left[0]; j[0] <= right[0]; j[0] ++)
+            for(j[1] = left[1]; j[1] <= right[1]; j[1] ++)
+            {
+                rank = pm_ipos_to_rank(pm, j);
+                if(LIKELY(rank == pm->ThisTask))  continue;
+                int ptr;
+                for(ptr = 0; ptr < used; ptr++) {
+                    if(rank == ranks[ptr]) break;
+                }
+                if(UNLIKELY(ptr == used)) {
+                    ranks[used++] = rank;
+                    localppd.rank = rank;
+                    localppd.reason = j;
+                    iter_func(pm, &localppd, userdata);
+                }
             }
         }
     }
@@ -82,8 +115,7 @@ pm_iter_ghosts(PM * pm, PMGhostData * pgd,
 static void
 count_ghosts(PM * pm, PMGhostData * pgd, void * userdata)
 {
-#pragma omp atomic
-    pgd->Nsend[pgd->rank] ++;
+    pgd->Nsend_chunk[pgd->ichunk * pm->NTask + pgd->rank] ++;
 }
 
 static void
@@ -91,14 +123,7 @@ build_ghost_buffer(PM * pm, PMGhostData * pgd, void * userdata)
 {
     FastPMPackingPlan * plan = userdata;
 
-
-    int ighost;
-    int offset; 
-
-#pragma omp atomic capture
-    offset = pgd->Nsend[pgd->rank] ++;
-
-    ighost = pgd->Osend[pgd->rank] + offset;
+    int ighost = pgd->Osend_chunk[pgd->ichunk * pm->NTask + pgd->rank] ++;
 
     fastpm_packing_plan_pack(plan, pgd->source, pgd->ipar, 
                 (char*) pgd->send_buffer + ighost * plan->elsize);
@@ -155,16 +180,30 @@ pm_ghosts_create_full(PM * pm, FastPMStore * p,
     pgd->Nrecv = calloc(pm->NTask, sizeof(int));
     pgd->Orecv = calloc(pm->NTask, sizeof(int));
 
+#ifdef _OPENMP
+    pgd->nchunks = omp_get_max_threads();
+#else
+    pgd->nchunks = 1;
+#endif
+    pgd->Nsend_chunk = calloc(pgd->nchunks * pm->NTask, sizeof(int));
+    pgd->Osend_chunk = NULL;
+
     size_t Nsend;
     size_t Nrecv;
 
-    memset(pgd->Nsend, 0, sizeof(pgd->Nsend[0]) * pm->NTask);
-
     pm_iter_ghosts(pm, pgd, count_ghosts, NULL);
 
+    int ichunk, rank;
+    for(rank = 0; rank < pm->NTask; rank ++) {
+        pgd->Nsend[rank] = 0;
+        for(ichunk = 0; ichunk < pgd->nchunks; ichunk ++) {
+            pgd->Nsend[rank] += pgd->Nsend_chunk[ichunk * pm->NTask + rank];
+        }
+    }
+
     Nsend = cumsum(pgd->Osend, pgd->Nsend, pm->NTask);
 
-    MPI_Alltoall(pgd->Nsend, 1, MPI_INT, pgd->Nrecv, 1, MPI_INT, pm->Comm2D);
+    MPI_Alltoall_sparse_counts(pgd->Nsend, pgd->Nrecv, pm->Comm2D);
 
     Nrecv = cumsum(pgd->Orecv, pgd->Nrecv, pm->NTask);
 
@@ -179,6 +218,11 @@ pm_ghosts_create_full(PM * pm, FastPMStore * p,
 
     pgd->ighost_to_ipar = fastpm_memory_alloc(pm->mem, "Ghost2Par", Nsend * sizeof(int), FASTPM_MEMORY_HEAP);
 
+    /* the ghosts keep the position format of the source */
+    if(p->xfix && (attributes & COLUMN_POS)) {
+        attributes |= COLUMN_POS_FIXED;
+    }
+
     pgd->p = malloc(sizeof(pgd->p[0]));
     fastpm_store_init(pgd->p, pgd->source->name, Nrecv, attributes, FASTPM_MEMORY_HEAP);
     memcpy(&pgd->p->meta, &pgd->source->meta, sizeof(pgd->source->meta));
@@ -217,11 +261,24 @@ pm_ghosts_send(PMGhostData * pgd, FastPMColumnTags attributes)
     pgd->send_buffer = fastpm_memory_alloc(pm->mem, "SendBuf", Nsend * plan->elsize, FASTPM_MEMORY_STACK);
     pgd->recv_buffer = fastpm_memory_alloc(pm->mem, "RecvBuf", Nrecv * plan->elsize, FASTPM_MEMORY_STACK);
 
-    /* build buffer */
-    memset(pgd->Nsend, 0, sizeof(pgd->Nsend[0]) * pm->NTask);
+    /* build buffer; each chunk writes after the earlier chunks, such that
+     * the ghosts are in the order of the particles for any number of threads. */
+    pgd->Osend_chunk = malloc(sizeof(int) * pgd->nchunks * pm->NTask);
+
+    int ichunk, rank;
+    for(rank = 0; rank < pm->NTask; rank ++) {
+        int offset = pgd->Osend[rank];
+        for(ichunk = 0; ichunk < pgd->nchunks; ichunk ++) {
+            pgd->Osend_chunk[ichunk * pm->NTask + rank] = offset;
+            offset += pgd->Nsend_chunk[ichunk * pm->NTask + rank];
+        }
+    }
 
     pm_iter_ghosts(pm, pgd, build_ghost_buffer, plan);
 
+    free(pgd->Osend_chunk);
+    pgd->Osend_chunk = NULL;
+
     /* exchange */
 
     pgd->p->np = Nrecv;
@@ -229,17 +286,24 @@ pm_ghosts_send(PMGhostData * pgd, FastPMColumnTags attributes)
     MPI_Datatype GHOST_TYPE;
     MPI_Type_contiguous(plan->elsize, MPI_BYTE, &GHOST_TYPE);
     MPI_Type_commit(&GHOST_TYPE);
-    MPI_Alltoallv_sparse(pgd->send_buffer, pgd->Nsend, pgd->Osend, GHOST_TYPE,
+
+    MPIAlltoallvSparse h[1];
+    MPI_Ialltoallv_sparse(pgd->send_buffer, pgd->Nsend, pgd->Osend, GHOST_TYPE,
                   pgd->recv_buffer, pgd->Nrecv, pgd->Orecv, GHOST_TYPE,
-                    pm->Comm2D);
-    MPI_Type_free(&GHOST_TYPE);
+                    pm->Comm2D, h);
 
+    /* unpack the ghosts of a rank while the others are still in flight */
+    while((rank = MPI_Alltoallv_sparse_waitany(h)) >= 0) {
 #pragma omp parallel for
-    for(i = 0; i < Nrecv; i ++) {
-        fastpm_packing_plan_unpack(plan,
-                pgd->p, i,
-                (char*) pgd->recv_buffer + i * plan->elsize);
+        for(i = pgd->Orecv[rank]; i < pgd->Orecv[rank] + pgd->Nrecv[rank]; i ++) {
+            fastpm_packing_plan_unpack(plan,
+                    pgd->p, i,
+                    (char*) pgd->recv_buffer + i * plan->elsize);
+        }
     }
+    MPI_Alltoallv_sparse_waitall(h);
+    MPI_Type_free(&GHOST_TYPE);
+
     fastpm_memory_free(pm->mem, pgd->recv_buffer);
     fastpm_memory_free(pm->mem, pgd->send_buffer);
 }
@@ -275,27 +339,35 @@ pm_ghosts_reduce(PMGhostData * pgd, FastPMColumnTags attribute,
     MPI_Datatype GHOST_TYPE;
     MPI_Type_contiguous(elsize, MPI_BYTE, &GHOST_TYPE);
     MPI_Type_commit(&GHOST_TYPE);
-    MPI_Alltoallv_sparse(pgd->recv_buffer, pgd->Nrecv, pgd->Orecv, GHOST_TYPE,
+
+    MPIAlltoallvSparse h[1];
+    MPI_Ialltoallv_sparse(pgd->recv_buffer, pgd->Nrecv, pgd->Orecv, GHOST_TYPE,
                   pgd->send_buffer, pgd->Nsend, pgd->Osend, GHOST_TYPE,
-                    pm->Comm2D);
-    MPI_Type_free(&GHOST_TYPE);
+                    pm->Comm2D, h);
 
     FastPMStore q[1];
     fastpm_store_init(q, pgd->p->name, Nsend, attribute, FASTPM_MEMORY_HEAP);
 
-    /* now reduce the attributes. */
     int ighost;
+    int rank;
+
+    /* unpack the ghosts from a rank while the others are still in flight */
+    while((rank = MPI_Alltoallv_sparse_waitany(h)) >= 0) {
+        for(ighost = pgd->Osend[rank]; ighost < pgd->Osend[rank] + pgd->Nsend[rank]; ighost ++) {
+            pgd->p->_column_info[ci].unpack(q, ighost, ci,
+                (char*) pgd->send_buffer + ighost * elsize);
+        }
+    }
+    MPI_Alltoallv_sparse_waitall(h);
+    MPI_Type_free(&GHOST_TYPE);
+
+    /* now reduce the attributes. */
 
     /* this loop is not parallel because multiple ghosts can be for the same ipar,
      * in which case we have a race condition.
      * we can fix this by carefully working with ipar (it should / could be made sorted)
      * but unlikly worth the effort.
      * */
-    for(ighost = 0; ighost < Nsend; ighost ++) {
-        pgd->p->_column_info[ci].unpack(q, ighost, ci,
-            (char*) pgd->send_buffer + ighost * elsize);
-    }
-
     for(ighost = 0; ighost < Nsend; ighost ++) {
         reduce(q, ighost, pgd->source, pgd->ighost_to_ipar[ighost],
                 ci, userdata);
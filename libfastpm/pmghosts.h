@@ -21,8 +21,12 @@ typedef struct PMGhostData {
     int * Orecv;
     void * send_buffer;
     void * recv_buffer;
+    int nchunks; /* the particles are visited in this many chunks in parallel */
+    int * Nsend_chunk; /* nchunks x NTask */
+    int * Osend_chunk;
 
     /* iterator status */
+    int ichunk;
     ptrdiff_t ipar;
     int * ighost_to_ipar;
     int rank;
@@ -1,6 +1,12 @@
 #include <string.h>
+#include <stdio.h>
+#include <unistd.h>
 #include <mpi.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include <fftw3.h>
 #include <fftw3-mpi.h>
 #include <pfft.h>
@@ -15,6 +21,10 @@ static MPI_Datatype MPI_PTRDIFF = (MPI_Datatype) 0;
 #if FASTPM_FFT_PRECISION == 64
     #define plan_dft_r2c pfft_plan_dft_r2c
     #define plan_dft_c2r pfft_plan_dft_c2r
+    #define plan_many_dft_r2c pfft_plan_many_dft_r2c
+    #define plan_many_dft_c2r pfft_plan_many_dft_c2r
+    #define plan_many_dft_r2c_fftw fftw_mpi_plan_many_dft_r2c
+    #define plan_many_dft_c2r_fftw fftw_mpi_plan_many_dft_c2r
     #define execute_dft_r2c pfft_execute_dft_r2c
     #define execute_dft_c2r pfft_execute_dft_c2r
     #define plan_dft_r2c_fftw fftw_mpi_plan_dft_r2c
@@ -25,10 +35,18 @@ static MPI_Datatype MPI_PTRDIFF = (MPI_Datatype) 0;
     #define _pfft_cleanup pfft_cleanup
     #define destroy_plan pfft_destroy_plan
     #define destroy_plan_fftw fftw_destroy_plan
+    #define import_wisdom_from_filename fftw_import_wisdom_from_filename
+    #define export_wisdom_to_filename fftw_export_wisdom_to_filename
+    #define mpi_broadcast_wisdom fftw_mpi_broadcast_wisdom
+    #define mpi_gather_wisdom fftw_mpi_gather_wisdom
 
 #elif FASTPM_FFT_PRECISION == 32
     #define plan_dft_r2c pfftf_plan_dft_r2c
     #define plan_dft_c2r pfftf_plan_dft_c2r
+    #define plan_many_dft_r2c pfftf_plan_many_dft_r2c
+    #define plan_many_dft_c2r pfftf_plan_many_dft_c2r
+    #define plan_many_dft_r2c_fftw fftwf_mpi_plan_many_dft_r2c
+    #define plan_many_dft_c2r_fftw fftwf_mpi_plan_many_dft_c2r
     #define plan_dft_r2c_fftw fftwf_mpi_plan_dft_r2c
     #define plan_dft_c2r_fftw fftwf_mpi_plan_dft_c2r
     #define execute_dft_r2c pfftf_execute_dft_r2c
@@ -39,6 +57,10 @@ static MPI_Datatype MPI_PTRDIFF = (MPI_Datatype) 0;
     #define _pfft_cleanup pfftf_cleanup
     #define destroy_plan pfftf_destroy_plan
     #define destroy_plan_fftw fftwf_destroy_plan
+    #define import_wisdom_from_filename fftwf_import_wisdom_from_filename
+    #define export_wisdom_to_filename fftwf_export_wisdom_to_filename
+    #define mpi_broadcast_wisdom fftwf_mpi_broadcast_wisdom
+    #define mpi_gather_wisdom fftwf_mpi_gather_wisdom
 #endif
 
 void
@@ -105,6 +127,68 @@ static size_t fftw_local_size_dft_r2c(int nrnk, ptrdiff_t * n, MPI_Comm comm,
     return allocsize;
 }
 
+/* The wisdom of a plan depends on the mesh, the process mesh and the threads;
+ * one file per combination, next to the prefix given in PMInit.wisdom. */
+static void
+pm_wisdom_filename(PM * pm, char * filename, size_t n)
+{
+    int nthreads = 1;
+#ifdef _OPENMP
+    nthreads = omp_get_max_threads();
+#endif
+    snprintf(filename, n, "%s-%tdx%tdx%td-%dx%d-t%d-f%d.wisdom",
+        pm->init.wisdom, pm->Nmesh[0], pm->Nmesh[1], pm->Nmesh[2],
+        pm->Nproc[0], pm->Nproc[1],
+        nthreads, FASTPM_FFT_PRECISION);
+}
+
+/* rank 0 reads the wisdom file and broadcasts the wisdom; collective.
+ * Called once in pm_init; the wisdom stays in FFTW for the plans made later
+ * by pm_plan_many. */
+static void
+pm_import_wisdom(PM * pm)
+{
+    if(!pm->init.wisdom) return;
+
+    char filename[4096];
+    pm_wisdom_filename(pm, filename, sizeof(filename));
+
+    int loaded = 0;
+    if(pm->ThisTask == 0) {
+        loaded = import_wisdom_from_filename(filename);
+    }
+    MPI_Bcast(&loaded, 1, MPI_INT, 0, pm->Comm2D);
+
+    if(loaded) {
+        mpi_broadcast_wisdom(pm->Comm2D);
+        fastpm_info("Imported FFT wisdom from %s\n", filename);
+    } else {
+        fastpm_info("No FFT wisdom in %s; measuring the plans.\n", filename);
+    }
+}
+
+/* gathers the wisdom of the new plans to rank 0, which writes the wisdom file;
+ * the file is replaced atomically in case another job is reading it. */
+static void
+pm_export_wisdom(PM * pm)
+{
+    if(!pm->init.wisdom) return;
+
+    mpi_gather_wisdom(pm->Comm2D);
+
+    if(pm->ThisTask != 0) return;
+
+    char filename[4096];
+    char tmpname[4096 + 32];
+    pm_wisdom_filename(pm, filename, sizeof(filename));
+    snprintf(tmpname, sizeof(tmpname), "%s.%d", filename, (int) getpid());
+
+    if(!export_wisdom_to_filename(tmpname) || 0 != rename(tmpname, filename)) {
+        fastpm_ilog(INFO, "Failed to write FFT wisdom to %s\n", filename);
+        unlink(tmpname);
+    }
+}
+
 void pm_init(PM * pm, PMInit * init, MPI_Comm comm) {
 
     pm->init = *init;
@@ -262,19 +346,21 @@ void pm_init(PM * pm, PMInit * init, MPI_Comm comm) {
     FastPMFloat * canvas = pm_alloc(pm);
     FastPMFloat * workspace = pm_alloc(pm);
 
+    pm_import_wisdom(pm);
+
     if(pm->init.use_fftw) {
         pm->r2c = plan_dft_r2c_fftw(
                 3, pm->Nmesh, (void*) workspace, (void*) canvas, 
                 pm->Comm2D, 
                 (pm->init.transposed?FFTW_MPI_TRANSPOSED_OUT:0)
-                | FFTW_ESTIMATE 
+                | (pm->init.wisdom?FFTW_MEASURE:FFTW_ESTIMATE)
                 | FFTW_DESTROY_INPUT
                 );
         pm->c2r = plan_dft_c2r_fftw(
                 3, pm->Nmesh, (void*) canvas, (void*) canvas, 
                 pm->Comm2D, 
                 (pm->init.transposed?FFTW_MPI_TRANSPOSED_IN:0)
-                | FFTW_ESTIMATE 
+                | (pm->init.wisdom?FFTW_MEASURE:FFTW_ESTIMATE)
                 | FFTW_DESTROY_INPUT
                 );
     } else {
@@ -284,9 +370,8 @@ void pm_init(PM * pm, PMInit * init, MPI_Comm comm) {
                 PFFT_FORWARD, 
                 (pm->init.transposed?PFFT_TRANSPOSED_OUT:0)
                 | PFFT_PADDED_R2C 
-                | PFFT_ESTIMATE 
+                | (pm->init.wisdom?PFFT_MEASURE:PFFT_ESTIMATE)
                 | PFFT_TUNE
-                //| PFFT_MEASURE
                 | PFFT_DESTROY_INPUT
                 );
         pm->c2r = plan_dft_c2r(
@@ -295,16 +380,23 @@ void pm_init(PM * pm, PMInit * init, MPI_Comm comm) {
                 PFFT_BACKWARD, 
                 (pm->init.transposed?PFFT_TRANSPOSED_IN:0)
                 | PFFT_PADDED_C2R 
-                | PFFT_ESTIMATE 
-                //| PFFT_MEASURE
+                | (pm->init.wisdom?PFFT_MEASURE:PFFT_ESTIMATE)
                 | PFFT_TUNE
                 | PFFT_DESTROY_INPUT
                 );
     }
 
+    pm_export_wisdom(pm);
+
     pm_free(pm, workspace);
     pm_free(pm, canvas);
 
+    for(d = 0; d <= PM_MANY_MAX; d++) {
+        pm->r2c_many[d] = NULL;
+        pm->c2r_many[d] = NULL;
+        pm->allocsize_many[d] = 0;
+    }
+
     for(d = 0; d < 3; d++) {
         pm->MeshtoK[d] = malloc(pm->Nmesh[d] * sizeof(double));
         int i;
@@ -316,6 +408,7 @@ void pm_init(PM * pm, PMInit * init, MPI_Comm comm) {
             pm->MeshtoK[d][i] = ii * 2 * M_PI / pm->BoxSize[d];
         }
     }
+    pm_create_k_factors(pm, &pm->KFactors);
 }
 
 void 
@@ -329,6 +422,17 @@ pm_destroy(PM * pm)
         destroy_plan(pm->r2c);
         destroy_plan(pm->c2r);
     }
+    for(d = 0; d <= PM_MANY_MAX; d++) {
+        if(!pm->c2r_many[d]) continue;
+        if(pm->init.use_fftw) {
+            destroy_plan_fftw(pm->r2c_many[d]);
+            destroy_plan_fftw(pm->c2r_many[d]);
+        } else {
+            destroy_plan(pm->r2c_many[d]);
+            destroy_plan(pm->c2r_many[d]);
+        }
+    }
+    pm_destroy_k_factors(&pm->KFactors);
     for(d = 0; d < 3; d++) {
         free(pm->MeshtoK[d]);
     }
@@ -398,6 +502,229 @@ void pm_c2r(PM * pm, FastPMFloat * inplace) {
     VALGRIND_MAKE_MEM_DEFINED(inplace, sizeof(inplace[0]) * pm->allocsize);
 }
 
+/* plans for howmany interleaved fields; both are in-place, as the
+ * scratch buffer is the only storage for the interleaved fields. */
+static void
+pm_plan_many(PM * pm, int howmany)
+{
+    if(howmany < 1 || howmany > PM_MANY_MAX) {
+        fastpm_raise(-1, "Transforming %d fields at once is not supported; max is %d\n", howmany, PM_MANY_MAX);
+    }
+    if(pm->c2r_many[howmany]) return;
+
+    ptrdiff_t isize[3], istart[3], osize[3], ostart[3];
+
+    if(pm->init.use_fftw) {
+        ptrdiff_t n2[3] = {pm->Nmesh[0], pm->Nmesh[1], pm->Nmesh[2] / 2 + 1};
+        if(pm->init.transposed) {
+            pm->allocsize_many[howmany] = 2 * fftw_mpi_local_size_many_transposed(
+                3, n2, howmany, FFTW_MPI_DEFAULT_BLOCK, FFTW_MPI_DEFAULT_BLOCK, pm->Comm2D,
+                &isize[0], &istart[0], &osize[1], &ostart[1]);
+        } else {
+            pm->allocsize_many[howmany] = 2 * fftw_mpi_local_size_many(
+                3, n2, howmany, FFTW_MPI_DEFAULT_BLOCK, pm->Comm2D,
+                &isize[0], &istart[0]);
+        }
+    } else {
+        pm->allocsize_many[howmany] = 2 * pfft_local_size_many_dft_r2c(
+                3, pm->Nmesh, pm->Nmesh, pm->Nmesh, howmany,
+                PFFT_DEFAULT_BLOCKS, PFFT_DEFAULT_BLOCKS,
+                pm->Comm2D,
+                (pm->init.transposed?PFFT_TRANSPOSED_OUT:0)
+                | PFFT_PADDED_R2C,
+                isize, istart, osize, ostart);
+    }
+
+    FastPMFloat * workspace = fastpm_memory_alloc(pm->mem, "PMMany",
+            sizeof(FastPMFloat) * pm->allocsize_many[howmany], FASTPM_MEMORY_HEAP);
+
+    if(pm->init.use_fftw) {
+        pm->r2c_many[howmany] = plan_many_dft_r2c_fftw(
+                3, pm->Nmesh, howmany, FFTW_MPI_DEFAULT_BLOCK, FFTW_MPI_DEFAULT_BLOCK,
+                (void*) workspace, (void*) workspace,
+                pm->Comm2D,
+                (pm->init.transposed?FFTW_MPI_TRANSPOSED_OUT:0)
+                | (pm->init.wisdom?FFTW_MEASURE:FFTW_ESTIMATE)
+                | FFTW_DESTROY_INPUT
+                );
+        pm->c2r_many[howmany] = plan_many_dft_c2r_fftw(
+                3, pm->Nmesh, howmany, FFTW_MPI_DEFAULT_BLOCK, FFTW_MPI_DEFAULT_BLOCK,
+                (void*) workspace, (void*) workspace,
+                pm->Comm2D,
+                (pm->init.transposed?FFTW_MPI_TRANSPOSED_IN:0)
+                | (pm->init.wisdom?FFTW_MEASURE:FFTW_ESTIMATE)
+                | FFTW_DESTROY_INPUT
+                );
+    } else {
+        pm->r2c_many[howmany] = plan_many_dft_r2c(
+                3, pm->Nmesh, pm->Nmesh, pm->Nmesh, howmany,
+                PFFT_DEFAULT_BLOCKS, PFFT_DEFAULT_BLOCKS,
+                (void*) workspace, (void*) workspace,
+                pm->Comm2D,
+                PFFT_FORWARD,
+                (pm->init.transposed?PFFT_TRANSPOSED_OUT:0)
+                | PFFT_PADDED_R2C
+                | (pm->init.wisdom?PFFT_MEASURE:PFFT_ESTIMATE)
+                | PFFT_TUNE
+                | PFFT_DESTROY_INPUT
+                );
+        pm->c2r_many[howmany] = plan_many_dft_c2r(
+                3, pm->Nmesh, pm->Nmesh, pm->Nmesh, howmany,
+                PFFT_DEFAULT_BLOCKS, PFFT_DEFAULT_BLOCKS,
+                (void*) workspace, (void*) workspace,
+                pm->Comm2D,
+                PFFT_BACKWARD,
+                (pm->init.transposed?PFFT_TRANSPOSED_IN:0)
+                | PFFT_PADDED_C2R
+                | (pm->init.wisdom?PFFT_MEASURE:PFFT_ESTIMATE)
+                | PFFT_TUNE
+                | PFFT_DESTROY_INPUT
+                );
+    }
+
+    pm_export_wisdom(pm);
+
+    fastpm_memory_free(pm->mem, workspace);
+}
+
+/* bytes of the interleaved scratch of a batch of howmany fields; an estimate before
+ * the plan is made. */
+static size_t
+pm_many_bytes(PM * pm, int howmany)
+{
+    ptrdiff_t size = pm->c2r_many[howmany] ? pm->allocsize_many[howmany] : howmany * pm->allocsize;
+    return sizeof(FastPMFloat) * size;
+}
+
+/* fields transformed in a batch, at most howmany; limited by init.max_batched_ffts,
+ * and by the free memory for the interleaved scratch and nalloc new fields per batched field
+ * on the rank with the least free memory. Collective on the PM. */
+static int
+pm_batch_size_details(PM * pm, int howmany, int nalloc)
+{
+    int n = pm->init.max_batched_ffts;
+    if(n > howmany) n = howmany;
+    if(n > PM_MANY_MAX) n = PM_MANY_MAX;
+
+    for(; n > 1; n --) {
+        size_t need = pm_many_bytes(pm, n) + nalloc * (n - 1) * sizeof(FastPMFloat) * pm->allocsize;
+        if(need < pm->mem->free_bytes) break;
+    }
+    if(n < 1) n = 1;
+
+    /* the transforms are collective; all ranks shall plan and run the same batch */
+    MPI_Allreduce(MPI_IN_PLACE, &n, 1, MPI_INT, MPI_MIN, pm->Comm2D);
+    return n;
+}
+
+int
+pm_batch_size(PM * pm, int howmany)
+{
+    return pm_batch_size_details(pm, howmany, 1);
+}
+
+static void
+pm_r2c_batch(PM * pm, FastPMFloat * from[], FastPMFloat * to[], int howmany) {
+    pm_plan_many(pm, howmany);
+
+    FastPMFloat * buf = fastpm_memory_alloc(pm->mem, "PMMany",
+            sizeof(FastPMFloat) * pm->allocsize_many[howmany], FASTPM_MEMORY_STACK);
+
+    ptrdiff_t i;
+    int f;
+
+    /* real fields, with the padding */
+#pragma omp parallel for private(f)
+    for(i = 0; i < pm->IRegion.total; i ++) {
+        for(f = 0; f < howmany; f ++) {
+            buf[i * howmany + f] = from[f][i];
+        }
+    }
+
+    if(pm->init.use_fftw) {
+        execute_dft_r2c_fftw(pm->r2c_many[howmany], buf, (void*) buf);
+    } else {
+        execute_dft_r2c(pm->r2c_many[howmany], buf, (void*) buf);
+    }
+
+    /* complex fields */
+#pragma omp parallel for private(f)
+    for(i = 0; i < pm->ORegion.total; i ++) {
+        for(f = 0; f < howmany; f ++) {
+            to[f][2 * i + 0] = buf[2 * (i * howmany + f) + 0] * (1 / pm->Norm);
+            to[f][2 * i + 1] = buf[2 * (i * howmany + f) + 1] * (1 / pm->Norm);
+        }
+    }
+
+    fastpm_memory_free(pm->mem, buf);
+
+    for(f = 0; f < howmany; f ++) {
+        VALGRIND_MAKE_MEM_DEFINED(to[f], sizeof(to[f][0]) * pm->allocsize);
+    }
+}
+
+static void
+pm_c2r_batch(PM * pm, FastPMFloat * inplace[], int howmany) {
+    pm_plan_many(pm, howmany);
+
+    FastPMFloat * buf = fastpm_memory_alloc(pm->mem, "PMMany",
+            sizeof(FastPMFloat) * pm->allocsize_many[howmany], FASTPM_MEMORY_STACK);
+
+    ptrdiff_t i;
+    int f;
+
+#pragma omp parallel for private(f)
+    for(i = 0; i < pm->ORegion.total; i ++) {
+        for(f = 0; f < howmany; f ++) {
+            buf[2 * (i * howmany + f) + 0] = inplace[f][2 * i + 0];
+            buf[2 * (i * howmany + f) + 1] = inplace[f][2 * i + 1];
+        }
+    }
+
+    if(pm->init.use_fftw) {
+        execute_dft_c2r_fftw(pm->c2r_many[howmany], (void*) buf, buf);
+    } else {
+        execute_dft_c2r(pm->c2r_many[howmany], (void*) buf, buf);
+    }
+
+#pragma omp parallel for private(f)
+    for(i = 0; i < pm->IRegion.total; i ++) {
+        for(f = 0; f < howmany; f ++) {
+            inplace[f][i] = buf[i * howmany + f];
+        }
+    }
+
+    fastpm_memory_free(pm->mem, buf);
+
+    for(f = 0; f < howmany; f ++) {
+        VALGRIND_MAKE_MEM_DEFINED(inplace[f], sizeof(inplace[f][0]) * pm->allocsize);
+    }
+}
+
+void pm_r2c_many(PM * pm, FastPMFloat * from[], FastPMFloat * to[], int howmany) {
+    int f, n;
+    for(f = 0; f < howmany; f += n) {
+        n = pm_batch_size_details(pm, howmany - f, 0);
+        if(n == 1) {
+            pm_r2c(pm, from[f], to[f]);
+        } else {
+            pm_r2c_batch(pm, from + f, to + f, n);
+        }
+    }
+}
+
+void pm_c2r_many(PM * pm, FastPMFloat * inplace[], int howmany) {
+    int f, n;
+    for(f = 0; f < howmany; f += n) {
+        n = pm_batch_size_details(pm, howmany - f, 0);
+        if(n == 1) {
+            pm_c2r(pm, inplace[f]);
+        } else {
+            pm_c2r_batch(pm, inplace + f, n);
+        }
+    }
+}
+
 #define unravel(ind, i, d0, d1, d2, strides) \
 i[d0] = ind / strides[d0]; ind %= strides[d0]; \
 i[d1] = ind / strides[d1]; ind %= strides[d1]; \
@@ -487,17 +814,76 @@ int pm_inc_i_index(PM * pm, ptrdiff_t i[3]) {
     return rt;
 }
 
-int MPI_Alltoallv_sparse(void *sendbuf, int *sendcnts, int *sdispls,
+/* Exchanges the counts of a sparse all to all with the nonblocking consensus
+ * (NBX) of Hoefler et al.: the counts go in synchronous sends to the ranks
+ * that are sent to, and a rank enters a nonblocking barrier once all of its
+ * sends are matched; everyone is done when the barrier completes.
+ * The cost scales with the number of partners rather than NTask. */
+int MPI_Alltoall_sparse_counts(int * sendcnts, int * recvcnts, MPI_Comm comm)
+{
+    int NTask;
+    MPI_Comm_size(comm, &NTask);
+
+    MPI_Request * requests = malloc(sizeof(MPI_Request) * NTask);
+    int n_requests = 0;
+
+    int i;
+    for(i = 0; i < NTask; i ++) {
+        recvcnts[i] = 0;
+    }
+    for(i = 0; i < NTask; i ++) {
+        if(sendcnts[i] == 0) continue;
+        MPI_Issend(&sendcnts[i], 1, MPI_INT, i, 101933, comm, &requests[n_requests++]);
+    }
+
+    MPI_Request barrier;
+    int in_barrier = 0;
+    int done = 0;
+    while(!done) {
+        int flag;
+        MPI_Status status;
+        MPI_Iprobe(MPI_ANY_SOURCE, 101933, comm, &flag, &status);
+        if(flag) {
+            MPI_Recv(&recvcnts[status.MPI_SOURCE], 1, MPI_INT,
+                status.MPI_SOURCE, 101933, comm, MPI_STATUS_IGNORE);
+        }
+        if(in_barrier) {
+            MPI_Test(&barrier, &done, MPI_STATUS_IGNORE);
+        } else {
+            int sent;
+            MPI_Testall(n_requests, requests, &sent, MPI_STATUSES_IGNORE);
+            if(sent) {
+                MPI_Ibarrier(comm, &barrier);
+                in_barrier = 1;
+            }
+        }
+    }
+
+    free(requests);
+    return 0;
+}
+
+int MPI_Ialltoallv_sparse(void *sendbuf, int *sendcnts, int *sdispls,
         MPI_Datatype sendtype, void *recvbuf, int *recvcnts,
-        int *rdispls, MPI_Datatype recvtype, MPI_Comm comm) {
+        int *rdispls, MPI_Datatype recvtype, MPI_Comm comm,
+        MPIAlltoallvSparse * h) {
 
     int ThisTask;
     int NTask;
     MPI_Comm_rank(comm, &ThisTask);
     MPI_Comm_size(comm, &NTask);
 
+    h->NTask = NTask;
+    h->recvbuf = recvbuf;
+    h->recvcnts = recvcnts;
+    h->rdispls = rdispls;
+    h->next = 0;
+
+    ptrdiff_t lb;
+    MPI_Type_get_extent(recvtype, &lb, &h->recv_elsize);
+
     {
-        /* if the send is dense, use MPI_Alltoallv directly. */
+        /* if the send is dense, use MPI_Ialltoallv directly. */
         int i;
 
         size_t send_requests = 0;
@@ -510,14 +896,21 @@ int MPI_Alltoallv_sparse(void *sendbuf, int *sendcnts, int *sdispls,
         int dense = send_requests > 128;
         MPI_Allreduce(MPI_IN_PLACE, &dense, 1, MPI_INT, MPI_SUM, comm);
         /* dense is number of ranks does a lot of sends. */
-        if (dense > 0) {
-            fastpm_info("Using MPI's Alltoallv");
-            return MPI_Alltoallv(
-                sendbuf, sendcnts, sdispls, sendtype,
-                recvbuf, recvcnts, rdispls, recvtype,
-                comm);
-        } /* else */
+        h->dense = dense > 0;
+    }
+
+    if(h->dense) {
+        fastpm_info("Using MPI's Alltoallv");
+        h->requests = malloc(sizeof(MPI_Request));
+        h->peers = NULL;
+        h->n_requests = 1;
+        h->n_recv = 1;
+        return MPI_Ialltoallv(
+            sendbuf, sendcnts, sdispls, sendtype,
+            recvbuf, recvcnts, rdispls, recvtype,
+            comm, &h->requests[0]);
     }
+
     fastpm_info("Using sparse Alltoallv");
 
     int PTask;
@@ -525,34 +918,30 @@ int MPI_Alltoallv_sparse(void *sendbuf, int *sendcnts, int *sdispls,
 
     for(PTask = 0; NTask > (1 << PTask); PTask++);
 
-    ptrdiff_t lb;
     ptrdiff_t send_elsize;
-    ptrdiff_t recv_elsize;
 
     MPI_Type_get_extent(sendtype, &lb, &send_elsize);
-    MPI_Type_get_extent(recvtype, &lb, &recv_elsize);
-
-#ifndef NO_ISEND_IRECV_IN_DOMAIN
-    int n_requests;
-    MPI_Request requests[NTask * 2];
-    n_requests = 0;
 
+    h->requests = malloc(sizeof(MPI_Request) * NTask * 2);
+    h->peers = malloc(sizeof(int) * NTask * 2);
+    h->n_requests = 0;
 
+    /* the receives first, such that waitany only looks at them;
+     * no barrier: the sends to a rank that has not posted its receive yet
+     * are buffered or wait in the progress engine. */
     for(ngrp = 0; ngrp < (1 << PTask); ngrp++)
     {
         int target = ThisTask ^ ngrp;
 
         if(target >= NTask) continue;
         if(recvcnts[target] == 0) continue;
+        h->peers[h->n_requests] = target;
         MPI_Irecv(
-                ((char*) recvbuf) + recv_elsize * rdispls[target], 
+                ((char*) recvbuf) + h->recv_elsize * rdispls[target], 
                 recvcnts[target],
-                recvtype, target, 101934, comm, &requests[n_requests++]);
+                recvtype, target, 101934, comm, &h->requests[h->n_requests++]);
     }
-
-    MPI_Barrier(comm);	/* not really necessary, but this will guarantee that all receives are
-                                       posted before the sends, which helps the stability of MPI on 
-                                       bluegene, and perhaps some mpich1-clusters */
+    h->n_recv = h->n_requests;
 
     for(ngrp = 0; ngrp < (1 << PTask); ngrp++)
     {
@@ -560,46 +949,59 @@ int MPI_Alltoallv_sparse(void *sendbuf, int *sendcnts, int *sdispls,
         if(target >= NTask) continue;
         if(sendcnts[target] == 0) continue;
 
-        VALGRIND_CHECK_MEM_IS_DEFINED(sendbuf, send_elsize * sdispls[target]);
+        VALGRIND_CHECK_MEM_IS_DEFINED(((char*) sendbuf) + send_elsize * sdispls[target],
+                send_elsize * sendcnts[target]);
 
+        h->peers[h->n_requests] = target;
         MPI_Isend(((char*) sendbuf) + send_elsize * sdispls[target], 
                 sendcnts[target],
-                sendtype, target, 101934, comm, &requests[n_requests++]);
+                sendtype, target, 101934, comm, &h->requests[h->n_requests++]);
     }
 
-    MPI_Waitall(n_requests, requests, MPI_STATUSES_IGNORE);
-
-    for(ngrp = 0; ngrp < (1 << PTask); ngrp++) {
-        int target = ThisTask ^ ngrp;
-        if(target >= NTask) continue;
-        if(recvcnts[target] == 0) continue;
+    return 0;
+}
 
-        VALGRIND_MAKE_MEM_DEFINED(recvbuf, recv_elsize * rdispls[target]);
+int MPI_Alltoallv_sparse_waitany(MPIAlltoallvSparse * h)
+{
+    if(h->dense) {
+        /* everything arrives at once; then hand out the ranks one by one. */
+        if(h->n_recv) {
+            MPI_Wait(&h->requests[0], MPI_STATUS_IGNORE);
+            h->n_recv = 0;
+        }
+        while(h->next < h->NTask && h->recvcnts[h->next] == 0) h->next ++;
+        if(h->next == h->NTask) return -1;
+        return h->next ++;
     }
-#else
-    for(ngrp = 0; ngrp < (1 << PTask); ngrp++)
-    {
-        int target = ThisTask ^ ngrp;
 
-        if(target >= NTask) continue;
-        if(sendcnts[target] == 0 && recvcnts[target] == 0) continue;
+    int index;
+    MPI_Waitany(h->n_recv, h->requests, &index, MPI_STATUS_IGNORE);
+    if(index == MPI_UNDEFINED) return -1;
 
-        VALGRIND_CHECK_MEM_IS_DEFINED(sendbuf, send_elsize * sdispls[target]);
+    int rank = h->peers[index];
+    VALGRIND_MAKE_MEM_DEFINED(((char*) h->recvbuf) + h->recv_elsize * h->rdispls[rank],
+            h->recv_elsize * h->recvcnts[rank]);
+    return rank;
+}
 
-        MPI_Sendrecv(((char*)sendbuf) + send_elsize * sdispls[target], 
-                sendcnts[target], sendtype, 
-                target, 101934,
-                ((char*)recvbuf) + recv_elsize * rdispls[target],
-                recvcnts[target], recvtype, 
-                target, 101934, 
-                comm, MPI_STATUS_IGNORE);
+void MPI_Alltoallv_sparse_waitall(MPIAlltoallvSparse * h)
+{
+    while(MPI_Alltoallv_sparse_waitany(h) >= 0) continue;
 
-        VALGRIND_MAKE_MEM_DEFINED(recvbuf, recv_elsize * rdispls[target]);
-    }
-#endif
-    /* ensure the collective-ness */
-    MPI_Barrier(comm);
+    MPI_Waitall(h->n_requests, h->requests, MPI_STATUSES_IGNORE);
+
+    free(h->peers);
+    free(h->requests);
+}
 
+int MPI_Alltoallv_sparse(void *sendbuf, int *sendcnts, int *sdispls,
+        MPI_Datatype sendtype, void *recvbuf, int *recvcnts,
+        int *rdispls, MPI_Datatype recvtype, MPI_Comm comm) {
+
+    MPIAlltoallvSparse h[1];
+    MPI_Ialltoallv_sparse(sendbuf, sendcnts, sdispls, sendtype,
+            recvbuf, recvcnts, rdispls, recvtype, comm, h);
+    MPI_Alltoallv_sparse_waitall(h);
     return 0;
-} 
+}
 
@@ -26,12 +26,21 @@
 #define UNLIKELY(x) __builtin_expect(!!(x), 0)
 #endif
 
+/* max number of interleaved fields in pm_r2c_many / pm_c2r_many */
+#define PM_MANY_MAX 6
+
 typedef struct {
     ptrdiff_t Nmesh;
     double BoxSize;
     int NprocY;
     int transposed;
     int use_fftw;
+    /* prefix of the FFTW wisdom files. If not NULL, the plans are measured,
+     * and the wisdom is kept for later runs; see pm_import_wisdom. */
+    const char * wisdom;
+    /* max number of fields in a batch of pm_r2c_many / pm_c2r_many;
+     * 0 or 1 transforms the fields one by one. */
+    int max_batched_ffts;
 } PMInit;
 
 typedef struct {
@@ -49,6 +58,12 @@ struct PM {
     void * r2c;   /* Forward r2c plan */
     void * c2r;   /* Bacward c2r plan */
 
+    /* in-place plans for howmany interleaved fields, indexed by howmany;
+     * created on first use. */
+    void * r2c_many[PM_MANY_MAX + 1];
+    void * c2r_many[PM_MANY_MAX + 1];
+    ptrdiff_t allocsize_many[PM_MANY_MAX + 1];
+
     int Nproc[2];
     MPI_Comm Comm2D;
 
@@ -61,6 +76,8 @@ struct PM {
 
     PMGrid Grid;
     double * MeshtoK[3];
+    /* the per-axis k tables, built once and shared by every PMKIter */
+    PMKIter KFactors;
     double Norm;
     double Volume;
     double CellSize[3];
@@ -75,6 +92,12 @@ pm_module_init();
 void
 pm_module_cleanup();
 
+void
+pm_create_k_factors(PM * pm, PMKIter * iter);
+
+void
+pm_destroy_k_factors(PMKIter * iter);
+
 /* Initializing a PM object. */
 void 
 pm_init(PM * pm, PMInit * init, MPI_Comm comm);
@@ -96,6 +119,37 @@ int MPI_Alltoallv_sparse(void *sendbuf, int *sendcnts, int *sdispls,
         MPI_Datatype sendtype, void *recvbuf, int *recvcnts,
         int *rdispls, MPI_Datatype recvtype, MPI_Comm comm);
 
+/* exchanges the counts of a sparse all to all, replacing MPI_Alltoall of the counts. */
+int MPI_Alltoall_sparse_counts(int * sendcnts, int * recvcnts, MPI_Comm comm);
+
+/* A sparse all to all in flight. The buffers and the count arrays
+ * must stay alive until MPI_Alltoallv_sparse_waitall. */
+typedef struct {
+    int NTask;
+    int dense; /* a single MPI_Ialltoallv request */
+    int n_requests;
+    int n_recv; /* the first n_recv requests are the receives */
+    MPI_Request * requests;
+    int * peers; /* rank of each request */
+    int next;
+
+    void * recvbuf;
+    int * recvcnts;
+    int * rdispls;
+    ptrdiff_t recv_elsize;
+} MPIAlltoallvSparse;
+
+int MPI_Ialltoallv_sparse(void *sendbuf, int *sendcnts, int *sdispls,
+        MPI_Datatype sendtype, void *recvbuf, int *recvcnts,
+        int *rdispls, MPI_Datatype recvtype, MPI_Comm comm,
+        MPIAlltoallvSparse * h);
+
+/* waits for the items from any rank; returns the rank, or -1 if all have arrived. */
+int MPI_Alltoallv_sparse_waitany(MPIAlltoallvSparse * h);
+
+/* waits for all receives and sends, and releases the handle. */
+void MPI_Alltoallv_sparse_waitall(MPIAlltoallvSparse * h);
+
 static inline size_t cumsum(int * out, int * in, size_t nitems) {
     size_t total = 0;
     int i;
@@ -113,9 +113,12 @@ fastpm_png_transform_potential(PM * pm, FastPMFloat * delta_k, FastPMPNGaussian
     pm_c2r(pm, g_x);
 
     /* The second order, NG piece must be truncated to avoid Dirac folding. */
-    pm_assign(pm, delta_k, g_x2);
     /* MS: Zero-pad/truncate high k to avoid spurious Dirac delta images. */
-    fastpm_apply_lowpass_transfer(pm, g_x2, g_x2, png->kmax_primordial);
+    FastPMTransferChain chain[1];
+    fastpm_transfer_chain_init(chain, pm);
+    fastpm_transfer_chain_add_lowpass(chain, png->kmax_primordial);
+    fastpm_transfer_chain_apply(chain, delta_k, g_x2);
+    fastpm_transfer_chain_destroy(chain);
     pm_c2r(pm, g_x2);
 
     ptrdiff_t i;
@@ -18,6 +18,10 @@ struct FastPMClock {
 
 static FastPMClock * head = NULL;
 
+/* clocks of a thread that is not profiled, e.g. an IO thread; never in the list */
+static __thread int thread_unprofiled = 0;
+static __thread FastPMClock thread_clock;
+
 FastPMClock * 
 fastpm_clock_create(const char * file, const char * func, const char * name) 
 {
@@ -36,6 +40,9 @@ FastPMClock *
 fastpm_clock_find(const char * file, const char * func, const char * name) 
 {
     FastPMClock * p;
+    if(thread_unprofiled) {
+        return &thread_clock;
+    }
     if(head == NULL) {
         goto notfound;
     }
@@ -53,6 +60,12 @@ notfound:
     return p;
 }
 
+void
+fastpm_clock_skip_thread()
+{
+    thread_unprofiled = 1;
+}
+
 void fastpm_clock_in(FastPMClock * clock) 
 {
     clock->t0 = MPI_Wtime();
@@ -121,12 +121,29 @@ fastpm_rfof_execute(FastPMRFOFFinder * finder,
         ihalo[j] = -1;
     }
 
+    /* The particles left active after a bin are whole groups of the bin, so with
+     * decreasing linking lengths the groups of all bins nest, and come from one
+     * walk of a single kdtree. */
+    double lls[6];
     for(i = 1; i <= 6; i ++) {
-        double ll = _fastpm_rfof_get_linkinglength(finder, i, z);
+        lls[i - 1] = _fastpm_rfof_get_linkinglength(finder, i, z);
+    }
+    ptrdiff_t ** linked = fastpm_fof_link_hierarchy(&fof, 6, lls);
+    if(!linked) {
+        fastpm_info("RFOF: linking lengths are not decreasing; running FOF for each bin.");
+    }
+
+    for(i = 1; i <= 6; i ++) {
+        double ll = lls[i - 1];
         fastpm_info("RFOF: FOF with linking length %g (Mpc/h), bin = %d, z= %0.3f, Np=%d", ll, i, z, finder->priv->Np[i]);
 
         fastpm_store_set_name(candidates, "candidates");
-        ptrdiff_t * icandidate = fastpm_fof_execute(&fof, ll, candidates, active);
+        ptrdiff_t * icandidate;
+        if(linked) {
+            icandidate = fastpm_fof_execute_linked(&fof, linked[i - 1], candidates, active);
+        } else {
+            icandidate = fastpm_fof_execute(&fof, ll, candidates, active);
+        }
 
         FastPMParticleMaskType * save_mask = fastpm_memory_alloc(finder->p->mem,
                         "SaveMask",
@@ -179,6 +196,9 @@ fastpm_rfof_execute(FastPMRFOFFinder * finder,
         fastpm_memory_free(halos->mem, icandidate);
         fastpm_store_destroy(candidates);
     }
+    if(linked) {
+        fastpm_fof_free_hierarchy(&fof, 6, linked);
+    }
     fastpm_memory_free(finder->p->mem, active);
     fastpm_fof_destroy(&fof);
 
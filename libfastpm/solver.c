@@ -73,6 +73,8 @@ void fastpm_solver_init(FastPMSolver * fastpm,
             .NprocY = config->NprocY, /* 0 for auto, 1 for slabs */
             .transposed = 1,
             .use_fftw = config->UseFFTW,
+            .wisdom = config->fft_wisdom,
+            .max_batched_ffts = config->max_batched_ffts,
         };
 
     fastpm->comm = comm;
@@ -88,13 +90,20 @@ void fastpm_solver_init(FastPMSolver * fastpm,
 
     memset(fastpm->has_species, 0, FASTPM_SOLVER_NSPECIES);
 
+    /* with kick_in_readout the forces are only kept when an interpolation needs them;
+     * see fastpm_do_force. */
+    FastPMColumnTags acc = config->kick_in_readout ? 0 : COLUMN_ACC;
+
     fastpm_store_init_evenly(fastpm->cdm,
           fastpm_species_get_name(FASTPM_SPECIES_CDM),
           pow(1.0 * config->nc, 3),
-          COLUMN_POS | COLUMN_VEL | COLUMN_ID | COLUMN_MASK | COLUMN_RAND | COLUMN_ACC | config->ExtraAttributes,
+          COLUMN_POS | COLUMN_VEL | COLUMN_ID | COLUMN_MASK | COLUMN_RAND | acc | config->ExtraAttributes,
           config->alloc_factor,
           comm);
 
+    double BoxSize[3] = {config->boxsize, config->boxsize, config->boxsize};
+    fastpm_store_set_boxsize(fastpm->cdm, BoxSize);
+
     fastpm_solver_add_species(fastpm, FASTPM_SPECIES_CDM, fastpm->cdm);   //add CDM [why make np_total a double?]
 
     fastpm->vpm_list = vpm_create(config->vpminit,
@@ -106,6 +115,8 @@ void fastpm_solver_init(FastPMSolver * fastpm,
             .NprocY = config->NprocY, /* 0 for auto, 1 for slabs */
             .transposed = 0, /* use untransposed to make sure we see all kz on a rank; this speeds up IC */
             .use_fftw = config->UseFFTW,
+            .wisdom = config->fft_wisdom,
+            .max_batched_ffts = config->max_batched_ffts,
         };
 
     fastpm->basepm = malloc(sizeof(PM));
@@ -126,6 +137,8 @@ void fastpm_solver_init(FastPMSolver * fastpm,
             .NprocY = config->NprocY, /* 0 for auto, 1 for slabs */
             .transposed = 0, /* use untransposed to make sure we see all kz on a rank; this speeds up IC */
             .use_fftw = config->UseFFTW,
+            .wisdom = config->fft_wisdom,
+            .max_batched_ffts = config->max_batched_ffts,
         };
 
     fastpm->lptpm = malloc(sizeof(PM));
@@ -238,8 +251,20 @@ static void
 fastpm_do_kick(FastPMSolver * fastpm, FastPMTransition * trans);
 static void
 fastpm_do_drift(FastPMSolver * fastpm, FastPMTransition * trans);
+static int
+fastpm_can_fuse_kick_drift(FastPMSolver * fastpm, FastPMTransition * trans, FastPMTransition * next);
+static void
+fastpm_do_kick_drift(FastPMSolver * fastpm, FastPMTransition * ktrans, FastPMTransition * dtrans);
 static void
 fastpm_do_force(FastPMSolver * fastpm, FastPMTransition * trans);
+static int
+fastpm_find_readout_kick(FastPMSolver * fastpm, FastPMTransition * trans, double * ai, double * af);
+static void
+fastpm_alloc_acc(FastPMSolver * fastpm);
+static void
+fastpm_free_acc(FastPMSolver * fastpm);
+static int
+fastpm_kicked_in_readout(FastPMSolver * fastpm, FastPMStore * p, FastPMTransition * trans);
 
 static void
 fastpm_do_interpolation(FastPMSolver * fastpm,
@@ -297,22 +322,33 @@ fastpm_solver_evolve(FastPMSolver * fastpm, double * time_step, int nstep)
 
     fastpm_tevo_generate_states(states, nstep-1, template, time_step);
 
-    FastPMTransition transition[1];
+    FastPMTransition transition[2];
 
     /* The last step is the 'terminal' step */
     int i;
     for(i = 1; states->table[i].force != -1; i ++) {
-        fastpm_tevo_transition_init(transition, states, i - 1, i);
+        fastpm_tevo_transition_init(&transition[0], states, i - 1, i);
+
+        /* a kick and the following drift are done in one pass over the
+         * particles if no interpolation is needed in between; the
+         * transition events of both are emitted around the pass. */
+        int fused = fastpm_can_fuse_kick_drift(fastpm, &transition[0], &transition[1]);
 
-        FastPMTransitionEvent event[1];
-        event->transition = transition;
+        FastPMTransitionEvent event[2];
+        int j;
 
         CLOCK(beforetransit);
         ENTER(beforetransit);
-        fastpm_emit_event(fastpm->event_handlers, FASTPM_EVENT_TRANSITION,
-                FASTPM_EVENT_STAGE_BEFORE, (FastPMEvent*) event, fastpm);
+        for(j = 0; j <= fused; j ++) {
+            event[j].transition = &transition[j];
+            fastpm_emit_event(fastpm->event_handlers, FASTPM_EVENT_TRANSITION,
+                    FASTPM_EVENT_STAGE_BEFORE, (FastPMEvent*) &event[j], fastpm);
+        }
         LEAVE(beforetransit);
 
+        if(fused) {
+            fastpm_do_kick_drift(fastpm, &transition[0], &transition[1]);
+        } else
         switch(transition->action) {
             case FASTPM_ACTION_KICK:
                 fastpm_do_kick(fastpm, transition);
@@ -327,8 +363,10 @@ fastpm_solver_evolve(FastPMSolver * fastpm, double * time_step, int nstep)
 
         CLOCK(aftertransit);
         ENTER(aftertransit);
-        fastpm_emit_event(fastpm->event_handlers, FASTPM_EVENT_TRANSITION,
-                FASTPM_EVENT_STAGE_AFTER, (FastPMEvent*) event, fastpm);
+        for(j = 0; j <= fused; j ++) {
+            fastpm_emit_event(fastpm->event_handlers, FASTPM_EVENT_TRANSITION,
+                    FASTPM_EVENT_STAGE_AFTER, (FastPMEvent*) &event[j], fastpm);
+        }
         LEAVE(aftertransit);
 
         if(i == 1) {
@@ -343,6 +381,7 @@ fastpm_solver_evolve(FastPMSolver * fastpm, double * time_step, int nstep)
             fastpm_do_interpolation(fastpm, &drift, &kick, a0, a0, TIMESTEP_START);
 
         }
+        i += fused;
     }
     /* special interpolation event for the end of the simulation. */
     double a1 = time_step[nstep - 1];
@@ -351,6 +390,9 @@ fastpm_solver_evolve(FastPMSolver * fastpm, double * time_step, int nstep)
     fastpm_kick_init(&kick, fastpm, a1, a1, a1);
     fastpm_drift_init(&drift, fastpm, a1, a1, a1);
     fastpm_do_interpolation(fastpm, &drift, &kick, a1, a1, TIMESTEP_END);
+    if(fastpm->config->kick_in_readout) {
+        fastpm_free_acc(fastpm);
+    }
     fastpm_tevo_destroy_states(states);
     free(states);
 }
@@ -388,7 +430,12 @@ fastpm_do_warmup(FastPMSolver * fastpm, double a0)
         FastPMStore * p = fastpm_solver_get_species(fastpm, si);
         if(!p) continue;
         /* set acc to zero or we see valgrind errors */
-        memset(p->acc, 0, sizeof(p->acc[0]) * p->np);
+        if(p->acc)
+            memset(p->acc, 0, sizeof(p->acc[0]) * p->np);
+
+        /* the initial positions may be outside of the box; afterwards the
+         * drifts keep them wrapped. */
+        fastpm_store_wrap(p, fastpm->basepm->BoxSize);
     }
     LEAVE(warmup);
 }
@@ -422,6 +469,7 @@ fastpm_do_force(FastPMSolver * fastpm, FastPMTransition * trans)
     int64_t N = p->np;
 
     fastpm_painter_init(painter, pm, fastpm->config->PAINTER_TYPE, fastpm->config->painter_support);
+    painter->tiled = fastpm->config->painter_tiled;
 
     MPI_Allreduce(MPI_IN_PLACE, &N, 1, MPI_LONG, MPI_SUM, fastpm->comm);
 
@@ -445,14 +493,43 @@ fastpm_do_force(FastPMSolver * fastpm, FastPMTransition * trans)
         event->a_n = next->a.f;
     }
 
+    /* the forces of the last step are no longer used; do not exchange them. */
+    if(fastpm->config->kick_in_readout) {
+        fastpm_free_acc(fastpm);
+    }
+
     ENTER(decompose);
     fastpm_decompose(fastpm, pm);
     LEAVE(decompose);
 
+    double kick_ai = 0, kick_af = 0;
+    int kick_in_readout = 0;
+    if(fastpm->config->kick_in_readout) {
+        kick_in_readout = fastpm_find_readout_kick(fastpm, trans, &kick_ai, &kick_af);
+        if(!kick_in_readout) {
+            fastpm_alloc_acc(fastpm);
+        }
+    }
+
     fastpm_emit_event(fastpm->event_handlers, FASTPM_EVENT_FORCE, FASTPM_EVENT_STAGE_BEFORE, (FastPMEvent*) event, fastpm);
 
     ENTER(force);
-    fastpm_solver_compute_force(fastpm, pm, painter, fastpm->config->SOFTENING_TYPE, fastpm->config->KERNEL_TYPE, delta_k, trans->a.f);
+    if(kick_in_readout) {
+        FastPMKickFactor kick;
+        fastpm_kick_init(&kick, fastpm, kick_ai, trans->a.f, kick_af);
+
+        int si;
+        for(si = 0; si < FASTPM_SOLVER_NSPECIES; si++) {
+            FastPMStore * q = fastpm_solver_get_species(fastpm, si);
+            if(!q) continue;
+            if(kick.ai != q->meta.a_v) {
+                fastpm_raise(-1, "kick is inconsitant with state.\n");
+            }
+        }
+        fastpm_solver_compute_force_kick(fastpm, pm, painter, fastpm->config->SOFTENING_TYPE, fastpm->config->KERNEL_TYPE, fastpm->config->GRADIENT_TYPE, delta_k, trans->a.f, &kick, kick_af);
+    } else {
+        fastpm_solver_compute_force(fastpm, pm, painter, fastpm->config->SOFTENING_TYPE, fastpm->config->KERNEL_TYPE, fastpm->config->GRADIENT_TYPE, delta_k, trans->a.f);
+    }
     LEAVE(force);
 
     if(p->pgdc) {
@@ -477,6 +554,95 @@ fastpm_do_force(FastPMSolver * fastpm, FastPMTransition * trans)
 
 }
 
+/* Can the kicks using the force of trans be done by the readout of the force?
+ * They shall be consecutive, and no interpolation shall want the forces: the
+ * interpolations up to the next force use them. Returns the number of kicks,
+ * from ai to af. */
+static int
+fastpm_find_readout_kick(FastPMSolver * fastpm, FastPMTransition * trans, double * ai, double * af)
+{
+    FastPMStates * states = trans->states;
+
+    int nhandlers = fastpm_count_event_handlers(fastpm->event_handlers,
+            FASTPM_EVENT_INTERPOLATION, FASTPM_EVENT_STAGE_BEFORE);
+
+    /* the interpolation of the initial state is after the first force. */
+    if(trans->istart == 0 && nhandlers > 0) return 0;
+
+    int nkicks = 0;
+    int drifted = 0;
+    int i;
+    for(i = trans->iend; states->table[i + 1].force != -1; i ++) {
+        FastPMTransition next[1];
+        fastpm_tevo_transition_init(next, states, i, i + 1);
+
+        if(next->action == FASTPM_ACTION_FORCE) break;
+
+        if(next->action == FASTPM_ACTION_DRIFT) drifted = 1;
+
+        if(next->action == FASTPM_ACTION_KICK) {
+            /* a drift in between would use the kicked velocity */
+            if(drifted) return 0;
+            if(nkicks == 0) *ai = next->a.i;
+            *af = next->a.f;
+            nkicks ++;
+        }
+
+        if(next->end->v != next->end->x || nhandlers == 0) continue;
+
+        FastPMInterpolationQueryEvent event[1];
+        event->a1 = next->a.i;
+        event->a2 = next->a.f;
+        event->nanswers = 0;
+        event->wanted = 0;
+
+        fastpm_emit_event(fastpm->event_handlers,
+                FASTPM_EVENT_INTERPOLATION_QUERY, FASTPM_EVENT_STAGE_BEFORE,
+                (FastPMEvent*) event, fastpm);
+
+        if(event->nanswers != nhandlers || event->wanted) return 0;
+    }
+    return nkicks;
+}
+
+/* a temporary ACC column for a force that cannot be read out into the kicks */
+static void
+fastpm_alloc_acc(FastPMSolver * fastpm)
+{
+    int si;
+    for(si = 0; si < FASTPM_SOLVER_NSPECIES; si++) {
+        FastPMStore * p = fastpm_solver_get_species(fastpm, si);
+        if(!p) continue;
+        p->acc = fastpm_memory_alloc(p->mem, "ACC", sizeof(p->acc[0]) * p->np_upper, FASTPM_MEMORY_FLOATING);
+        p->attributes |= COLUMN_ACC;
+    }
+}
+
+static void
+fastpm_free_acc(FastPMSolver * fastpm)
+{
+    int si;
+    for(si = FASTPM_SOLVER_NSPECIES - 1; si >= 0; si--) {
+        FastPMStore * p = fastpm_solver_get_species(fastpm, si);
+        if(!p || !p->acc) continue;
+        fastpm_memory_free(p->mem, p->acc);
+        p->acc = NULL;
+        p->attributes &= ~COLUMN_ACC;
+    }
+}
+
+/* has the kick of trans been done by the readout of the force? */
+static int
+fastpm_kicked_in_readout(FastPMSolver * fastpm, FastPMStore * p, FastPMTransition * trans)
+{
+    if(!fastpm->config->kick_in_readout) return 0;
+    if(p->meta.a_v == trans->a.i) return 0;
+    if(p->meta.a_v < trans->a.f) {
+        fastpm_raise(-1, "kick is inconsitant with state.\n");
+    }
+    return 1;
+}
+
 static void
 fastpm_do_kick(FastPMSolver * fastpm, FastPMTransition * trans)
 {
@@ -505,6 +671,8 @@ fastpm_do_kick(FastPMSolver * fastpm, FastPMTransition * trans)
         FastPMStore * p = fastpm_solver_get_species(fastpm, si);
         if(!p) continue;
 
+        if(fastpm_kicked_in_readout(fastpm, p, trans)) continue;
+
         if(kick.ai != p->meta.a_v) {
             fastpm_raise(-1, "kick is inconsitant with state.\n");
         }
@@ -549,11 +717,89 @@ fastpm_do_drift(FastPMSolver * fastpm, FastPMTransition * trans)
         if(drift.ac != p->meta.a_v) {
             fastpm_raise(-1, "drift is inconsitant with state.\n");
         }
-        fastpm_drift_store(&drift, p, p, trans->a.f);
+        fastpm_drift_store(&drift, p, p, trans->a.f, fastpm->basepm->BoxSize);
         LEAVE(drift);
     }
 }
 
+/* Is trans a kick that can be fused with the next transition, a drift?
+ * The drift shall need no interpolation, or no handler shall want it. */
+static int
+fastpm_can_fuse_kick_drift(FastPMSolver * fastpm, FastPMTransition * trans, FastPMTransition * next)
+{
+    FastPMStates * states = trans->states;
+
+    if(trans->action != FASTPM_ACTION_KICK) return 0;
+    /* the interpolation of the kick is before the kick; keep it simple. */
+    if(trans->end->v == trans->end->x) return 0;
+    if(states->table[trans->iend + 1].force == -1) return 0;
+
+    fastpm_tevo_transition_init(next, states, trans->iend, trans->iend + 1);
+    if(next->action != FASTPM_ACTION_DRIFT) return 0;
+
+    if(next->end->v != next->end->x) return 1;
+
+    int nhandlers = fastpm_count_event_handlers(fastpm->event_handlers,
+            FASTPM_EVENT_INTERPOLATION, FASTPM_EVENT_STAGE_BEFORE);
+
+    if(nhandlers == 0) return 1;
+
+    FastPMInterpolationQueryEvent event[1];
+    event->a1 = next->a.i;
+    event->a2 = next->a.f;
+    event->nanswers = 0;
+    event->wanted = 0;
+
+    fastpm_emit_event(fastpm->event_handlers,
+            FASTPM_EVENT_INTERPOLATION_QUERY, FASTPM_EVENT_STAGE_BEFORE,
+            (FastPMEvent*) event, fastpm);
+
+    return event->nanswers == nhandlers && !event->wanted;
+}
+
+static void
+fastpm_do_kick_drift(FastPMSolver * fastpm, FastPMTransition * ktrans, FastPMTransition * dtrans)
+{
+    CLOCK(kickdrift);
+
+    FastPMKickFactor kick;
+    FastPMDriftFactor drift;
+    fastpm_kick_init(&kick, fastpm, ktrans->a.i, ktrans->a.r, ktrans->a.f);
+    fastpm_drift_init(&drift, fastpm, dtrans->a.i, dtrans->a.r, dtrans->a.f);
+
+    ENTER(kickdrift);
+    int si;
+    for(si = 0; si < FASTPM_SOLVER_NSPECIES; si++) {
+        FastPMStore * p = fastpm_solver_get_species(fastpm, si);
+        if(!p) continue;
+
+        if(fastpm_kicked_in_readout(fastpm, p, ktrans)) {
+            if(drift.ai != p->meta.a_x || drift.ac != p->meta.a_v) {
+                fastpm_raise(-1, "drift is inconsitant with state.\n");
+            }
+            fastpm_drift_store(&drift, p, p, dtrans->a.f, fastpm->basepm->BoxSize);
+            continue;
+        }
+
+        if(kick.ai != p->meta.a_v) {
+            fastpm_raise(-1, "kick is inconsitant with state.\n");
+        }
+        if(kick.ac != p->meta.a_x) {
+            fastpm_raise(-1, "kick is inconsitant with state.\n");
+        }
+        /* the drift starts after the kick */
+        if(drift.ai != p->meta.a_x) {
+            fastpm_raise(-1, "drift is inconsitant with state.\n");
+        }
+        if(drift.ac != ktrans->a.f) {
+            fastpm_raise(-1, "drift is inconsitant with state.\n");
+        }
+        fastpm_kick_drift_store(&kick, &drift, p, p, ktrans->a.f, dtrans->a.f,
+                fastpm->basepm->BoxSize);
+    }
+    LEAVE(kickdrift);
+}
+
 void
 fastpm_solver_destroy(FastPMSolver * fastpm)
 {
@@ -579,15 +825,18 @@ fastpm_decompose(FastPMSolver * fastpm, PM * pm) {
         FastPMStore * p = fastpm_solver_get_species(fastpm, si);
         if(!p) continue;
 
-        /* apply periodic boundary and move particles to the correct rank */
-        fastpm_store_wrap(p, pm->BoxSize);
-
+        /* move particles to the correct rank; the periodic boundary is
+         * applied by the drift. */
         if(0 != fastpm_store_decompose(p,
                 (fastpm_store_target_func) FastPMTargetPM, pm,
                 fastpm->comm))
         {
             fastpm_raise(-1, "Out of particle storage space\n");
         }
+
+        if(fastpm->config->sort_particles) {
+            fastpm_store_sort_morton(p, pm);
+        }
     }
 }
 
@@ -666,7 +915,9 @@ fastpm_set_species_snapshot(FastPMSolver * fastpm,
 
     if(drift) {
         /* update position; before kick to use the old velocity */
-        fastpm_drift_store(drift, p, po, aout);
+        fastpm_drift_store(drift, p, po, aout, pm->BoxSize);
+    } else {
+        fastpm_store_wrap(po, pm->BoxSize);
     }
 
     if(kick) {
@@ -698,7 +949,6 @@ fastpm_set_species_snapshot(FastPMSolver * fastpm,
             }
         }
     }
-    fastpm_store_wrap(po, pm->BoxSize);
 }
 
 /* revert the effect of a snapshot on fastpm->species, and destroy po */
@@ -746,13 +996,13 @@ fastpm_unset_species_snapshot(FastPMSolver * fastpm,
     }
     if(drift) {
         /* revert position */
-        fastpm_drift_store(drift, po, po, p->meta.a_x);
+        fastpm_drift_store(drift, po, po, p->meta.a_x, pm->BoxSize);
+    } else {
+        fastpm_store_wrap(po, pm->BoxSize);
     }
     /* steal back columns */
     fastpm_store_steal(po, p, p->attributes);
 
-    fastpm_store_wrap(p, pm->BoxSize);
-
     /* Stop faking the attributes */
     po->attributes = 0;
 
@@ -1,6 +1,9 @@
 #include <string.h>
 
 #include <mpi.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include <pfft.h>
 #include <gsl/gsl_rng.h>
 
@@ -103,13 +106,57 @@ fastpm_species_get_name(enum FastPMSpecies species)
     }
     return "UNKNOWN";
 }
+/* one box in units of the fixed point positions */
+#define XFIX_ONE 4294967296.0
+
+static double
+to_double_xfix (FastPMStore * p, ptrdiff_t index, int ci, int memb)
+{
+    size_t nmemb = p->_column_info[ci].nmemb ;
+    if(memb > nmemb) {
+        fastpm_raise(-1, "memb %d greater than nmemb %d", memb, nmemb);
+    }
+    return p->xfix[index][memb] * (p->meta._x_boxsize[memb] / XFIX_ONE);
+}
+
 void fastpm_store_get_position(FastPMStore * p, ptrdiff_t index, double pos[3])
 {
+    if(p->xfix) {
+        int d;
+        for(d = 0; d < 3; d ++) {
+            pos[d] = p->xfix[index][d] * (p->meta._x_boxsize[d] / XFIX_ONE);
+        }
+        return;
+    }
     pos[0] = p->x[index][0];
     pos[1] = p->x[index][1];
     pos[2] = p->x[index][2];
 }
 
+void fastpm_store_set_position(FastPMStore * p, ptrdiff_t index, const double pos[3])
+{
+    if(p->xfix) {
+        int d;
+        for(d = 0; d < 3; d ++) {
+            /* the conversion to unsigned wraps the position into the box */
+            double u = floor(pos[d] * (XFIX_ONE / p->meta._x_boxsize[d]) + 0.5);
+            p->xfix[index][d] = (uint32_t) (int64_t) u;
+        }
+        return;
+    }
+    p->x[index][0] = pos[0];
+    p->x[index][1] = pos[1];
+    p->x[index][2] = pos[2];
+}
+
+void fastpm_store_set_boxsize(FastPMStore * p, const double BoxSize[3])
+{
+    int d;
+    for(d = 0; d < 3; d ++) {
+        p->meta._x_boxsize[d] = BoxSize[d];
+    }
+}
+
 void fastpm_store_get_lagrangian_position(FastPMStore * p, ptrdiff_t index, double pos[3])
 {
     pos[0] = p->q[index][0];
@@ -151,6 +198,10 @@ fastpm_store_init_details(FastPMStore * p,
         strcpy(p->name, name);
     }
 
+    /* the fixed point positions replace the double positions */
+    if(attributes & COLUMN_POS_FIXED) {
+        attributes &= ~COLUMN_POS;
+    }
     p->attributes = attributes;
 
     p->np = 0;
@@ -208,8 +259,10 @@ fastpm_store_init_details(FastPMStore * p,
     DEFINE_COLUMN(mass, COLUMN_MASS, "f4", 1);
     DEFINE_COLUMN(rand, COLUMN_RAND, "f4", 1);
     DEFINE_COLUMN(rmom, COLUMN_RMOM, "f4", 1);
+    DEFINE_COLUMN(xfix, COLUMN_POS_FIXED, "u4", 3);
 
     COLUMN_INFO(x).to_double = to_double_f8;
+    COLUMN_INFO(xfix).to_double = to_double_xfix;
     COLUMN_INFO(v).to_double = to_double_f4;
     COLUMN_INFO(rho).to_double = to_double_f4;
     COLUMN_INFO(dx1).to_double = to_double_f4;
@@ -248,10 +301,22 @@ fastpm_store_init_details(FastPMStore * p,
         }
         if(it == 0) {
             p->_base = fastpm_memory_alloc_details(p->mem, "FastPMStore", size, loc, file, line);
-            /* zero out all memory */
-            memset(p->_base, 0, size);
         }
     };
+
+    /* zero out all columns with the static schedule of the particle loops; the first touch
+     * places the pages of every column near the threads that use them. */
+    int ci;
+    for(ci = 0; ci < 32; ci ++) {
+        if(!p->columns[ci]) continue;
+        char * column = p->columns[ci];
+        size_t elsize = p->_column_info[ci].elsize;
+        ptrdiff_t i;
+#pragma omp parallel for schedule(static)
+        for(i = 0; i < np_upper; i ++) {
+            memset(column + i * elsize, 0, elsize);
+        }
+    }
 }
 
 void
@@ -298,9 +363,21 @@ fastpm_store_get_mask_sum(FastPMStore * p, MPI_Comm comm)
     return np;
 }
 
+/* COLUMN_POS refers to the fixed point positions if the store has them. */
+static FastPMColumnTags
+_fastpm_store_resolve_attributes(FastPMStore * p, FastPMColumnTags attributes)
+{
+    if(p->xfix && (attributes & COLUMN_POS)) {
+        attributes = (attributes & ~COLUMN_POS) | COLUMN_POS_FIXED;
+    }
+    return attributes;
+}
+
 void
 fastpm_packing_plan_init(FastPMPackingPlan * plan, FastPMStore * p, FastPMColumnTags attributes)
 {
+    attributes = _fastpm_store_resolve_attributes(p, attributes);
+
     int ci;
     int i = 0;
     plan->elsize = 0;
@@ -361,6 +438,8 @@ fastpm_packing_plan_unpack_ci(FastPMPackingPlan * plan, int ci,
 int
 fastpm_store_find_column_id(FastPMStore * p, FastPMColumnTags attribute)
 {
+    attribute = _fastpm_store_resolve_attributes(p, attribute);
+
     int ci;
     for (ci = 0; ci < 32; ci ++) {
         if (p->_column_info[ci].attribute == attribute) {
@@ -377,12 +456,13 @@ fastpm_store_destroy(FastPMStore * p)
     fastpm_memory_free(p->mem, p->_base);
 }
 
-static void permute(void * data, int np, size_t elsize, int * ind) {
+static void gather(void * data, int np, size_t elsize, int * ind) {
     void * tmp = malloc(elsize * np);
     if(!tmp) {
         fastpm_raise(-1, "No memory for permuting\n");
     }
     int i;
+#pragma omp parallel for
     for(i = 0; i < np; i ++) {
         memcpy(((char*) tmp) + i * elsize, ((char*) data) + ind[i] * elsize, elsize);
     }
@@ -390,13 +470,77 @@ static void permute(void * data, int np, size_t elsize, int * ind) {
     free(tmp);
 }
 
+/* OUT[i] = IN[ind[i]] through a scratch copy; ind may repeat items, e.g. to replicate them. */
+void fastpm_store_gather(FastPMStore * p, int * ind)
+{
+    int c;
+    for(c = 0; c < 32; c ++) {
+        if(!p->columns[c]) continue;
+        gather(p->columns[c], p->np, p->_column_info[c].elsize, ind);
+    }
+}
+
+/* permute the columns in place: OUT[i] = IN[ind[i]]; ind must be a permutation,
+ * use fastpm_store_gather otherwise.
+ *
+ * The cycles of ind are found once and shared by all columns; different cycles and
+ * columns are moved by different threads. */
 void fastpm_store_permute(FastPMStore * p, int * ind)
 {
+    int np = p->np;
+    uint8_t * done = calloc(np / 8 + 1, 1);
+    int * leaders = fastpm_memory_alloc(p->mem, "CycleLeaders", sizeof(int) * (np + 1), FASTPM_MEMORY_HEAP);
+    int nleaders = 0;
+
+    int i;
+    for(i = 0; i < np; i ++) {
+        if(done[i >> 3] & (1 << (i & 7))) continue;
+        done[i >> 3] |= 1 << (i & 7);
+        /* a ring of length 1 does not move */
+        if(ind[i] == i) continue;
+
+        leaders[nleaders++] = i;
+        int j;
+        for(j = ind[i]; j != i; j = ind[j]) {
+            if(j >= np || j < 0) {
+                fastpm_raise(-1, "Permutation index %d out of range %d\n", j, np);
+            }
+            /* in a permutation every item is on exactly one cycle */
+            if(done[j >> 3] & (1 << (j & 7))) {
+                fastpm_raise(-1, "Index %d is reached twice; not a permutation\n", j);
+            }
+            done[j >> 3] |= 1 << (j & 7);
+        }
+    }
+    free(done);
+
+    int columns[32];
+    int ncolumns = 0;
     int c;
     for(c = 0; c < 32; c ++) {
         if(!p->columns[c]) continue;
-        permute(p->columns[c], p->np, p->_column_info[c].elsize, ind);
+        columns[ncolumns++] = c;
     }
+
+    int t;
+#pragma omp parallel for collapse(2) schedule(dynamic, 16)
+    for(t = 0; t < ncolumns; t ++) {
+        for(i = 0; i < nleaders; i ++) {
+            size_t elsize = p->_column_info[columns[t]].elsize;
+            char * q = p->columns[columns[t]];
+            char tmp[elsize];
+            int head = leaders[i];
+            int ii = head;
+            int j;
+            memcpy(tmp, q + head * elsize, elsize);
+            for(j = ind[ii]; j != head; ii = j, j = ind[j]) {
+                memcpy(q + ii * elsize, q + j * elsize, elsize);
+            }
+            memcpy(q + ii * elsize, tmp, elsize);
+        }
+    }
+
+    fastpm_memory_free(p->mem, leaders);
 }
 
 
@@ -443,34 +587,44 @@ fastpm_store_sort(FastPMStore * p,
     fastpm_memory_free(p->mem, arg);
 }
 
-void 
-fastpm_store_wrap(FastPMStore * p, double BoxSize[3])
+void
+fastpm_store_wrap_one(FastPMStore * p, ptrdiff_t i, double BoxSize[3])
 {
-    int i;
+    /* fixed point positions are always in the box */
+    if(p->xfix) return;
+
     int d;
-    for(i = 0; i < p->np; i ++) {
-        for(d = 0; d < 3; d ++) {
-            double n = abs(p->x[i][d] / BoxSize[d]);
+    for(d = 0; d < 3; d ++) {
+        double n = abs(p->x[i][d] / BoxSize[d]);
 
-            double x1 = remainder(p->x[i][d], BoxSize[d]);
+        double x1 = remainder(p->x[i][d], BoxSize[d]);
 
-            while(x1 < 0) x1 += BoxSize[d];
-            while(x1 > BoxSize[d]) x1 -= BoxSize[d];
-            p->x[i][d] = x1;
+        while(x1 < 0) x1 += BoxSize[d];
+        while(x1 > BoxSize[d]) x1 -= BoxSize[d];
+        p->x[i][d] = x1;
 
-            if(n > 10000) {
-                double q[3] = {0, 0, 0};
-                if(fastpm_store_has_q(p)) {
-                    fastpm_store_get_q_from_id(p, p->id[i], q);
-                }
-                fastpm_raise(-1, "Particle at %g %g %g (q = %g %g %g) is too far from the bounds. Wrapping failed.\n", 
-                        p->x[i][0],
-                        p->x[i][1],
-                        p->x[i][2],
-                        q[0], q[1], q[2]
-                );
+        if(n > 10000) {
+            double q[3] = {0, 0, 0};
+            if(fastpm_store_has_q(p)) {
+                fastpm_store_get_q_from_id(p, p->id[i], q);
             }
+            fastpm_raise(-1, "Particle at %g %g %g (q = %g %g %g) is too far from the bounds. Wrapping failed.\n", 
+                    p->x[i][0],
+                    p->x[i][1],
+                    p->x[i][2],
+                    q[0], q[1], q[2]
+            );
         }
+    }
+}
+
+void 
+fastpm_store_wrap(FastPMStore * p, double BoxSize[3])
+{
+    ptrdiff_t i;
+#pragma omp parallel for
+    for(i = 0; i < p->np; i ++) {
+        fastpm_store_wrap_one(p, i, BoxSize);
     } 
 }
 
@@ -482,6 +636,157 @@ FastPMTargetPM (FastPMStore * p, ptrdiff_t i, PM * pm)
     return pm_pos_to_rank(pm, pos);
 }
 
+/* spread the lower 21 bits of x to every third bit */
+static uint64_t
+_morton_spread(uint64_t x)
+{
+    x &= 0x1fffff;
+    x = (x | x << 32) & 0x1f00000000ffffULL;
+    x = (x | x << 16) & 0x1f0000ff0000ffULL;
+    x = (x | x << 8) & 0x100f00f00f00f00fULL;
+    x = (x | x << 4) & 0x10c30c30c30c30c3ULL;
+    x = (x | x << 2) & 0x1249249249249249ULL;
+    return x;
+}
+
+struct morton_key {
+    uint64_t key;
+    int ind;
+};
+
+/* stable LSD radix sort of n keys on the lowest nbits bits, 8 bits per pass,
+ * as the counting sort of the tiled painter. tmp holds n keys. */
+static void
+_radix_sort_morton(struct morton_key * keys, struct morton_key * tmp, ptrdiff_t n, int nbits)
+{
+#ifdef _OPENMP
+    size_t * count = malloc(sizeof(count[0]) * omp_get_max_threads() * 256);
+#else
+    size_t * count = malloc(sizeof(count[0]) * 256);
+#endif
+    struct morton_key * from = keys;
+    struct morton_key * to = tmp;
+    int shift;
+
+    for(shift = 0; shift < nbits; shift += 8) {
+#pragma omp parallel
+        {
+#ifdef _OPENMP
+            const int nth = omp_get_num_threads();
+            const int ith = omp_get_thread_num();
+#else
+            const int nth = 1;
+            const int ith = 0;
+#endif
+            size_t * mycount = count + ith * 256;
+            ptrdiff_t i;
+            int r;
+
+            for(r = 0; r < 256; r ++) {
+                mycount[r] = 0;
+            }
+
+#pragma omp for schedule(static)
+            for(i = 0; i < n; i ++) {
+                mycount[(from[i].key >> shift) & 255] ++;
+            }
+
+#pragma omp single
+            {
+                size_t offset = 0;
+                int j;
+                for(r = 0; r < 256; r ++) {
+                    for(j = 0; j < nth; j ++) {
+                        size_t c = count[j * 256 + r];
+                        count[j * 256 + r] = offset;
+                        offset += c;
+                    }
+                }
+            }
+
+#pragma omp for schedule(static)
+            for(i = 0; i < n; i ++) {
+                to[mycount[(from[i].key >> shift) & 255] ++] = from[i];
+            }
+        }
+        struct morton_key * t = from;
+        from = to;
+        to = t;
+    }
+    if(from != keys) {
+        memcpy(keys, from, sizeof(keys[0]) * n);
+    }
+    free(count);
+}
+
+/* sort the particles locally by the Morton key of the mesh cell containing them,
+ * such that painting and readout walk the mesh in a cache friendly order.
+ *
+ * Particles move little in a step, so the store is usually still sorted after the
+ * exchange except for the newly received particles at the end; only the particles
+ * after the sorted prefix are sorted, then merged into the prefix. Nothing is
+ * permuted if the order is unchanged. */
+void
+fastpm_store_sort_morton(FastPMStore * p, PM * pm)
+{
+    struct morton_key * keys = fastpm_memory_alloc(p->mem, "MortonKey", sizeof(keys[0]) * p->np, FASTPM_MEMORY_HEAP);
+
+    /* bits of the key in use */
+    int nbits = 0;
+    int d;
+    for(d = 0; d < 3; d ++) {
+        int b = 0;
+        while(b < 21 && (((ptrdiff_t) 1) << b) < pm->Nmesh[d]) b ++;
+        if(3 * b > nbits) nbits = 3 * b;
+    }
+
+    ptrdiff_t i;
+#pragma omp parallel for
+    for(i = 0; i < p->np; i ++) {
+        double pos[3];
+        fastpm_store_get_position(p, i, pos);
+        uint64_t key = 0;
+        int d;
+        for(d = 0; d < 3; d ++) {
+            ptrdiff_t ipos = floor(pos[d] * pm->InvCellSize[d]);
+            ipos %= pm->Nmesh[d];
+            if(ipos < 0) ipos += pm->Nmesh[d];
+            key |= _morton_spread(ipos) << (2 - d);
+        }
+        keys[i].key = key;
+        keys[i].ind = i;
+    }
+
+    /* length of the sorted prefix */
+    ptrdiff_t m = 1;
+    while(m < p->np && keys[m].key >= keys[m - 1].key) m ++;
+
+    if(m < p->np) {
+        ptrdiff_t ntail = p->np - m;
+        struct morton_key * tmp = fastpm_memory_alloc(p->mem, "MortonTmp", sizeof(tmp[0]) * ntail, FASTPM_MEMORY_HEAP);
+        _radix_sort_morton(keys + m, tmp, ntail, nbits);
+        fastpm_memory_free(p->mem, tmp);
+
+        /* merge the sorted prefix and the sorted tail; prefix first among equal keys */
+        int * arg = fastpm_memory_alloc(p->mem, "PermArg", sizeof(int) * p->np, FASTPM_MEMORY_HEAP);
+        ptrdiff_t a = 0, b = m, j = 0;
+        while(a < m && b < p->np) {
+            if(keys[b].key < keys[a].key) {
+                arg[j++] = keys[b++].ind;
+            } else {
+                arg[j++] = keys[a++].ind;
+            }
+        }
+        while(a < m) arg[j++] = keys[a++].ind;
+        while(b < p->np) arg[j++] = keys[b++].ind;
+
+        fastpm_store_permute(p, arg);
+        fastpm_memory_free(p->mem, arg);
+    }
+
+    fastpm_memory_free(p->mem, keys);
+}
+
 int
 fastpm_store_decompose(FastPMStore * p,
     fastpm_store_target_func target_func,
@@ -489,7 +794,8 @@ fastpm_store_decompose(FastPMStore * p,
 {
     if(fastpm_store_get_np_total(p, comm) == 0) return 0 ;
 
-    VALGRIND_CHECK_MEM_IS_DEFINED(p->x, sizeof(p->x[0]) * p->np);
+    if(p->x)
+        VALGRIND_CHECK_MEM_IS_DEFINED(p->x, sizeof(p->x[0]) * p->np);
 
     FastPMPackingPlan plan[1];
 
@@ -510,7 +816,6 @@ fastpm_store_decompose(FastPMStore * p,
 
     /* do a bincount; offset by -1 because -1 is for self */
     int * count = calloc(NTask + 1, sizeof(int));
-    int * offsets = calloc(NTask + 1, sizeof(int));
     int * sendcount = count + 1;
     int * recvcount = malloc(sizeof(int) * (NTask));
     int * recvoffset = malloc(sizeof(int) * (NTask));
@@ -522,54 +827,112 @@ fastpm_store_decompose(FastPMStore * p,
     while(1) {
         incomplete = 0;
         int * target = fastpm_memory_alloc(p->mem, "Target", sizeof(int) * p->np, FASTPM_MEMORY_HEAP);
+        int * arg = fastpm_memory_alloc(p->mem, "PermArg", sizeof(int) * p->np, FASTPM_MEMORY_HEAP);
 
-        size_t Nsend_all = 0;
         ptrdiff_t i;
-        for(i = 0; i < p->np; i ++) {
-            target[i] = target_func(p, i, data);
-            if(ThisTask == target[i]) {
-                target[i] = -1;
-            } else {
-                Nsend_all++;
-                /* Throttling: never send more than this many particles. */
-                if(Nsend_all >= Nsend_limit) {
-                    incomplete = 1;
-                    target[i] = -1;
-                } else {
-                }
-            }
-        }
-
         for(i = 0; i < NTask + 1; i ++) {
             count[i] = 0;
-            offsets[i] = 0;
         }
         for(i = 0; i < NTask; i ++) {
             sendoffset[i] = 0;
             recvoffset[i] = 0;
         }
 
-        for(i = 0; i < p->np; i ++) {
-            sendcount[target[i]] ++;
+        size_t Nsend_all = 0;
+
+        /* a counting sort by target; the throttling below drops the same
+         * particles as a serial pass would. */
+#ifdef _OPENMP
+        int nth_max = omp_get_max_threads();
+#else
+        int nth_max = 1;
+#endif
+        size_t * nsend_thread = calloc(nth_max + 1, sizeof(size_t));
+        int * count_thread = calloc((size_t) nth_max * (NTask + 1), sizeof(int));
+
+#pragma omp parallel
+        {
+#ifdef _OPENMP
+            const int nth = omp_get_num_threads();
+            const int ith = omp_get_thread_num();
+#else
+            const int nth = 1;
+            const int ith = 0;
+#endif
+            int * mycount = count_thread + (size_t) ith * (NTask + 1);
+            ptrdiff_t i;
+
+#pragma omp for schedule(static)
+            for(i = 0; i < p->np; i ++) {
+                target[i] = target_func(p, i, data);
+                if(ThisTask == target[i]) {
+                    target[i] = -1;
+                } else {
+                    nsend_thread[ith + 1] ++;
+                }
+            }
+
+#pragma omp single
+            {
+                int j;
+                for(j = 0; j < nth; j ++) {
+                    nsend_thread[j + 1] += nsend_thread[j];
+                }
+                Nsend_all = nsend_thread[nth];
+            }
+
+            /* Throttling: never send more than this many particles. */
+            size_t nsend = nsend_thread[ith];
+#pragma omp for schedule(static)
+            for(i = 0; i < p->np; i ++) {
+                if(target[i] == -1) continue;
+                nsend ++;
+                if(nsend >= Nsend_limit) {
+                    target[i] = -1;
+                }
+            }
+
+#pragma omp for schedule(static)
+            for(i = 0; i < p->np; i ++) {
+                mycount[target[i] + 1] ++;
+            }
+
+#pragma omp single
+            {
+                int t, j;
+                int offset = 0;
+                for(t = 0; t < NTask + 1; t ++) {
+                    for(j = 0; j < nth; j ++) {
+                        int c = count_thread[(size_t) j * (NTask + 1) + t];
+                        count_thread[(size_t) j * (NTask + 1) + t] = offset;
+                        offset += c;
+                        count[t] += c;
+                    }
+                }
+            }
+
+#pragma omp for schedule(static)
+            for(i = 0; i < p->np; i ++) {
+                arg[mycount[target[i] + 1] ++] = i;
+            }
         }
-        cumsum(offsets, count, NTask + 1);
 
-        int * arg = fastpm_memory_alloc(p->mem, "PermArg", sizeof(int) * p->np, FASTPM_MEMORY_HEAP);
-        for(i = 0; i < p->np; i ++) {
-            int offset = offsets[target[i] + 1] ++;
-            arg[offset] = i;
+        if(Nsend_all >= Nsend_limit) {
+            incomplete = 1;
         }
 
+        free(count_thread);
+        free(nsend_thread);
+
         fastpm_store_permute(p, arg);
 
-        VALGRIND_CHECK_MEM_IS_DEFINED(p->x, sizeof(p->x[0]) * p->np);
+        if(p->x)
+            VALGRIND_CHECK_MEM_IS_DEFINED(p->x, sizeof(p->x[0]) * p->np);
 
         fastpm_memory_free(p->mem, arg);
         fastpm_memory_free(p->mem, target);
 
-        MPI_Alltoall(sendcount, 1, MPI_INT, 
-                     recvcount, 1, MPI_INT, 
-                     comm);
+        MPI_Alltoall_sparse_counts(sendcount, recvcount, comm);
 
         size_t Nsend = cumsum(sendoffset, sendcount, NTask);
         size_t Nrecv = cumsum(recvoffset, recvcount, NTask);
@@ -586,8 +949,21 @@ fastpm_store_decompose(FastPMStore * p,
 
         p->np -= Nsend;
 
-        void * send_buffer = fastpm_memory_alloc(p->mem, "SendBuf", elsize * Nsend, FASTPM_MEMORY_HEAP);
-        void * recv_buffer = fastpm_memory_alloc(p->mem, "RecvBuf", elsize * Nrecv, FASTPM_MEMORY_HEAP);
+        /* the sent particles are at the end of the columns, ordered by task;
+         * receive after them if there is room, otherwise into a scratch buffer. */
+        int inplace = p->np + Nsend + Nrecv <= p->np_upper;
+
+        size_t maxelsize = 0;
+        int t;
+        for(t = 0; t < plan->Ncolumns; t ++) {
+            size_t colsize = p->_column_info[plan->_ci[t]].elsize;
+            if(colsize > maxelsize) maxelsize = colsize;
+        }
+
+        void * recv_buffer = NULL;
+        if(!inplace) {
+            recv_buffer = fastpm_memory_alloc(p->mem, "RecvBuf", maxelsize * Nrecv, FASTPM_MEMORY_HEAP);
+        }
 
         {
             double nmin, nmax, nmean, nstd;
@@ -598,41 +974,56 @@ fastpm_store_decompose(FastPMStore * p,
             fastpm_info("Recv buffer size : min=%g max=%g mean=%g, std=%g bytes", nmin, nmax, nmean, nstd);
         }
 
-        int ipar = 0;
-        int j;
-        for(i = 0; i < NTask; i ++) {
-            for(j = sendoffset[i]; j < sendoffset[i] + sendcount[i]; j ++, ipar++) {
-                fastpm_packing_plan_pack(plan, p, j + p->np, (char*) send_buffer + ipar * elsize);
-            }
-        }
-
         size_t Nsendsum;
         size_t Nsendallsum;
         MPI_Allreduce(&Nsend, &Nsendsum, 1, MPI_LONG, MPI_SUM, comm);
         MPI_Allreduce(&Nsend_all, &Nsendallsum, 1, MPI_LONG, MPI_SUM, comm);
         fastpm_info("Decomposition iter %d,  exchange of %td particles; need %td", iter, Nsendsum, Nsendallsum);
 
-        MPI_Datatype PTYPE;
-        MPI_Type_contiguous(elsize, MPI_BYTE, &PTYPE);
-        MPI_Type_commit(&PTYPE);
-
-        MPI_Alltoallv_sparse(
-                send_buffer, sendcount, sendoffset, PTYPE,
-                recv_buffer, recvcount, recvoffset, PTYPE,
-                comm);
-
-        MPI_Type_free(&PTYPE);
-
-        ipar = 0;
-        for(i = 0; i < NTask; i ++) {
-            for(j = recvoffset[i]; j < recvoffset[i] + recvcount[i]; j++, ipar ++) {
-                fastpm_packing_plan_unpack(plan, p, j + p->np, (char*) recv_buffer + ipar * elsize);
+        /* exchange column by column straight from the columns; when receiving
+         * in place every column has its own room, and all of them are in flight at once. */
+        MPIAlltoallvSparse h[plan->Ncolumns];
+        MPI_Datatype PTYPE[plan->Ncolumns];
+        int t0 = 0;
+        for(t = 0; t < plan->Ncolumns; t ++) {
+            int ci = plan->_ci[t];
+            size_t colsize = p->_column_info[ci].elsize;
+            char * base = p->columns[ci];
+            char * send = base + p->np * colsize;
+            char * recv = inplace ? base + (p->np + Nsend) * colsize : recv_buffer;
+
+            MPI_Type_contiguous(colsize, MPI_BYTE, &PTYPE[t]);
+            MPI_Type_commit(&PTYPE[t]);
+
+            MPI_Ialltoallv_sparse(
+                    send, sendcount, sendoffset, PTYPE[t],
+                    recv, recvcount, recvoffset, PTYPE[t],
+                    comm, &h[t]);
+
+            if(inplace && t + 1 < plan->Ncolumns) continue;
+
+            for(; t0 <= t; t0 ++) {
+                ci = plan->_ci[t0];
+                colsize = p->_column_info[ci].elsize;
+                base = p->columns[ci];
+                send = base + p->np * colsize;
+
+                MPI_Alltoallv_sparse_waitall(&h[t0]);
+                MPI_Type_free(&PTYPE[t0]);
+
+                if(inplace) {
+                    /* slide the received ones into the hole of the sent particles, in order;
+                     * the order must not depend on whether there was room to receive in place. */
+                    memmove(send, base + (p->np + Nsend) * colsize, Nrecv * colsize);
+                } else {
+                    memcpy(send, recv_buffer, Nrecv * colsize);
+                }
             }
         }
 
-
-        fastpm_memory_free(p->mem, recv_buffer);
-        fastpm_memory_free(p->mem, send_buffer);
+        if(recv_buffer) {
+            fastpm_memory_free(p->mem, recv_buffer);
+        }
 
         p->np += Nrecv;
         iter++;
@@ -642,7 +1033,6 @@ fastpm_store_decompose(FastPMStore * p,
     free(recvcount);
     free(recvoffset);
     free(sendoffset);
-    free(offsets);
     free(count);
 
     return 0;
@@ -651,7 +1041,6 @@ fastpm_store_decompose(FastPMStore * p,
         free(recvcount);
         free(recvoffset);
         free(sendoffset);
-        free(offsets);
         free(count);
     return -1;
 }
@@ -747,6 +1136,7 @@ fastpm_store_fill(FastPMStore * p, PM * pm, double * shift, ptrdiff_t * Nc)
 
         p->meta._q_scale[d] = pm->BoxSize[d] / Nc[d];
     }
+    fastpm_store_set_boxsize(p, pm->BoxSize);
 
     p->meta._q_size = Nc[0] * Nc[1] * Nc[2];
     p->meta._q_strides[0] = Nc[1] * Nc[2];
@@ -781,12 +1171,14 @@ fastpm_store_fill(FastPMStore * p, PM * pm, double * shift, ptrdiff_t * Nc)
             if(p->rand) p->rand[ptr] = 0.;
             if(p->rmom) p->rmom[ptr] = 0.;
 
-            fastpm_store_get_q_from_id(p, id, &p->x[ptr][0]);
+            double q[3];
+            fastpm_store_get_q_from_id(p, id, q);
+            fastpm_store_set_position(p, ptr, q);
 
             if(p->q) {
                 /* set q if it is allocated. */
                 for(d = 0; d < 3; d ++) {
-                    p->q[ptr][d] = p->x[ptr][d];
+                    p->q[ptr][d] = q[d];
                 }
             }
             ptr ++;
@@ -445,12 +445,15 @@ fastpm_split_ncdm(FastPMncdmInitData * nid,
             dest->id[r] = s * src->meta._q_size + src->id[i];
             dest->mass[r] = nid->mass[s] * M0;    // ensures sum over split gives M0
 
+            double x[3];
+            fastpm_store_get_position(dest, r, x);
             for(d = 0; d < 3; d ++){
                 vthm = nid->vel[s][d];
                 dest->v[r][d] = vthm;
-                dest->x[r][d] += vthm * disp_factor;
+                x[d] += vthm * disp_factor;
                 if (dest->q) dest->q[r][d] += vthm * disp_factor;
             }
+            fastpm_store_set_position(dest, r, x);
             r ++;
         }
     }
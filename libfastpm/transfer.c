@@ -7,61 +7,21 @@
 void
 fastpm_apply_smoothing_transfer(PM * pm, FastPMFloat * from, FastPMFloat * to, double sml)
 {
-
-#pragma omp parallel
-    {
-        PMKIter kiter;
-        pm_kiter_init(pm, &kiter);
-        int d;
-        int i;
-        double *kernel[3];
-        for(d = 0; d < 3; d ++) {
-            kernel[d] = malloc(sizeof(double) * pm->Nmesh[d]);
-            for(i = 0; i < pm->Nmesh[d]; i ++) {
-                double kk = kiter.kk[d][i];
-                kernel[d][i] = exp(- 0.5 * kk * sml * sml);
-            }
-        }
-        for(;
-            !pm_kiter_stop(&kiter);
-            pm_kiter_next(&kiter)) {
-            int dir;
-            double smth = 1.0;
-            for(dir = 0; dir < 3; dir++)
-                smth *= kernel[dir][kiter.iabs[dir]];
-
-            to[kiter.ind + 0] = from[kiter.ind + 0] * smth;
-            to[kiter.ind + 1] = from[kiter.ind + 1] * smth;
-        }
-        for(d = 0; d < 3; d ++) {
-            free(kernel[d]);
-        }
-    }
+    FastPMTransferChain chain[1];
+    fastpm_transfer_chain_init(chain, pm);
+    fastpm_transfer_chain_add_smoothing(chain, sml);
+    fastpm_transfer_chain_apply(chain, from, to);
+    fastpm_transfer_chain_destroy(chain);
 }
 
 void
 fastpm_apply_lowpass_transfer(PM * pm, FastPMFloat * from, FastPMFloat * to, double kth)
 {
-    double kth2 = kth * kth;
-#pragma omp parallel 
-    {
-        PMKIter kiter;
-        pm_kiter_init(pm, &kiter);
-        for(;
-            !pm_kiter_stop(&kiter);
-            pm_kiter_next(&kiter)) {
-            int dir;
-            double smth = 1.0;
-            double kk = 0;
-            for(dir = 0; dir < 3; dir++) {
-                kk += kiter.kk[dir][kiter.iabs[dir]];
-            }
-            if(kk < kth2) smth = 1;
-            else smth = 0;
-            to[kiter.ind + 0] = from[kiter.ind + 0] * smth;
-            to[kiter.ind + 1] = from[kiter.ind + 1] * smth;
-        }
-    }
+    FastPMTransferChain chain[1];
+    fastpm_transfer_chain_init(chain, pm);
+    fastpm_transfer_chain_add_lowpass(chain, kth);
+    fastpm_transfer_chain_apply(chain, from, to);
+    fastpm_transfer_chain_destroy(chain);
 }
 
 static double sinc_unnormed(double x) {
@@ -77,39 +37,11 @@ static double sinc_unnormed(double x) {
 void 
 fastpm_apply_decic_transfer(PM * pm, FastPMFloat * from, FastPMFloat * to) 
 {
-
-#pragma omp parallel 
-    {
-        PMKIter kiter;
-        pm_kiter_init(pm, &kiter);
-        int d;
-        int i;
-        double *kernel[3];
-        for(d = 0; d < 3; d ++) {
-            kernel[d] = malloc(sizeof(double) * pm->Nmesh[d]);
-            for(i = 0; i < pm->Nmesh[d]; i ++) {
-                double w = kiter.k[d][i] * pm->BoxSize[d] / pm->Nmesh[d];
-                double cic = sinc_unnormed(0.5 * w);
-                /* Watchout: this does divide by sinc, not sinc 2, */
-                kernel[d][i] = 1.0 / pow(cic, 2);
-            }
-        }
-        for(;
-            !pm_kiter_stop(&kiter);
-            pm_kiter_next(&kiter)) {
-            int dir;
-            double smth = 1.0;
-            for(dir = 0; dir < 3; dir++) 
-                smth *= kernel[dir][kiter.iabs[dir]];
-
-            /* - i k[d] */
-            to[kiter.ind + 0] = from[kiter.ind + 0] * smth;
-            to[kiter.ind + 1] = from[kiter.ind + 1] * smth;
-        }
-        for(d = 0; d < 3; d ++) {
-            free(kernel[d]);
-        }
-    }
+    FastPMTransferChain chain[1];
+    fastpm_transfer_chain_init(chain, pm);
+    fastpm_transfer_chain_add_decic(chain);
+    fastpm_transfer_chain_apply(chain, from, to);
+    fastpm_transfer_chain_destroy(chain);
 }
 
 void
@@ -209,6 +141,16 @@ fastpm_apply_any_transfer(PM * pm, FastPMFloat * from, FastPMFloat * to, fastpm_
     }
 }
 
+void
+fastpm_apply_radial_transfer(PM * pm, FastPMFloat * from, FastPMFloat * to, fastpm_fkfunc func, void * data)
+{
+    FastPMTransferChain chain[1];
+    fastpm_transfer_chain_init(chain, pm);
+    fastpm_transfer_chain_add_radial(chain, func, data);
+    fastpm_transfer_chain_apply(chain, from, to);
+    fastpm_transfer_chain_destroy(chain);
+}
+
 void
 fastpm_apply_multiply_transfer(PM * pm, FastPMFloat * from, FastPMFloat * to, double value)
 {
@@ -362,3 +304,278 @@ fastpm_apply_get_mode_transfer(PM * pm, FastPMFloat * from, ptrdiff_t * mode)
     return result;
 }
 
+
+void
+fastpm_transfer_chain_init(FastPMTransferChain * chain, PM * pm)
+{
+    chain->pm = pm;
+    chain->scale = 1.0;
+    chain->nimag = 0;
+    chain->zero_selfconj = 0;
+    chain->nlaplace = 0;
+    chain->lowpass_kk = INFINITY;
+    chain->nfunc = 0;
+    chain->radial = NULL;
+    chain->radial_start = 0;
+    chain->radial_size = 0;
+
+    int d;
+    ptrdiff_t i;
+    for(d = 0; d < 3; d ++) {
+        chain->kernel[d] = malloc(sizeof(double) * pm->Nmesh[d]);
+        for(i = 0; i < pm->Nmesh[d]; i ++) {
+            chain->kernel[d][i] = 1.0;
+        }
+    }
+}
+
+void
+fastpm_transfer_chain_destroy(FastPMTransferChain * chain)
+{
+    int d;
+    for(d = 0; d < 3; d ++) {
+        free(chain->kernel[d]);
+    }
+    if(chain->radial) {
+        free(chain->radial);
+    }
+}
+
+void
+fastpm_transfer_chain_add_multiply(FastPMTransferChain * chain, double value)
+{
+    chain->scale *= value;
+}
+
+void
+fastpm_transfer_chain_add_decic(FastPMTransferChain * chain)
+{
+    PM * pm = chain->pm;
+    int d;
+    ptrdiff_t i;
+    for(d = 0; d < 3; d ++) {
+        for(i = 0; i < pm->Nmesh[d]; i ++) {
+            double w = pm->KFactors.k[d][i] * pm->BoxSize[d] / pm->Nmesh[d];
+            double cic = sinc_unnormed(0.5 * w);
+            /* Watchout: this does divide by sinc, not sinc 2, */
+            chain->kernel[d][i] *= 1.0 / pow(cic, 2);
+        }
+    }
+}
+
+void
+fastpm_transfer_chain_add_smoothing(FastPMTransferChain * chain, double sml)
+{
+    PM * pm = chain->pm;
+    int d;
+    ptrdiff_t i;
+    for(d = 0; d < 3; d ++) {
+        for(i = 0; i < pm->Nmesh[d]; i ++) {
+            double kk = pm->KFactors.kk[d][i];
+            chain->kernel[d][i] *= exp(- 0.5 * kk * sml * sml);
+        }
+    }
+}
+
+void
+fastpm_transfer_chain_add_lowpass(FastPMTransferChain * chain, double kth)
+{
+    if(kth * kth < chain->lowpass_kk) {
+        chain->lowpass_kk = kth * kth;
+    }
+}
+
+void
+fastpm_transfer_chain_add_laplace(FastPMTransferChain * chain, int order)
+{
+    if(chain->nlaplace == FASTPM_TRANSFER_CHAIN_MAX) {
+        fastpm_raise(-1, "Too many laplace stages in a transfer chain.\n");
+    }
+    chain->laplace[chain->nlaplace++] = order;
+}
+
+void
+fastpm_transfer_chain_add_diff(FastPMTransferChain * chain, int dir, int order)
+{
+    PM * pm = chain->pm;
+    float ** klist [2] = {pm->KFactors.k, pm->KFactors.k_finite};
+    ptrdiff_t i;
+    for(i = 0; i < pm->Nmesh[dir]; i ++) {
+        chain->kernel[dir][i] *= klist[order][dir][i];
+    }
+    chain->nimag ++;
+}
+
+void
+fastpm_transfer_chain_add_grad(FastPMTransferChain * chain, int dir, int order)
+{
+    fastpm_transfer_chain_add_diff(chain, dir, order);
+    chain->zero_selfconj = 1;
+}
+
+void
+fastpm_transfer_chain_add_any(FastPMTransferChain * chain, fastpm_fkfunc func, void * data)
+{
+    if(chain->nfunc == FASTPM_TRANSFER_CHAIN_MAX) {
+        fastpm_raise(-1, "Too many functions in a transfer chain.\n");
+    }
+    chain->func[chain->nfunc] = func;
+    chain->data[chain->nfunc] = data;
+    chain->nfunc ++;
+}
+
+/* signed integer wave number of mesh index i; same convention as MeshtoK */
+static ptrdiff_t
+_integer_k(ptrdiff_t i, ptrdiff_t Nmesh)
+{
+    return (i >= Nmesh / 2) ? i - Nmesh : i;
+}
+
+void
+fastpm_transfer_chain_add_radial(FastPMTransferChain * chain, fastpm_fkfunc func, void * data)
+{
+    PM * pm = chain->pm;
+    int d;
+
+    /* k**2 is an integer multiple of the fundamental mode only if it is the same on all axes. */
+    double k0 = 2 * M_PI / pm->BoxSize[0];
+    for(d = 1; d < 3; d ++) {
+        if(pm->BoxSize[d] != pm->BoxSize[0]) {
+            fastpm_transfer_chain_add_any(chain, func, data);
+            return;
+        }
+    }
+
+    if(chain->radial == NULL) {
+        /* the range of integer k**2 of the local modes */
+        ptrdiff_t n2min = 0;
+        ptrdiff_t n2max = 0;
+        for(d = 0; d < 3; d ++) {
+            ptrdiff_t i;
+            ptrdiff_t min = -1, max = 0;
+            for(i = pm->ORegion.start[d]; i < pm->ORegion.start[d] + pm->ORegion.size[d]; i ++) {
+                ptrdiff_t ii = _integer_k(i, pm->Nmesh[d]);
+                if(min < 0 || ii * ii < min) min = ii * ii;
+                if(ii * ii > max) max = ii * ii;
+            }
+            if(min < 0) min = 0;
+            n2min += min;
+            n2max += max;
+        }
+        /* a table longer than the local modes costs more than evaluating func per mode */
+        if(n2max - n2min + 1 > pm->ORegion.total
+        || n2max - n2min + 1 > FASTPM_TRANSFER_RADIAL_MAX) {
+            fastpm_transfer_chain_add_any(chain, func, data);
+            return;
+        }
+        chain->radial_start = n2min;
+        chain->radial_size = n2max - n2min + 1;
+        chain->radial = malloc(sizeof(double) * chain->radial_size);
+
+        ptrdiff_t j;
+#pragma omp parallel for
+        for(j = 0; j < chain->radial_size; j ++) {
+            chain->radial[j] = 1.0;
+        }
+    }
+
+    ptrdiff_t j;
+#pragma omp parallel for
+    for(j = 0; j < chain->radial_size; j ++) {
+        double k = k0 * sqrt(chain->radial_start + j);
+        chain->radial[j] *= func(k, data);
+    }
+}
+
+void
+fastpm_transfer_chain_apply(FastPMTransferChain * chain, FastPMFloat * from, FastPMFloat * to)
+{
+    PM * pm = chain->pm;
+    ptrdiff_t * Nmesh = pm_nmesh(pm);
+
+    /* only look at |k| if a stage needs it */
+    int need_kk = chain->nfunc > 0 || isfinite(chain->lowpass_kk);
+
+#pragma omp parallel
+    {
+        PMKIter kiter;
+        pm_kiter_init(pm, &kiter);
+        float ** kklist [3] = {kiter.kk, kiter.kk_finite, kiter.kk_finite2};
+        for(;
+            !pm_kiter_stop(&kiter);
+            pm_kiter_next(&kiter)) {
+            int d;
+            int j;
+            double fac = chain->scale;
+            for(d = 0; d < 3; d++) {
+                fac *= chain->kernel[d][kiter.iabs[d]];
+            }
+
+            if(chain->radial) {
+                ptrdiff_t n2 = 0;
+                for(d = 0; d < 3; d++) {
+                    ptrdiff_t ii = _integer_k(kiter.iabs[d], Nmesh[d]);
+                    n2 += ii * ii;
+                }
+                fac *= chain->radial[n2 - chain->radial_start];
+            }
+
+            if(need_kk) {
+                double kk = 0;
+                for(d = 0; d < 3; d++) {
+                    kk += kiter.kk[d][kiter.iabs[d]];
+                }
+                for(j = 0; j < chain->nfunc; j ++) {
+                    fac *= chain->func[j](sqrt(kk), chain->data[j]);
+                }
+                if(kk >= chain->lowpass_kk) fac = 0;
+            }
+
+            for(j = 0; j < chain->nlaplace; j ++) {
+                double kk_finite = 0;
+                for(d = 0; d < 3; d++) {
+                    kk_finite += kklist[chain->laplace[j]][d][kiter.iabs[d]];
+                }
+                /* 1 / k2 */
+                if(LIKELY(kk_finite != 0)) {
+                    fac *= 1 / kk_finite;
+                } else {
+                    fac = 0;
+                }
+            }
+
+            if(chain->zero_selfconj &&
+                kiter.iabs[0] == (Nmesh[0] - kiter.iabs[0]) % Nmesh[0] &&
+                kiter.iabs[1] == (Nmesh[1] - kiter.iabs[1]) % Nmesh[1] &&
+                kiter.iabs[2] == (Nmesh[2] - kiter.iabs[2]) % Nmesh[2]
+            ) {
+                /* We are at the nyquist and the diff operator shall be zero;
+                 * otherwise the force is not real! */
+                fac = 0;
+            }
+
+            ptrdiff_t ind = kiter.ind;
+            double re = from[ind + 0] * fac;
+            double im = from[ind + 1] * fac;
+            /* i ** nimag */
+            switch(chain->nimag % 4) {
+                case 0:
+                    to[ind + 0] = re;
+                    to[ind + 1] = im;
+                break;
+                case 1:
+                    to[ind + 0] = - im;
+                    to[ind + 1] = re;
+                break;
+                case 2:
+                    to[ind + 0] = - re;
+                    to[ind + 1] = - im;
+                break;
+                case 3:
+                    to[ind + 0] = im;
+                    to[ind + 1] = - re;
+                break;
+            }
+        }
+    }
+}
@@ -403,6 +403,7 @@ fastpm_store_write(FastPMStore * p,
         int ci;
     } * descr, BLOCKS[] = {
         DEFINE_COLUMN_IO("Position",        "f4", x),
+        DEFINE_COLUMN_IO("Position",        "f4", xfix),
         DEFINE_COLUMN_IO("InitialPosition", "f4", q),
         DEFINE_COLUMN_IO("DX1",             "f4", dx1),
         DEFINE_COLUMN_IO("DX2",             "f4", dx2),
@@ -539,6 +540,12 @@ fastpm_store_write(FastPMStore * p,
 
         if(Nwriters > Nfile * writers_per_file) Nwriters = Nfile * writers_per_file;
 
+        /* fixed point positions are converted through a temporary f8 buffer */
+        int xfix = descr->ci == FASTPM_STORE_COLUMN_INDEX(xfix);
+        const char * dtype = xfix ? "f8" : descr->dtype;
+        double (* xbuffer)[3] = NULL;
+        ptrdiff_t i;
+
         void * buffer;
         switch(mode) {
             case WRITE:
@@ -553,7 +560,15 @@ fastpm_store_write(FastPMStore * p,
 
                 buffer = p->columns[descr->ci];
 
-                big_array_init(&array, buffer, descr->dtype, 2, (size_t[]) {p->np, descr->nmemb}, NULL );
+                if(xfix) {
+                    xbuffer = malloc(sizeof(xbuffer[0]) * p->np);
+                    for(i = 0; i < p->np; i ++) {
+                        fastpm_store_get_position(p, i, xbuffer[i]);
+                    }
+                    buffer = xbuffer;
+                }
+
+                big_array_init(&array, buffer, dtype, 2, (size_t[]) {p->np, descr->nmemb}, NULL );
 
 
                 /*
@@ -570,6 +585,7 @@ fastpm_store_write(FastPMStore * p,
                 big_block_mpi_write(&bb, &ptr, &array, Nwriters, comm);
 
                 /* free(buffer); */
+                free(xbuffer);
 
                 big_block_mpi_close(&bb, comm);
                 break;
@@ -577,10 +593,22 @@ fastpm_store_write(FastPMStore * p,
                 fastpm_info("Reading block %s of (%s, %d) from %d files with %d writers\n", descr->name, descr->dtype, descr->nmemb, Nfile, Nwriters);
                 buffer = p->columns[descr->ci];
 
-                big_array_init(&array, buffer, descr->dtype, 2, (size_t[]) {p->np, descr->nmemb}, NULL );
+                if(xfix) {
+                    xbuffer = malloc(sizeof(xbuffer[0]) * p->np);
+                    buffer = xbuffer;
+                }
+
+                big_array_init(&array, buffer, dtype, 2, (size_t[]) {p->np, descr->nmemb}, NULL );
 
                 big_block_mpi_read(&bb, &ptr, &array, Nwriters, comm);
 
+                if(xfix) {
+                    for(i = 0; i < p->np; i ++) {
+                        fastpm_store_set_position(p, i, xbuffer[i]);
+                    }
+                    free(xbuffer);
+                }
+
                 big_block_mpi_close(&bb, comm);
                 break;
         }
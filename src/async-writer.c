@@ -0,0 +1,332 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <mpi.h>
+
+#include <fastpm/libfastpm.h>
+#include <fastpm/logging.h>
+#include <fastpm/string.h>
+#include <fastpm/histogram.h>
+#include <fastpm/io.h>
+#include <fastpm/prof.h>
+
+#include <bigfile.h>
+
+#include "async-writer.h"
+
+/*
+ * The IO thread runs the jobs in the order of submission. The main thread
+ * owns all staging buffers: they are allocated from FASTPM_MEMORY_FLOATING
+ * when a job is built, and released by the main thread after the job is
+ * done, because FastPMMemory is not thread safe.
+ *
+ * Every rank runs the same jobs in the same order, hence the collectives of
+ * the IO threads match on the duplicated communicator. Messages from the IO
+ * thread are logged collectively on that communicator too.
+ *
+ * MPI must provide MPI_THREAD_MULTIPLE; otherwise the jobs are written
+ * synchronously in submit. bigfile is not thread safe: the main thread
+ * flushes the writer before it calls bigfile itself, e.g. for the headers,
+ * which are still written synchronously. The IO thread is not profiled.
+ * */
+
+enum FastPMWriteOpType {
+    WRITE_STORE,
+    WRITE_ATTR,
+    WRITE_AEMIT_HIST,
+};
+
+struct FastPMWriteOp {
+    enum FastPMWriteOpType type;
+    char * filebase;
+    char * dataset;
+    char * attrname;
+    char modestr[4];
+
+    FastPMStore * p;
+
+    void * buf;
+    char dtype[8];
+    size_t nmemb;
+
+    FastPMHistogram hist[1];
+
+    struct FastPMWriteOp * next;
+};
+
+struct FastPMWriteJob {
+    struct FastPMWriteOp * head;
+    struct FastPMWriteOp * tail;
+    int done;
+    int Nwriters;
+    struct FastPMWriteJob * next;
+};
+
+struct FastPMAsyncWriter {
+    int max_inflight;
+    int async;
+    int Nwriters;
+    MPI_Comm comm;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    /* oldest job that is not released; next job to run; the last job. */
+    FastPMWriteJob * head;
+    FastPMWriteJob * next;
+    FastPMWriteJob * tail;
+    int ninflight;
+    int quit;
+};
+
+FastPMWriteJob *
+fastpm_write_job_create(FastPMAsyncWriter * writer)
+{
+    FastPMWriteJob * job = calloc(1, sizeof(job[0]));
+    job->Nwriters = writer->Nwriters;
+    return job;
+}
+
+static struct FastPMWriteOp *
+_job_append(FastPMWriteJob * job, enum FastPMWriteOpType type, const char * filebase)
+{
+    struct FastPMWriteOp * op = calloc(1, sizeof(op[0]));
+    op->type = type;
+    op->filebase = fastpm_strdup(filebase);
+    if(job->tail) {
+        job->tail->next = op;
+    } else {
+        job->head = op;
+    }
+    job->tail = op;
+    return op;
+}
+
+void
+fastpm_write_job_add_store(FastPMWriteJob * job, FastPMStore * p,
+        const char * filebase, const char * modestr)
+{
+    struct FastPMWriteOp * op = _job_append(job, WRITE_STORE, filebase);
+    strncpy(op->modestr, modestr, sizeof(op->modestr) - 1);
+
+    /* ACC and MASK are never written */
+    op->p = malloc(sizeof(FastPMStore));
+    fastpm_store_init(op->p, p->name, p->np,
+            p->attributes & (~COLUMN_ACC) & (~COLUMN_MASK),
+            FASTPM_MEMORY_FLOATING);
+    fastpm_store_copy(p, op->p);
+}
+
+void
+fastpm_write_job_add_attr(FastPMWriteJob * job,
+        const char * filebase, const char * dataset, const char * attrname,
+        void * buf, const char * dtype, size_t nmemb)
+{
+    struct FastPMWriteOp * op = _job_append(job, WRITE_ATTR, filebase);
+    op->dataset = fastpm_strdup(dataset);
+    op->attrname = fastpm_strdup(attrname);
+    strncpy(op->dtype, dtype, sizeof(op->dtype) - 1);
+    op->nmemb = nmemb;
+
+    size_t size = big_file_dtype_itemsize(dtype) * nmemb;
+    op->buf = malloc(size);
+    memcpy(op->buf, buf, size);
+}
+
+void
+fastpm_write_job_add_aemit_hist(FastPMWriteJob * job,
+        const char * filebase, const char * dataset, FastPMHistogram * hist)
+{
+    struct FastPMWriteOp * op = _job_append(job, WRITE_AEMIT_HIST, filebase);
+    op->dataset = fastpm_strdup(dataset);
+
+    op->hist->Nedges = hist->Nedges;
+    op->hist->edges = malloc(sizeof(double) * hist->Nedges);
+    op->hist->counts = malloc(sizeof(int64_t) * (hist->Nedges + 1));
+    memcpy(op->hist->edges, hist->edges, sizeof(double) * hist->Nedges);
+    memcpy(op->hist->counts, hist->counts, sizeof(int64_t) * (hist->Nedges + 1));
+}
+
+static void
+_job_run(FastPMWriteJob * job, MPI_Comm comm)
+{
+    struct FastPMWriteOp * op;
+    for(op = job->head; op; op = op->next) {
+        switch(op->type) {
+            case WRITE_STORE:
+                fastpm_store_write(op->p, op->filebase, op->modestr, job->Nwriters, comm);
+                break;
+            case WRITE_ATTR:
+                write_snapshot_attr(op->filebase, op->dataset, op->attrname,
+                        op->buf, op->dtype, op->nmemb, comm);
+                break;
+            case WRITE_AEMIT_HIST:
+                write_aemit_hist(op->filebase, op->dataset, op->hist, comm);
+                break;
+        }
+    }
+}
+
+/* release the staging buffers; on the main thread. */
+static void
+_job_free(FastPMWriteJob * job)
+{
+    struct FastPMWriteOp * op, * next;
+    for(op = job->head; op; op = next) {
+        next = op->next;
+        if(op->p) {
+            fastpm_store_destroy(op->p);
+            free(op->p);
+        }
+        if(op->type == WRITE_AEMIT_HIST) {
+            fastpm_histogram_destroy(op->hist);
+        }
+        free(op->buf);
+        free(op->attrname);
+        free(op->dataset);
+        free(op->filebase);
+        free(op);
+    }
+    free(job);
+}
+
+static void *
+_writer_main(void * userdata)
+{
+    FastPMAsyncWriter * writer = userdata;
+
+    fastpm_set_thread_msg_handler(fastpm_default_msg_handler, writer->comm, NULL);
+    /* the clocks are not thread safe */
+    fastpm_clock_skip_thread();
+
+    pthread_mutex_lock(&writer->lock);
+    while(1) {
+        while(writer->next == NULL && !writer->quit) {
+            pthread_cond_wait(&writer->cond, &writer->lock);
+        }
+        if(writer->next == NULL) break;
+
+        FastPMWriteJob * job = writer->next;
+        writer->next = job->next;
+        pthread_mutex_unlock(&writer->lock);
+
+        _job_run(job, writer->comm);
+
+        pthread_mutex_lock(&writer->lock);
+        job->done = 1;
+        pthread_cond_broadcast(&writer->cond);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+/* release finished jobs, waiting until at most maxjobs are in flight. */
+static void
+_writer_reap(FastPMAsyncWriter * writer, int maxjobs)
+{
+    pthread_mutex_lock(&writer->lock);
+    while(1) {
+        while(writer->head && writer->head->done) {
+            FastPMWriteJob * job = writer->head;
+            writer->head = job->next;
+            if(writer->head == NULL) writer->tail = NULL;
+            writer->ninflight --;
+
+            pthread_mutex_unlock(&writer->lock);
+            _job_free(job);
+            pthread_mutex_lock(&writer->lock);
+        }
+        if(writer->ninflight <= maxjobs) break;
+        pthread_cond_wait(&writer->cond, &writer->lock);
+    }
+    pthread_mutex_unlock(&writer->lock);
+}
+
+FastPMAsyncWriter *
+fastpm_async_writer_create(int max_inflight, int Nwriters, MPI_Comm comm)
+{
+    FastPMAsyncWriter * writer = calloc(1, sizeof(writer[0]));
+
+    int provided;
+    MPI_Query_thread(&provided);
+
+    writer->max_inflight = max_inflight;
+    writer->Nwriters = Nwriters;
+    writer->async = max_inflight > 0 && provided == MPI_THREAD_MULTIPLE;
+
+    if(max_inflight > 0 && !writer->async) {
+        fastpm_info("MPI does not provide MPI_THREAD_MULTIPLE; writing synchronously.\n");
+    }
+
+    if(!writer->async) {
+        writer->comm = comm;
+        return writer;
+    }
+
+    fastpm_info("Writing from an IO thread with at most %d jobs in flight.\n", max_inflight);
+
+    MPI_Comm_dup(comm, &writer->comm);
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->cond, NULL);
+
+    if(0 != pthread_create(&writer->thread, NULL, _writer_main, writer)) {
+        fastpm_raise(-1, "Failed to create the IO thread.\n");
+    }
+    return writer;
+}
+
+void
+fastpm_async_writer_submit(FastPMAsyncWriter * writer, FastPMWriteJob * job)
+{
+    if(!writer->async) {
+        _job_run(job, writer->comm);
+        _job_free(job);
+        return;
+    }
+
+    /* bound the number of staging buffers */
+    _writer_reap(writer, writer->max_inflight - 1);
+
+    pthread_mutex_lock(&writer->lock);
+    job->next = NULL;
+    if(writer->tail) {
+        writer->tail->next = job;
+    } else {
+        writer->head = job;
+    }
+    writer->tail = job;
+    if(writer->next == NULL) writer->next = job;
+    writer->ninflight ++;
+    pthread_cond_broadcast(&writer->cond);
+    pthread_mutex_unlock(&writer->lock);
+}
+
+void
+fastpm_async_writer_flush(FastPMAsyncWriter * writer)
+{
+    if(!writer->async) return;
+
+    _writer_reap(writer, 0);
+}
+
+void
+fastpm_async_writer_destroy(FastPMAsyncWriter * writer)
+{
+    if(writer->async) {
+        fastpm_async_writer_flush(writer);
+
+        pthread_mutex_lock(&writer->lock);
+        writer->quit = 1;
+        pthread_cond_broadcast(&writer->cond);
+        pthread_mutex_unlock(&writer->lock);
+
+        pthread_join(writer->thread, NULL);
+
+        pthread_cond_destroy(&writer->cond);
+        pthread_mutex_destroy(&writer->lock);
+        MPI_Comm_free(&writer->comm);
+    }
+    free(writer);
+}
@@ -0,0 +1,40 @@
+/* Writing stores from a background IO thread.
+ *
+ * A job is an ordered list of store writes and attributes. The stores and
+ * the attributes are copied to staging buffers when they are added, thus the
+ * caller can modify or free them right away. The jobs run in the order of
+ * submission, collectively on a private communicator. */
+
+typedef struct FastPMAsyncWriter FastPMAsyncWriter;
+typedef struct FastPMWriteJob FastPMWriteJob;
+
+/* max_inflight jobs may be pending before submit blocks; 0 for writing
+ * synchronously in submit. */
+FastPMAsyncWriter *
+fastpm_async_writer_create(int max_inflight, int Nwriters, MPI_Comm comm);
+
+FastPMWriteJob *
+fastpm_write_job_create(FastPMAsyncWriter * writer);
+
+void
+fastpm_write_job_add_store(FastPMWriteJob * job, FastPMStore * p,
+        const char * filebase, const char * modestr);
+
+void
+fastpm_write_job_add_attr(FastPMWriteJob * job,
+        const char * filebase, const char * dataset, const char * attrname,
+        void * buf, const char * dtype, size_t nmemb);
+
+void
+fastpm_write_job_add_aemit_hist(FastPMWriteJob * job,
+        const char * filebase, const char * dataset, FastPMHistogram * hist);
+
+void
+fastpm_async_writer_submit(FastPMAsyncWriter * writer, FastPMWriteJob * job);
+
+/* wait for all submitted jobs; required before calling bigfile from the main thread. */
+void
+fastpm_async_writer_flush(FastPMAsyncWriter * writer);
+
+void
+fastpm_async_writer_destroy(FastPMAsyncWriter * writer);
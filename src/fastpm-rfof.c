@@ -95,6 +95,7 @@ main(int argc, char * argv[])
         exit(1);
     }
 
+    libfastpm_set_memory_numa(cli->MemoryFirstTouch, cli->MemoryHugePages);
     libfastpm_set_memory_bound(cli->MemoryPerRank * 1024 * 1024);
 
     FastPMStore source[1];
@@ -8,6 +8,8 @@
 #include <math.h>
 #include <signal.h>
 #include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <fastpm/libfastpm.h>
 #include <fastpm/prof.h>
@@ -29,6 +31,7 @@
 #include "lua-config.h"
 #include "param.h"
 #include "prepare.h"
+#include "async-writer.h"
 
 /* c99 has no pi. */
 #ifndef M_PI
@@ -39,6 +42,7 @@ typedef struct {
     CLIParameters * cli;
     LUAParameters * lua;
     int iout; /* index of next unwritten snapshot. */
+    FastPMAsyncWriter * writer;
 } RunData;
 
 
@@ -118,11 +122,38 @@ write_parameters(const char * filebase, const char * dataset, RunData * prr, MPI
 
 int run_fastpm(FastPMConfig * config, RunData * prr, MPI_Comm comm);
 
+/* peek at write_async_buffers before MPI is initialized, to decide the thread level;
+ * errors are left for the parsing after MPI is initialized to report. */
+static int
+wants_async_writer(int argc, char ** argv)
+{
+    char * error = NULL;
+    int r = 0;
+    CLIParameters * cli = parse_cli_args(argc, argv);
+    LUAParameters * lua = parse_config(cli->argv[0], cli->argc, cli->argv, &error);
+    if(lua) {
+        r = CONF(lua, write_async_buffers) > 0;
+        free_lua_parameters(lua);
+    }
+    free(error);
+    free_cli_parameters(cli);
+    /* getopt rescans argv in parse_cli_args_mpi */
+    optind = 1;
+    return r;
+}
+
 int main(int argc, char ** argv) {
 
     init_stacktrace();
 
-    MPI_Init(&argc, &argv);
+    /* the snapshots and the lightcone are written from an IO thread if write_async_buffers is set,
+     * which requires MPI_THREAD_MULTIPLE; otherwise they are written synchronously. */
+    if(wants_async_writer(argc, argv)) {
+        int provided;
+        MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
+    } else {
+        MPI_Init(&argc, &argv);
+    }
 
     libfastpm_init();
 
@@ -142,7 +173,7 @@ int main(int argc, char ** argv) {
 
     LUAParameters * lua = parse_config_mpi(cli->argv[0], cli->argc, cli->argv, &error, comm);
 
-    RunData prr[1] = {{cli, lua, 0}};
+    RunData prr[1] = {{cli, lua, 0, NULL}};
 
     if(prr->lua) {
         fastpm_info("Configuration %s\n", prr->lua->string);
@@ -152,6 +183,7 @@ int main(int argc, char ** argv) {
         exit(1);
     }
 
+    libfastpm_set_memory_numa(prr->cli->MemoryFirstTouch, prr->cli->MemoryHugePages);
     libfastpm_set_memory_bound(prr->cli->MemoryPerRank * 1024 * 1024);
     fastpm_memory_set_handlers(_libfastpm_get_gmem(), NULL, _memory_peak_handler, &comm);
 
@@ -196,10 +228,16 @@ int main(int argc, char ** argv) {
         .FORCE_TYPE = CONF(prr->lua, force_mode),
         .KERNEL_TYPE = CONF(prr->lua, kernel_type),
         .SOFTENING_TYPE = CONF(prr->lua, force_softening_type),
+        .GRADIENT_TYPE = CONF(prr->lua, force_gradient_type),
         .PAINTER_TYPE = CONF(prr->lua, painter_type),
         .painter_support = CONF(prr->lua, painter_support),
+        .painter_tiled = CONF(prr->lua, painter_tiled),
+        .sort_particles = CONF(prr->lua, sort_particles),
+        .kick_in_readout = CONF(prr->lua, kick_in_readout),
         .NprocY = prr->cli->NprocY,
         .UseFFTW = prr->cli->UseFFTW,
+        .fft_wisdom = CONF(prr->lua, fft_wisdom),
+        .max_batched_ffts = CONF(prr->lua, max_batched_ffts),
         .ExtraAttributes = 0,
         .pgdc = CONF(prr->lua, pgdc),
         .pgdc_alpha0 = CONF(prr->lua, pgdc_alpha0),
@@ -215,6 +253,9 @@ int main(int argc, char ** argv) {
     if(CONF(prr->lua, pgdc)) {
         config->ExtraAttributes |= COLUMN_PGDC;
     }
+    if(CONF(prr->lua, fixed_point_position)) {
+        config->ExtraAttributes |= COLUMN_POS_FIXED;
+    }
 
     run_fastpm(config, prr, comm);
 
@@ -231,9 +272,15 @@ int main(int argc, char ** argv) {
 static int
 check_snapshots(FastPMSolver * fastpm, FastPMInterpolationEvent * event, RunData * prr);
 
+static int
+query_snapshots(FastPMSolver * fastpm, FastPMInterpolationQueryEvent * event, RunData * prr);
+
 static int
 check_lightcone(FastPMSolver * fastpm, FastPMInterpolationEvent * event, FastPMUSMesh * lc);
 
+static int
+query_lightcone(FastPMSolver * fastpm, FastPMInterpolationQueryEvent * event, FastPMUSMesh * lc);
+
 static int
 write_powerspectrum(FastPMSolver * fastpm, FastPMForceEvent * event, RunData * prr);
 
@@ -255,6 +302,9 @@ prepare_ncdm(FastPMSolver * fastpm, RunData * prr, double a0, MPI_Comm comm);
 static void
 report_memory(MPI_Comm);
 
+static void
+write_memory_report(const char * filename, MPI_Comm comm);
+
 static void
 prepare_lc(FastPMSolver * fastpm, RunData * prr,
         FastPMLightCone * lc, FastPMUSMesh ** usmesh);
@@ -285,6 +335,11 @@ int run_fastpm(FastPMConfig * config, RunData * prr, MPI_Comm comm) {
     fastpm_info("%d Threads\n", omp_get_max_threads());
 #endif
 
+    /* neutrino linear response is saved with MPI_COMM_WORLD in the snapshots; thus no IO thread. */
+    prr->writer = fastpm_async_writer_create(
+            fastpm->cosmology->ncdm_linearresponse ? 0 : CONF(prr->lua, write_async_buffers),
+            prr->cli->Nwriters, comm);
+
     LEAVE(init);
 
     fastpm_add_event_handler(&fastpm->event_handlers,
@@ -311,6 +366,12 @@ int run_fastpm(FastPMConfig * config, RunData * prr, MPI_Comm comm) {
         (FastPMEventHandlerFunction) check_snapshots,
         prr);
 
+    fastpm_add_event_handler(&fastpm->event_handlers,
+        FASTPM_EVENT_INTERPOLATION_QUERY,
+        FASTPM_EVENT_STAGE_BEFORE,
+        (FastPMEventHandlerFunction) query_snapshots,
+        prr);
+
     fastpm_add_event_handler(&fastpm->event_handlers,
         FASTPM_EVENT_TRANSITION,
         FASTPM_EVENT_STAGE_BEFORE,
@@ -369,6 +430,11 @@ int run_fastpm(FastPMConfig * config, RunData * prr, MPI_Comm comm) {
     fastpm_solver_evolve(fastpm, time_step, n_time_step);
     LEAVE(evolve);
 
+    ENTER(io);
+    fastpm_async_writer_destroy(prr->writer);
+    prr->writer = NULL;
+    LEAVE(io);
+
     free(time_step);
     if(usmesh)
         fastpm_usmesh_destroy(usmesh);
@@ -391,6 +457,10 @@ int run_fastpm(FastPMConfig * config, RunData * prr, MPI_Comm comm) {
 
     report_memory(comm);
 
+    if(CONF(prr->lua, write_memory_report)) {
+        write_memory_report(CONF(prr->lua, write_memory_report), comm);
+    }
+
     fastpm_clock_stat(comm);
 
     return 0;
@@ -473,8 +543,8 @@ prepare_deltak(FastPMSolver * fastpm, PM * pm, FastPMFloat * delta_k, RunData *
         goto induce;
     }
 
-    /* Nothing to read from, just generate a gadget IC with the seed. */
-    fastpm_ic_fill_gaussiank(pm, delta_k, CONF(prr->lua, random_seed), FASTPM_DELTAK_GADGET);
+    /* Nothing to read from, just generate an IC with the seed. */
+    fastpm_ic_fill_gaussiank(pm, delta_k, CONF(prr->lua, random_seed), CONF(prr->lua, whitenoise_scheme));
 
 induce:
     if(CONF(prr->lua, remove_cosmic_variance)) {
@@ -783,11 +853,14 @@ prepare_ncdm(FastPMSolver * fastpm, RunData * prr, double a0, MPI_Comm comm)
     // stagger the ncdm grid wrt the cdm grid. FIXME: Does this conflict with the shift stuff above?
     int i, d;
     for(i = 0; i < ncdm_sites->np; i ++) {
+        double x[3];
+        fastpm_store_get_position(ncdm_sites, i, x);
         for(d = 0; d < 3; d ++) {
-            ncdm_sites->x[i][d] += fastpm->config->boxsize / nc_cdm * 0.5;
+            x[d] += fastpm->config->boxsize / nc_cdm * 0.5;
             if (ncdm_sites->q)
                 ncdm_sites->q[i][d] += fastpm->config->boxsize / nc_cdm * 0.5;
         }
+        fastpm_store_set_position(ncdm_sites, i, x);
     }
 
     // SPLIT
@@ -945,6 +1018,12 @@ prepare_lc(FastPMSolver * fastpm, RunData * prr,
             (FastPMEventHandlerFunction) check_lightcone,
             *usmesh);
 
+        fastpm_add_event_handler(&fastpm->event_handlers,
+            FASTPM_EVENT_INTERPOLATION_QUERY,
+            FASTPM_EVENT_STAGE_BEFORE,
+            (FastPMEventHandlerFunction) query_lightcone,
+            *usmesh);
+
         free(tiles);
 
         struct usmesh_ready_handler_data * data = malloc(sizeof(data[0]));
@@ -1071,62 +1150,56 @@ usmesh_ready_handler(FastPMUSMesh * mesh, FastPMLCEvent * lcevent, struct usmesh
     LEAVE(indexing);
 
     ENTER(io);
+    FastPMWriteJob * job = fastpm_write_job_create(prr->writer);
+    const char * mode = (lcevent->whence == TIMESTEP_START) ? "w" : "a";
     if(lcevent->whence == TIMESTEP_START) {
         fastpm_info("Creating usmesh catalog in %s\n", filebase);
+        /* the header is written synchronously; bigfile is not thread safe */
+        fastpm_async_writer_flush(prr->writer);
         write_snapshot_header(fastpm, filebase, fastpm->comm);
         write_parameters(filebase, "Header", prr, fastpm->comm);
-        fastpm_store_write(lcevent->p, filebase, "w", prr->cli->Nwriters, fastpm->comm);
     } else {
         fastpm_info("Appending usmesh catalog to %s\n", filebase);
-        fastpm_store_write(lcevent->p, filebase, "a", prr->cli->Nwriters, fastpm->comm);
     }
-    write_aemit_hist(filebase, "1/.", data->cdm_hist, fastpm->comm);
+    fastpm_write_job_add_store(job, lcevent->p, filebase, mode);
+    fastpm_write_job_add_aemit_hist(job, filebase, "1/.", data->cdm_hist);
 
     /* halos */
     if(CONF(prr->lua, write_fof)) {
-        if(lcevent->whence == TIMESTEP_START) {
-            /* usmesh fof is always written after the subsample snapshot; no need to create a header */
-            fastpm_store_write(halos, filebase, "w", prr->cli->Nwriters, fastpm->comm);
-        } else {
-            fastpm_store_write(halos, filebase, "a", prr->cli->Nwriters, fastpm->comm);
-        }
+        /* usmesh fof is always written after the subsample snapshot; no need to create a header */
+        fastpm_write_job_add_store(job, halos, filebase, mode);
         char * dataset_attrs = fastpm_strdup_printf("%s/.", halos->name);
-        write_aemit_hist(filebase, dataset_attrs, data->fof_hist, fastpm->comm);
+        fastpm_write_job_add_aemit_hist(job, filebase, dataset_attrs, data->fof_hist);
         free(dataset_attrs);
         fastpm_store_destroy(halos);
     }
     if(CONF(prr->lua, write_rfof)) {
-        if(lcevent->whence == TIMESTEP_START) {
-            /* usmesh fof is always written after the subsample snapshot; no need to create a header */
-            fastpm_store_write(rhalos, filebase, "w", prr->cli->Nwriters, fastpm->comm);
-        } else {
-            fastpm_store_write(rhalos, filebase, "a", prr->cli->Nwriters, fastpm->comm);
-        }
+        /* usmesh fof is always written after the subsample snapshot; no need to create a header */
+        fastpm_write_job_add_store(job, rhalos, filebase, mode);
 
         char * dataset_attrs = fastpm_strdup_printf("%s/.", rhalos->name);
-        write_aemit_hist(filebase, dataset_attrs, data->fof_hist, fastpm->comm);
+        fastpm_write_job_add_aemit_hist(job, filebase, dataset_attrs, data->fof_hist);
         free(dataset_attrs);
         fastpm_store_destroy(rhalos);
     }
     if(CONF(prr->lua, lc_usmesh_healpix_nside)) {
+        fastpm_write_job_add_store(job, map, filebase, mode);
         if(lcevent->whence == TIMESTEP_START) {
-            fastpm_store_write(map, filebase, "w", prr->cli->Nwriters, fastpm->comm);
             int64_t nside = CONF(prr->lua, lc_usmesh_healpix_nside);
             int64_t nslices = CONF(prr->lua, lc_usmesh_nslices);
             int64_t npix = nside2npix(nside);
             char * scheme = "RING";
-            write_snapshot_attr(filebase, map->name, "healpix.nside", &nside, "i8", 1, fastpm->comm);
-            write_snapshot_attr(filebase, map->name, "healpix.npix", &npix, "i8", 1, fastpm->comm);
-            write_snapshot_attr(filebase, map->name, "healpix.nslices", &nslices, "i8", 1, fastpm->comm);
-            write_snapshot_attr(filebase, map->name, "healpix.scheme", scheme, "S1", strlen(scheme) + 1, fastpm->comm);
-        } else {
-            fastpm_store_write(map, filebase, "a", prr->cli->Nwriters, fastpm->comm);
+            fastpm_write_job_add_attr(job, filebase, map->name, "healpix.nside", &nside, "i8", 1);
+            fastpm_write_job_add_attr(job, filebase, map->name, "healpix.npix", &npix, "i8", 1);
+            fastpm_write_job_add_attr(job, filebase, map->name, "healpix.nslices", &nslices, "i8", 1);
+            fastpm_write_job_add_attr(job, filebase, map->name, "healpix.scheme", scheme, "S1", strlen(scheme) + 1);
         }
         char * dataset_attrs = fastpm_strdup_printf("%s/.", map->name);
-        write_aemit_hist(filebase, dataset_attrs, data->map_hist, fastpm->comm);
+        fastpm_write_job_add_aemit_hist(job, filebase, dataset_attrs, data->map_hist);
         free(dataset_attrs);
         fastpm_store_destroy(map);
     }
+    fastpm_async_writer_submit(prr->writer, job);
     LEAVE(io);
     free(filebase);
 
@@ -1207,6 +1280,23 @@ check_snapshots(FastPMSolver * fastpm, FastPMInterpolationEvent * event, RunData
     return 0;
 }
 
+/* would check_snapshots write a snapshot in (a1, a2] ? */
+static int
+query_snapshots(FastPMSolver * fastpm, FastPMInterpolationQueryEvent * event, RunData * prr)
+{
+    int nout = CONF(prr->lua, n_aout);
+    double * aout = CONF(prr->lua, aout);
+
+    int iout;
+    for(iout = 0; iout < nout; iout ++) {
+        if(event->a1 >= aout[iout]) continue;
+        if(event->a2 < aout[iout]) continue;
+        event->wanted = 1;
+    }
+    event->nanswers ++;
+    return 0;
+}
+
 static void
 _halos_ready (
     FastPMStore * halos,
@@ -1428,10 +1518,13 @@ take_a_snapshot(FastPMSolver * fastpm, RunData * prr)
         FastPMFloat * rho_k = pm_alloc(fastpm->basepm);
 
         fastpm_painter_init(painter, fastpm->basepm, fastpm->config->PAINTER_TYPE, fastpm->config->painter_support);
+        painter->tiled = fastpm->config->painter_tiled;
 
         fastpm_paint(painter, rho_x, cdm, FASTPM_FIELD_DESCR_NONE);
         pm_r2c(fastpm->basepm, rho_x, rho_k);
 
+        /* bigfile is not thread safe */
+        fastpm_async_writer_flush(prr->writer);
         write_complex(fastpm->basepm, rho_k, filename, "DensityK", prr->cli->Nwriters);
 
         pm_free(fastpm->basepm, rho_k);
@@ -1475,16 +1568,20 @@ take_a_snapshot(FastPMSolver * fastpm, RunData * prr)
         sprintf(filebase, "%s_%0.04f", CONF(prr->lua, write_snapshot), aout);
 
         ENTER(io);
+        /* the header is written synchronously; bigfile is not thread safe */
+        fastpm_async_writer_flush(prr->writer);
         write_snapshot_header(fastpm, filebase, fastpm->comm);
         write_parameters(filebase, "Header", prr, fastpm->comm);
 
+        FastPMWriteJob * job = fastpm_write_job_create(prr->writer);
         for(si = 0; si < FASTPM_SOLVER_NSPECIES; si ++) {
             if(!fastpm_solver_get_species(fastpm, si)) continue;
-            fastpm_store_write(&subsample[si], filebase, "w", prr->cli->Nwriters, fastpm->comm);
+            fastpm_write_job_add_store(job, &subsample[si], filebase, "w");
         }
+        fastpm_async_writer_submit(prr->writer, job);
 
         LEAVE(io);
-        fastpm_info("snapshot %s [%s] written at z = %6.4f a = %6.4f \n", filebase, "1", z_out, aout);
+        fastpm_info("snapshot %s [%s] submitted at z = %6.4f a = %6.4f \n", filebase, "1", z_out, aout);
     }
 
     if(CONF(prr->lua, write_fof)) {
@@ -1497,14 +1594,17 @@ take_a_snapshot(FastPMSolver * fastpm, RunData * prr)
 
         ENTER(io);
         /* over write the header of write_fof and write_snapshot are the same */
+        fastpm_async_writer_flush(prr->writer);
         write_snapshot_header(fastpm, filebase, fastpm->comm);
         write_parameters(filebase, "Header", prr, fastpm->comm);
 
-        fastpm_store_write(halos, filebase, "w", prr->cli->Nwriters, fastpm->comm);
+        FastPMWriteJob * job = fastpm_write_job_create(prr->writer);
+        fastpm_write_job_add_store(job, halos, filebase, "w");
+        fastpm_async_writer_submit(prr->writer, job);
 
         LEAVE(io);
 
-        fastpm_info("fof %s [%s] written at z = %6.4f a = %6.4f \n", filebase, halos->name, z_out, aout);
+        fastpm_info("fof %s [%s] submitted at z = %6.4f a = %6.4f \n", filebase, halos->name, z_out, aout);
 
         fastpm_store_destroy(halos);
     }
@@ -1518,14 +1618,17 @@ take_a_snapshot(FastPMSolver * fastpm, RunData * prr)
 
         ENTER(io);
         /* over write the header of write_fof and write_snapshot are the same */
+        fastpm_async_writer_flush(prr->writer);
         write_snapshot_header(fastpm, filebase, fastpm->comm);
         write_parameters(filebase, "Header", prr, fastpm->comm);
 
-        fastpm_store_write(rhalos, filebase, "w", prr->cli->Nwriters, fastpm->comm);
+        FastPMWriteJob * job = fastpm_write_job_create(prr->writer);
+        fastpm_write_job_add_store(job, rhalos, filebase, "w");
+        fastpm_async_writer_submit(prr->writer, job);
 
         LEAVE(io);
 
-        fastpm_info("fof %s [%s] written at z = %6.4f a = %6.4f \n", filebase, rhalos->name, z_out, aout);
+        fastpm_info("fof %s [%s] submitted at z = %6.4f a = %6.4f \n", filebase, rhalos->name, z_out, aout);
 
         fastpm_store_destroy(rhalos);
     }
@@ -1572,6 +1675,20 @@ check_lightcone(FastPMSolver * fastpm, FastPMInterpolationEvent * event, FastPMU
     return 0;
 }
 
+/* the lightcone only collects particles between amin and amax. */
+static int
+query_lightcone(FastPMSolver * fastpm, FastPMInterpolationQueryEvent * event, FastPMUSMesh * usmesh)
+{
+    double a1 = fmin(event->a1, event->a2);
+    double a2 = fmax(event->a1, event->a2);
+
+    if(a2 >= usmesh->amin && a1 <= usmesh->amax) {
+        event->wanted = 1;
+    }
+    event->nanswers ++;
+    return 0;
+}
+
 static int
 print_transition(FastPMSolver * fastpm, FastPMTransitionEvent * event, RunData * prr)
 {
@@ -1646,6 +1763,59 @@ report_memory(MPI_Comm comm)
     oldrank = max_rank;
 }
 
+/* the peak of every rank; the tags and the timeline of the rank with the highest peak,
+ * which writes the file. */
+static void
+write_memory_report(const char * filename, MPI_Comm comm)
+{
+    FastPMMemory * mem = _libfastpm_get_gmem();
+
+    int ThisTask;
+    int NTask;
+    MPI_Comm_rank(comm, &ThisTask);
+    MPI_Comm_size(comm, &NTask);
+
+    double min_peak, max_peak, mean_peak;
+    int min_rank, max_rank;
+
+    MPIU_stats(comm, mem->peak_bytes, "<,>.-",
+            &min_peak,
+            &min_rank,
+            &max_peak,
+            &max_rank,
+            &mean_peak);
+
+    double peak = mem->peak_bytes;
+    double * peaks = NULL;
+    if(ThisTask == max_rank) {
+        peaks = malloc(sizeof(double) * NTask);
+    }
+    MPI_Gather(&peak, 1, MPI_DOUBLE, peaks, 1, MPI_DOUBLE, max_rank, comm);
+
+    if(ThisTask != max_rank) return;
+
+    fastpm_ilog(INFO, "Writing memory report to %s\n", filename);
+
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) {
+        fastpm_ilog(INFO, "Failed to open memory report file %s\n", filename);
+        free(peaks);
+        return;
+    }
+    dprintf(fd, "# peak bytes over %d ranks: min %g (rank %d) mean %g max %g (rank %d)\n",
+        NTask, min_peak, min_rank, mean_peak, max_peak, max_rank);
+    dprintf(fd, "# rank, peak bytes\n");
+    int i;
+    for(i = 0; i < NTask; i ++) {
+        dprintf(fd, "%d %g\n", i, peaks[i]);
+    }
+    dprintf(fd, "# rank %d has the highest peak\n", max_rank);
+    fastpm_memory_dump_tags(mem, fd);
+    fastpm_memory_dump_timeline(mem, fd);
+    close(fd);
+    free(peaks);
+}
+
 static int
 report_lpt(FastPMSolver * fastpm, FastPMLPTEvent * event, RunData * prr)
 {
@@ -1718,10 +1888,13 @@ write_powerspectrum(FastPMSolver * fastpm, FastPMForceEvent * event, RunData * p
         FastPMStore * p = fastpm_solver_get_species(fastpm, FASTPM_SPECIES_CDM);
         double fstd[3];
 
-        fastpm_store_summary(p, COLUMN_ACC, comm, "s", fstd);
+        /* no ACC if the forces were read out into the kicks */
+        if(p->acc) {
+            fastpm_store_summary(p, COLUMN_ACC, comm, "s", fstd);
 
-        fastpm_info("Force dispersion: std = %g %g %g\n",
-                fstd[0], fstd[1], fstd[2]);
+            fastpm_info("Force dispersion: std = %g %g %g\n",
+                    fstd[0], fstd[1], fstd[2]);
+        }
     }
 
     CLOCK(compute);
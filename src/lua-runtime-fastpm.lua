@@ -48,6 +48,7 @@ schema.declare{name='pm_nc_factor',      type='array:number',  required=true, he
 schema.declare{name='lpt_nc_factor',     type='number', required=false, default=1, help="PM resolution use in lpt and linear density field."}
 schema.declare{name='np_alloc_factor',   type='number', required=true, help="Over allocation factor for load imbalance" }
 schema.declare{name='compute_potential', type='boolean', required=false, default=false, help="Calculate the gravitional potential."}
+schema.declare{name='fixed_point_position', type='boolean', required=false, default=false, help="Store the particle positions as 32 bit fixed point offsets in the box (BoxSize / 2**32 resolution); saves 12 bytes per particle."}
 schema.declare{name='n_shell',           type='number', required=false, default=10, help="Number of shells of FD distribution for ncdm splitting. Set n_shell=0 for no ncdm particles."}
 schema.declare{name='lvk',               type='boolean', required=false, default=true, help="Use the low velocity kernel when splitting FD for ncdm."}
 schema.declare{name='n_side',            type='number', required=false, default=3, help="This is N_fib for fibonacci sphere splitting, or number of sides in HEALPix splitting."}
@@ -131,6 +132,11 @@ end
 -- Force calculation --
 schema.declare{name='painter_type',        type='enum', default='cic', help="Type of painter."}
 schema.declare{name='painter_support',     type='int', default=2, help="Support (size) of the painting kernel"}
+schema.declare{name='painter_tiled',       type='boolean', default=false, help="Paint by slabs of planes without atomics; the density is bitwise reproducible with any number of threads."}
+schema.declare{name='sort_particles',      type='boolean', default=false, help="Sort the particles by the Morton order of their mesh cells after every decomposition; painting and readout access the mesh with better locality."}
+schema.declare{name='fft_wisdom',          type='string', help="Prefix of the FFTW wisdom files. The FFTs are planned by measurements, and the wisdom is saved to a file per mesh size, process mesh and number of threads, to be reused by later runs. Plans are estimated if not set."}
+schema.declare{name='max_batched_ffts',    type='int', default=1, help="Max number of fields transformed together by a batched FFT (up to 6), e.g. the force components. Each batched field takes an extra mesh and a mesh of scratch; 1 transforms the fields one by one."}
+schema.declare{name='kick_in_readout',     type='boolean', default=false, help="Kick the velocities as the forces are read out, instead of keeping the forces in an ACC column. Forces are still kept for the steps that snapshots or lightcones interpolate."}
 schema.painter_type.choices = {
     cic = 'FASTPM_PAINTER_CIC',
     linear = 'FASTPM_PAINTER_LINEAR',
@@ -187,6 +193,13 @@ schema.declare{name='read_whitenoisek',         type='string'}
 
 schema.declare{name='sigma8',             type='number', default=0, help='normalize linear power spectrumt to sigma8(z); this shall be sigma8 at linear_density_redshift, not z=0.'}
 schema.declare{name='random_seed',         type='int'}
+schema.declare{name='whitenoise_scheme',   type='enum', default='gadget', help="Generator of the white noise from random_seed. 'philox' draws every mode from a counter based generator; the field does not depend on the number of ranks or threads."}
+schema.whitenoise_scheme.choices = {
+    gadget = 'FASTPM_DELTAK_GADGET',
+    fast = 'FASTPM_DELTAK_FAST',
+    slow = 'FASTPM_DELTAK_SLOW',
+    philox = 'FASTPM_DELTAK_PHILOX',
+}
 schema.declare{name='shift',             type='boolean', default=false}
 schema.declare{name='inverted_ic',             type='boolean', default=false}
 schema.declare{name='remove_cosmic_variance',  type='boolean', default=false}
@@ -222,11 +235,13 @@ schema.declare{name='write_lineark',         type='string', help='Write linear f
 schema.declare{name='write_whitenoisek',         type='string'}
 schema.declare{name='write_runpbic',       type='string'}
 schema.declare{name='write_powerspectrum', type='string'}
+schema.declare{name='write_memory_report', type='string', help='Write the peak memory of every rank, and the usage per allocation tag and the allocation timeline of the rank with the highest peak.'}
 schema.declare{name='write_snapshot',      type='string'}
 schema.declare{name='write_nonlineark',      type='string'}
 schema.declare{name='write_runpb_snapshot', type='string'}
 schema.declare{name='particle_fraction',    type='number', default=1.0, help='Fraction of particles to save in the snapshot (sub-sampling)'}
 schema.declare{name='sort_snapshot',    type='boolean', default=true, help='sort snapshots by ID; very large communication is incurred during snapshots.'}
+schema.declare{name='write_async_buffers',    type='int', default=0, help='Number of snapshot and lightcone writes that can be in flight on a background IO thread; each holds a copy of the data. 0 to write synchronously. Requires MPI_THREAD_MULTIPLE.'}
 
 schema.declare{name='write_fof',      type='string', help='Path to save the fof catalog, will be in the FOF-0.200 dataset. (or other linking length).'}
 schema.declare{name='fof_linkinglength',      type='number', default=0.2, help='linking length of FOF; in units of particle mean separation.'}
@@ -310,6 +325,13 @@ schema.force_softening_type.choices = {
     twothird = 'FASTPM_SOFTENING_TWO_THIRD',
 }
 
+schema.declare{name='force_gradient_type',      type='enum', default="fourier", help='Gradient of the potential; fourier does one c2r per force component, fd2 and fd4 take 2 and 4 point finite differences of the real space potential after a single c2r.'}
+schema.force_gradient_type.choices = {
+    fourier = 'FASTPM_GRADIENT_FOURIER',
+    fd2 = 'FASTPM_GRADIENT_FD2',
+    fd4 = 'FASTPM_GRADIENT_FD4',
+}
+
 schema.declare{name='constraints',      type='array:number',  help="A list of {x, y, z, peak-sigma}, giving the constraints in MPC/h units. "}
 function schema.constraints.action (constraints)
     if constraints == nil then
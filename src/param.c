@@ -30,9 +30,11 @@ parse_cli_args(int argc, char ** argv)
     prr->NprocY = 0;
     prr->Nwriters = 0;
     prr->MemoryPerRank = 0;
+    prr->MemoryFirstTouch = 0;
+    prr->MemoryHugePages = 0;
     prr->MaxThreads = -1;
     prr->RestartSnapshotPath = NULL;
-    while ((opt = getopt(argc, argv, "h?T:y:fW:m:r:")) != -1) {
+    while ((opt = getopt(argc, argv, "h?T:y:fW:m:NHr:")) != -1) {
         switch(opt) {
             case 'r':
                 prr->RestartSnapshotPath = _strdup(optarg);
@@ -52,6 +54,12 @@ parse_cli_args(int argc, char ** argv)
             case 'm':
                 prr->MemoryPerRank = atoi(optarg);
             break;
+            case 'N':
+                prr->MemoryFirstTouch = 1;
+            break;
+            case 'H':
+                prr->MemoryHugePages = 1;
+            break;
             case 'h':
             case '?':
             default:
@@ -69,10 +77,12 @@ parse_cli_args(int argc, char ** argv)
     return prr;
 
 usage:
-    printf("Usage: fastpm [-T MaxThreads] [-W Nwriters] [-f] [-y NprocY] [-m MemoryBoundInMB] paramfile\n"
+    printf("Usage: fastpm [-T MaxThreads] [-W Nwriters] [-f] [-y NprocY] [-m MemoryBoundInMB] [-N] [-H] paramfile\n"
     "-T limit number of OMP threads\n"
     "-f Use FFTW / slab decomposition \n"
     "-m limit memory usage (die if exceeds this)\n"
+    "-N with -m, place the memory pages on the NUMA node of the threads that use them (first touch)\n"
+    "-H with -m, advise transparent huge pages for the memory pool\n"
     "-y Set the number of processes in the 2D mesh along the Y direction. \n"
     "-r Restart from a given snapshot.\n"
 );
@@ -5,6 +5,8 @@ typedef struct {
     int MaxThreads;
     char * RestartSnapshotPath;
     size_t MemoryPerRank;
+    int MemoryFirstTouch;
+    int MemoryHugePages;
 
     char ** argv;
     int argc;
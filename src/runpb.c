@@ -130,6 +130,10 @@ read_runpb_ic(FastPMSolver * fastpm, FastPMStore * p, const char * filename)
     size_t end   = (ThisTask + 1) * Ntot / NTask;
     p->np = end - start;
 
+    /* the positions in the file are in units of the box; they are stored once scaled,
+     * since the fixed point positions are quantized in units of BoxSize. */
+    double (* pos)[3] = malloc(sizeof(pos[0]) * p->np);
+
     int offset = 0;
     int chunknpart = chunksize / (sizeof(float) * 3);
     fastpm_info("chunknpart = %d\n", chunknpart);
@@ -181,7 +185,7 @@ read_runpb_ic(FastPMSolver * fastpm, FastPMStore * p, const char * filename)
             for(ip = 0, q = 0; ip < nbatch; ip ++) {
                 int d;
                 for(d = 0; d < 3; d ++)
-                    p->x[offset + nread + ip][d] = fscratch[q++];
+                    pos[offset + nread + ip][d] = fscratch[q++];
             }
             nread += nbatch;
         }
@@ -250,7 +254,7 @@ read_runpb_ic(FastPMSolver * fastpm, FastPMStore * p, const char * filename)
     double dx2disp[3] = {0};
     int ip;
     for(ip = 0; ip < offset; ip ++) {
-        double * x = p->x[ip];
+        double x[3];
         float * v = p->v[ip];
         float * dx1 = p->dx1[ip];
         float * dx2 = p->dx2[ip];
@@ -261,7 +265,7 @@ read_runpb_ic(FastPMSolver * fastpm, FastPMStore * p, const char * filename)
         for(d = 0; d < 3; d ++ ) {
             double opos = (id / strides[d]) * (1.0 / fastpm->config->nc) + offset0;
             id %= strides[d];
-            double disp = x[d] - opos;
+            double disp = pos[ip][d] - opos;
             if(disp < -0.5) disp += 1.0;
             if(disp > 0.5) disp -= 1.0;
             dx1[d] = (v[d] - disp * (2 * f2)) / (f1 - 2 * f2) / DplusIC;
@@ -285,6 +289,7 @@ read_runpb_ic(FastPMSolver * fastpm, FastPMStore * p, const char * filename)
             dx1disp[d] += dx1[d] * dx1[d];
             dx2disp[d] += dx2[d] * dx2[d];
         }
+        fastpm_store_set_position(p, ip, x);
     }
 
     MPI_Allreduce(MPI_IN_PLACE, dx1disp, 3, MPI_DOUBLE, MPI_SUM, comm);
@@ -302,6 +307,7 @@ read_runpb_ic(FastPMSolver * fastpm, FastPMStore * p, const char * filename)
             dx2disp[0], dx2disp[1], dx2disp[2],
             (dx2disp[0] + dx2disp[1] + dx2disp[2]) / 3.0);
 
+    free(pos);
     free(NcumFile);
     free(NperFile);
     free(scratch);
@@ -369,8 +375,10 @@ static void write_mine(const char * filebase,
             int ip, q;
             for(ip = 0, q = 0; ip < nbatch; ip ++) {
                 int d;
+                double x[3];
+                fastpm_store_get_position(p, offset + nread + ip, x);
                 for(d = 0; d < 3; d++) 
-                    fscratch[q++] = p->x[offset + nread + ip][d] / boxsize;
+                    fscratch[q++] = x[d] / boxsize;
             }
             fwrite_or_die(scratch, sizeof(float) * 3, nbatch, fp, "pos");
             nread += nbatch;
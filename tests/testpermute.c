@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <string.h>
+#include <mpi.h>
+
+#include <fastpm/libfastpm.h>
+#include <fastpm/logging.h>
+
+static void
+fill(FastPMStore * p)
+{
+    ptrdiff_t i;
+    for(i = 0; i < p->np; i ++) {
+        p->id[i] = i;
+        p->x[i][0] = i;
+        p->x[i][1] = 2 * i;
+        p->x[i][2] = 3 * i;
+    }
+}
+
+/* OUT[i] = IN[ind[i]] for every column */
+static void
+check(FastPMStore * p, int * ind, const char * name)
+{
+    ptrdiff_t i;
+    for(i = 0; i < p->np; i ++) {
+        if(p->id[i] != ind[i]
+        || p->x[i][0] != ind[i]
+        || p->x[i][1] != 2 * ind[i]
+        || p->x[i][2] != 3 * ind[i]) {
+            fastpm_raise(-1, "%s: item %td is %ld, expecting %d\n", name, i, (long) p->id[i], ind[i]);
+        }
+    }
+    fastpm_info("%s: passed\n", name);
+}
+
+int main(int argc, char * argv[]) {
+
+    MPI_Init(&argc, &argv);
+
+    libfastpm_init();
+
+    MPI_Comm comm = MPI_COMM_WORLD;
+
+    fastpm_set_msg_handler(fastpm_default_msg_handler, comm, NULL);
+
+    int np = 1000;
+    int * ind = malloc(sizeof(int) * np);
+    int i;
+
+    FastPMStore p[1];
+    fastpm_store_init(p, "1", np, COLUMN_ID | COLUMN_POS, FASTPM_MEMORY_HEAP);
+    p->np = np;
+
+    /* a permutation with one long cycle; i * 21 + 3 visits all of 0 .. 999
+     * before it returns, as 20 is a multiple of 4 and 5 and 3 is coprime to 1000. */
+    for(i = 0; i < np; i ++) {
+        ind[i] = (i * 21 + 3) % np;
+    }
+    fill(p);
+    fastpm_store_permute(p, ind);
+    check(p, ind, "permute long cycle");
+
+    /* a permutation of fixed points and swaps */
+    for(i = 0; i < np; i ++) {
+        ind[i] = (i / 2 % 3 == 0) ? i : (i ^ 1);
+    }
+    fill(p);
+    fastpm_store_permute(p, ind);
+    check(p, ind, "permute swaps");
+
+    /* replicate the first item of every segment of 10, as FOF does */
+    for(i = 0; i < np; i ++) {
+        ind[i] = i - i % 10;
+    }
+    fill(p);
+    fastpm_store_gather(p, ind);
+    check(p, ind, "gather replication");
+
+    fastpm_store_destroy(p);
+    free(ind);
+
+    libfastpm_cleanup();
+    MPI_Finalize();
+    return 0;
+}
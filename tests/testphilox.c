@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <mpi.h>
+
+#include <fastpm/libfastpm.h>
+#include <fastpm/logging.h>
+
+/* known answers of Philox4x32-10 from the kat_vectors of Random123 */
+static void
+test_kat()
+{
+    struct {
+        uint32_t ctr[4];
+        uint32_t key[2];
+        uint32_t expected[4];
+    } kat[] = {
+        {{0x00000000, 0x00000000, 0x00000000, 0x00000000},
+         {0x00000000, 0x00000000},
+         {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}},
+        {{0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff},
+         {0xffffffff, 0xffffffff},
+         {0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd}},
+        {{0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344},
+         {0xa4093822, 0x299f31d0},
+         {0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}},
+    };
+
+    int t;
+    for(t = 0; t < sizeof(kat) / sizeof(kat[0]); t ++) {
+        uint32_t ctr[4];
+        memcpy(ctr, kat[t].ctr, sizeof(ctr));
+        fastpm_philox4x32(ctr, kat[t].key);
+        int d;
+        for(d = 0; d < 4; d ++) {
+            if(ctr[d] != kat[t].expected[d]) {
+                fastpm_raise(-1, "kat %d: word %d is %08x, expecting %08x\n", t, d, ctr[d], kat[t].expected[d]);
+            }
+        }
+    }
+    fastpm_info("kat: passed\n");
+}
+
+/* the modes of the field on all ranks, indexed by the absolute mesh index */
+static double *
+gather_modes(int Ngrid, int NprocY, int transposed, int seed, MPI_Comm comm)
+{
+    PM * pm = fastpm_create_pm(Ngrid, NprocY, transposed, 100., comm);
+    FastPMFloat * delta_k = pm_alloc(pm);
+
+    fastpm_ic_fill_gaussiank(pm, delta_k, seed, FASTPM_DELTAK_PHILOX);
+
+    size_t size = 2 * Ngrid * Ngrid * (Ngrid / 2 + 1);
+    double * modes = calloc(size, sizeof(double));
+
+    PMKIter kiter;
+    for(pm_kiter_init(pm, &kiter);
+        !pm_kiter_stop(&kiter);
+        pm_kiter_next(&kiter)) {
+        ptrdiff_t ind = (kiter.iabs[0] * Ngrid + kiter.iabs[1]) * (Ngrid / 2 + 1) + kiter.iabs[2];
+        modes[2 * ind + 0] = delta_k[kiter.ind + 0];
+        modes[2 * ind + 1] = delta_k[kiter.ind + 1];
+    }
+
+    /* every mode is on one rank; the sum is exact */
+    MPI_Allreduce(MPI_IN_PLACE, modes, size, MPI_DOUBLE, MPI_SUM, comm);
+
+    pm_free(pm, delta_k);
+    fastpm_free_pm(pm);
+    return modes;
+}
+
+/* the same seed gives the same field on any process mesh */
+static void
+test_decomposition(MPI_Comm comm)
+{
+    int Ngrid = 16;
+    size_t size = 2 * Ngrid * Ngrid * (Ngrid / 2 + 1);
+
+    double * slabs = gather_modes(Ngrid, 1, 0, 42, comm);
+    double * pencils = gather_modes(Ngrid, 0, 1, 42, comm);
+    double * other = gather_modes(Ngrid, 0, 1, 43, comm);
+
+    size_t i;
+    int same = 1;
+    for(i = 0; i < size; i ++) {
+        if(slabs[i] != pencils[i]) {
+            fastpm_raise(-1, "decomposition: mode %zu differs: %g != %g\n", i / 2, slabs[i], pencils[i]);
+        }
+        if(slabs[i] != other[i]) same = 0;
+    }
+    if(same) {
+        fastpm_raise(-1, "decomposition: seed 42 and 43 give the same field\n");
+    }
+
+    free(other);
+    free(pencils);
+    free(slabs);
+    fastpm_info("decomposition: passed\n");
+}
+
+int main(int argc, char * argv[]) {
+
+    MPI_Init(&argc, &argv);
+
+    libfastpm_init();
+
+    MPI_Comm comm = MPI_COMM_WORLD;
+
+    fastpm_set_msg_handler(fastpm_default_msg_handler, comm, NULL);
+
+    test_kat();
+    test_decomposition(comm);
+
+    libfastpm_cleanup();
+    MPI_Finalize();
+    return 0;
+}